@@ -0,0 +1,280 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include "Lib/Universe.h"
+#include "Lib/Profiler.h"
+#include "Lib/Particle.h"
+#include "Lib/DistributedUniverse.h"
+#include "Lib/Generators.h"
+#include "Lib/ParticleIO.h"
+
+#include <unistd.h>
+#ifndef __EMSCRIPTEN__
+#include <sys/wait.h>
+#endif
+
+/*
+ * Headless benchmark of Universe::advance(). Fills a 1920x1080 universe with a lattice of particles of the types
+ * in Setups/default.txt and reports steps per second and candidate pair counts for each box subdivision.
+ * If maxRanks is given, also reports steps per second of DistributedUniverse with 1, 2, 4... single-threaded
+ * processes exchanging halos over shared memory.
+ * With --profile, the steps with cellsPerRange 1 are profiled: time and hardware counters per phase and thread are
+ * reported, and a timeline of the boxes each thread computed is written to traceFile as Chrome trace-event JSON.
+ *
+ * With --longRange, the Barnes-Hut evaluation of the long-range force (LongRange.h) between equal charges is compared
+ * against direct summation (opening angle 0) for several opening angles: time per evaluation of all particles,
+ * force errors relative to the root mean square force and steps per second of a universe with the long-range force.
+ *
+ * With --generate, a scene of the given number of particles is generated with a lattice fill and with a random fill
+ * (Generators.h) and added to a universe one by one and in bulk, reporting the time of each. The lattice scene is
+ * then exported and imported in each format of ParticleIO.h. Stepping isn't benchmarked then, as scenes of millions
+ * of particles take long to step.
+ *
+ * Usage: Benchmark [--profile traceFile] [--longRange] [--generate] [particles=5000] [steps=20] [maxRanks=0]
+ */
+
+template<typename T>
+static void fillLattice(T &universe, int nParticles) {
+    const UniverseConfig &config = universe.getConfig();
+    double spacing = std::sqrt((double) config.sizeX * config.sizeY / nParticles);
+    int perRow = std::max(1, (int) (config.sizeX / spacing));
+    for(int i = 0; i < nParticles; ++i) {
+        Vector2D pos((i % perRow + 0.5) * spacing, (i / perRow + 0.5) * spacing);
+        Vector2D v(0.3 * std::sin(i * 1.7), 0.3 * std::cos(i * 2.3)); // Deterministic pseudorandom velocities
+        universe.addParticle(i % universe.getParticleTypes().size(), ParticleState(pos, v));
+    }
+}
+
+static void benchmarkLongRange(std::vector<ParticleType> types, int nParticles, int nSteps, double dT) {
+    for(ParticleType &type: types)
+        type.setCharge(1);
+    UniverseConfig config{ 1920, 1080, 1e-2, 0 };
+    config.longRangeCoupling = -1e-1; // Self-gravitating
+
+    // Forces of a single evaluation, compared particle by particle against direct summation
+    Universe reference(config, types);
+    fillLattice(reference, nParticles);
+    UniverseState state;
+    state.setInteractionDistance(config, 28);
+    for(const ParticleState &p: reference)
+        state.insert(p);
+    state.prepareDifferentiation();
+
+    auto evaluate = [&](double openingAngle, std::vector<Vector2D> &fields) {
+        auto begin = std::chrono::steady_clock::now();
+        BarnesHutTree tree;
+        tree.build(state);
+        fields.clear();
+        for(const ParticleState &p: state) {
+            Vector2D field;
+            double potential;
+            tree.field(state, p, openingAngle, config.longRangeSoftening, field, potential);
+            fields.push_back(field);
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    };
+
+    std::vector<Vector2D> direct, fields;
+    double directSeconds = evaluate(0, direct);
+    std::cout << "openingAngle  seconds  speedup  rmsError  maxError  steps/s" << std::endl;
+    for(double openingAngle: { 0., 0.3, 0.5, 0.7, 1. }) {
+        double seconds = evaluate(openingAngle, fields);
+        // Errors relative to the root mean square force, as forces nearly cancel in the middle of the lattice
+        double directSum2 = 0, sum2 = 0, maxError = 0;
+        for(const Vector2D &field: direct)
+            directSum2 += field.x * field.x + field.y * field.y;
+        double rmsField = std::max(std::sqrt(directSum2 / direct.size()), 1e-12);
+        for(size_t i = 0; i < fields.size(); ++i) {
+            double error = (fields[i] - direct[i]).magnitude() / rmsField;
+            sum2 += error * error;
+            maxError = std::max(maxError, error);
+        }
+
+        config.openingAngle = openingAngle;
+        Universe universe(config, types);
+        fillLattice(universe, nParticles);
+        universe.advance(dT); // Warm up buffers
+        auto begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < nSteps; ++i)
+            universe.advance(dT);
+        double stepSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        std::cout << std::setprecision(3) << std::setw(12) << openingAngle << std::setw(9) << seconds
+                  << std::setw(9) << directSeconds / seconds << std::setw(10) << std::sqrt(sum2 / fields.size())
+                  << std::setw(10) << maxError << std::setw(9) << nSteps / stepSeconds << std::endl;
+    }
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void benchmarkGenerators(const std::vector<ParticleType> &types, int nParticles) {
+    // A square universe of the area of nParticles lattice cells
+    double spacing = 8;
+    int size = std::sqrt(nParticles * spacing * spacing * std::sqrt(3.) / 2);
+    UniverseConfig config{ size, size, 1e-2, 0 };
+    std::unique_ptr<Universe> lattice;
+
+    std::cout << std::endl << "generator  particles  generate [s]  add [s]  bulk add [s]" << std::endl;
+    for(GeneratorKind kind: { GeneratorKind::lattice, GeneratorKind::random }) {
+        GeneratorSetup generator;
+        generator.kind = kind;
+        generator.maxX = generator.maxY = size;
+        generator.spacing = kind == GeneratorKind::lattice ? spacing : spacing * 0.75;
+        generator.density = 1 / (spacing * spacing * std::sqrt(3.) / 2);
+        generator.temperature = 1;
+
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<ParticleState> particles;
+        generateParticles(generator, config, types[0].getMass(), 0, 0, particles);
+        double generateSeconds = secondsSince(begin);
+
+        begin = std::chrono::steady_clock::now();
+        Universe universe(config, types);
+        for(const ParticleState &p: particles)
+            universe.addParticle(0, p);
+        double addSeconds = secondsSince(begin);
+
+        begin = std::chrono::steady_clock::now();
+        std::unique_ptr<Universe> bulk(new Universe(config, types));
+        for(ParticleState &p: particles)
+            p.type = & bulk->getParticleTypes()[0];
+        bulk->addParticles(particles);
+        double bulkSeconds = secondsSince(begin);
+        if(kind == GeneratorKind::lattice) lattice = std::move(bulk);
+
+        std::cout << std::setw(9) << (kind == GeneratorKind::lattice ? "lattice" : "random") << std::setw(11)
+                  << particles.size() << std::setw(14) << std::setprecision(3) << generateSeconds << std::setw(9)
+                  << addSeconds << std::setw(14) << bulkSeconds << std::endl;
+    }
+
+    std::cout << std::endl << "format  export [s]  import [s]  MB" << std::endl;
+    std::string path = std::string(P_tmpdir) + "/PhaseTransitionBenchmark-" + std::to_string(getpid());
+    for(ParticleFormat format: { ParticleFormat::csv, ParticleFormat::binary }) {
+        auto begin = std::chrono::steady_clock::now();
+        exportParticles(*lattice, path, format);
+        double exportSeconds = secondsSince(begin);
+
+        begin = std::chrono::steady_clock::now();
+        Universe universe(config, types);
+        importParticles(universe, path, format);
+        double importSeconds = secondsSince(begin);
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        std::cout << std::setw(6) << (format == ParticleFormat::csv ? "csv" : "binary") << std::setw(12)
+                  << std::setprecision(3) << exportSeconds << std::setw(12) << importSeconds << std::setw(8)
+                  << std::setprecision(3) << file.tellg() / 1e6 << std::endl;
+        std::remove(path.c_str());
+    }
+}
+
+#ifndef __EMSCRIPTEN__
+static double distributedStepsPerSecond(const std::vector<ParticleType> &types, int nParticles, int nSteps,
+        double dT, int nRanks) {
+    // Rank 0 is this process, the others are forked. Threads don't survive fork(), so every rank uses one.
+    UniverseConfig config{ 1920, 1080, 1e-2, 1e-2 };
+    config.threads = 1;
+    std::string name = "PhaseTransitionBenchmark-" + std::to_string(getpid());
+
+    auto run = [&](int rank) {
+        ShmTransport transport(name, rank, nRanks);
+        DistributedUniverse universe(config, types, transport);
+        fillLattice(universe, nParticles);
+        universe.advance(dT); // Warm up buffers
+
+        auto begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < nSteps; ++i)
+            universe.advance(dT);
+        return nSteps / std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    };
+
+    std::vector<pid_t> children;
+    for(int rank = 1; rank < nRanks; ++rank) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            run(rank);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    double stepsPerSecond = run(0);
+    for(pid_t pid: children)
+        waitpid(pid, nullptr, 0);
+    return stepsPerSecond;
+}
+#endif
+
+int main(int argc, char **argv) {
+    std::string tracePath;
+    bool longRange = false, generate = false;
+    std::vector<std::string> args;
+    for(int i = 1; i < argc; ++i) {
+        if(std::string(argv[i]) == "--profile" && i + 1 < argc) tracePath = argv[++i];
+        else if(std::string(argv[i]) == "--longRange") longRange = true;
+        else if(std::string(argv[i]) == "--generate") generate = true;
+        else args.push_back(argv[i]);
+    }
+    int nParticles = args.size() > 0 ? std::stoi(args[0]) : 5000;
+    int nSteps = args.size() > 1 ? std::stoi(args[1]) : 20;
+    int maxRanks = args.size() > 2 ? std::stoi(args[2]) : 0;
+    const double dT = 0.1;
+
+    std::vector<ParticleType> types = {
+            ParticleType(1, 4, 2, 0.8, 20),
+            ParticleType(1, 5.6, 2.8, 1.12, 28),
+            ParticleType(1, 5.6, 11.2, 0, 28)
+    };
+    if(generate) {
+        benchmarkGenerators(types, nParticles);
+        return 0;
+    }
+
+    std::cout << "particles = " << nParticles << ", steps = " << nSteps << std::endl;
+    std::cout << "cellsPerRange  steps/s  candidates  inRange  inRange/candidates" << std::endl;
+    for(int cellsPerRange = 1; cellsPerRange <= 3; ++cellsPerRange) {
+        UniverseConfig config{ 1920, 1080, 1e-2, 1e-2 };
+        config.cellsPerRange = cellsPerRange;
+        Universe universe(config, types);
+        fillLattice(universe, nParticles);
+        universe.advance(dT); // Warm up buffers
+
+        std::unique_ptr<Profiler> profiler;
+        if(! tracePath.empty() && cellsPerRange == 1) profiler.reset(new Profiler);
+        Profiler::activate(profiler.get());
+        auto begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < nSteps; ++i)
+            universe.advance(dT);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        Profiler::activate(nullptr);
+
+        PairCounts pairs = universe.countPairs();
+        std::cout << std::setw(13) << cellsPerRange << std::setw(9) << std::setprecision(3) << nSteps / seconds
+                  << std::setw(12) << pairs.candidates << std::setw(9) << pairs.inRange
+                  << std::setw(20) << std::setprecision(3) << (double) pairs.inRange / pairs.candidates << std::endl;
+
+        if(profiler) {
+            std::ofstream trace(tracePath);
+            profiler->writeTrace(trace);
+            std::cout << std::endl << "Profile of cellsPerRange 1, timeline written to " << tracePath
+                      << (profiler->countersAvailable() ? "" : " (hardware counters unavailable)") << std::endl;
+            profiler->writeSummary(std::cout);
+            std::cout << std::endl;
+        }
+    }
+
+    if(longRange) benchmarkLongRange(types, nParticles, nSteps, dT);
+
+#ifndef __EMSCRIPTEN__
+    if(maxRanks > 0) std::cout << "ranks  steps/s" << std::endl;
+    for(int nRanks = 1; nRanks <= maxRanks; nRanks *= 2)
+        std::cout << std::setw(5) << nRanks << std::setw(9) << std::setprecision(3)
+                  << distributedStepsPerSecond(types, nParticles, nSteps, dT, nRanks) << std::endl;
+#endif
+    return 0;
+}
@@ -0,0 +1,44 @@
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include "Lib/Ensemble.h"
+
+/*
+ * Runs the parameter sweep of a sweep spec file (see Ensemble.h) and writes one line of summary observables per run
+ * into its output file. Progress is reported as runs finish, which isn't in run order.
+ *
+ * Usage: Ensemble specFile
+ */
+
+int main(int argc, char **argv) {
+    if(argc != 2) {
+        std::cout << "Usage: Ensemble specFile" << std::endl;
+        return 1;
+    }
+    EnsembleSpec spec(argv[1]);
+    if(spec.outputPath.empty()) {
+        std::cout << "Expected an output file in " << argv[1] << std::endl;
+        return 1;
+    }
+    std::ofstream out(spec.outputPath);
+    if(! out) {
+        std::cout << "Can't write " << spec.outputPath << std::endl;
+        return 1;
+    }
+
+    size_t nRuns = ensembleRuns(spec).size(), nFinished = 0;
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<EnsembleResult> results = runEnsemble(spec, [&](const EnsembleResult &result) {
+        std::cout << "Run " << result.run.index << " finished in " << std::setprecision(3) << result.seconds
+                  << " s (" << ++nFinished << "/" << nRuns << ")" << std::endl;
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    writeEnsembleHeader(out);
+    for(const EnsembleResult &result: results)
+        writeEnsembleResult(out, result);
+    std::cout << nRuns << " runs in " << seconds << " s, results written to " << spec.outputPath << std::endl;
+    return 0;
+}
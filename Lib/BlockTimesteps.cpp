@@ -0,0 +1,77 @@
+
+#include "Lib/BlockTimesteps.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static int timestepLevel(const ParticleState &pState, const ParticleState &pAcc, const UniverseConfig &config,
+        double dT) {
+    const double inf = std::numeric_limits<double>::infinity();
+    double radius = pState.type->getRadius();
+    double v = pState.v.magnitude(), a = pAcc.v.magnitude();
+    double maxDT = config.timestepAccuracy * std::min(v > 0 ? radius / v : inf, a > 0 ? std::sqrt(radius / a) : inf);
+
+    int level = 0;
+    while(level < config.maxTimestepLevel && dT / (1 << level) > maxDT)
+        ++level;
+    return level;
+}
+
+void advanceBlockTimesteps(UniverseState &x, const UniverseDifferentiator &diff, double dT,
+        BlockTimestepsWorkspace &w) {
+    const int maxLevel = diff.config.maxTimestepLevel;
+    const int nTicks = 1 << maxLevel;
+    const double tickDT = dT / nTicks;
+
+    diff.prepareDifferentiation(x);
+
+    UniverseState &acc = w.acc;
+    UniverseBuffers &accBuffers = w.accBuffers;
+    ParticleMask &active = w.active;
+    std::vector<std::vector<int>> &strides = w.strides;
+
+    // Full force evaluation for choosing levels
+    diff.initAccelerations(acc, accBuffers, x);
+    active.resize(x);
+    strides.resize(x.cells.size());
+    for(size_t c = 0; c < x.cells.size(); ++c) {
+        active.flags[c].assign(x.cells[c].particles.size(), 1);
+        active.cellCounts[c] = x.cells[c].particles.size();
+    }
+    diff.activeAccelerations(acc, accBuffers, x, active);
+
+    for(size_t c = 0; c < x.cells.size(); ++c) {
+        const auto &particles = x.cells[c].particles;
+        strides[c].resize(particles.size());
+        for(size_t i = 0; i < particles.size(); ++i)
+            strides[c][i] = nTicks >> timestepLevel(particles[i], acc.cells[c].particles[i], diff.config, dT);
+    }
+
+    for(int tick = 0; tick < nTicks; ++tick) {
+        for(size_t c = 0; c < x.cells.size(); ++c) {
+            auto &particles = x.cells[c].particles;
+            int count = 0;
+            for(size_t i = 0; i < particles.size(); ++i) {
+                int stride = strides[c][i];
+                if(tick % stride == 0) // Opening kick
+                    particles[i].v += acc.cells[c].particles[i].v * (0.5 * stride * tickDT);
+                particles[i].pos += particles[i].v * tickDT;
+
+                bool ends = (tick + 1) % stride == 0;
+                active.flags[c][i] = ends;
+                count += ends;
+            }
+            active.cellCounts[c] = count;
+        }
+
+        diff.activeAccelerations(acc, accBuffers, x, active);
+
+        for(size_t c = 0; c < x.cells.size(); ++c) {
+            if(! active.cellCounts[c]) continue;
+            auto &particles = x.cells[c].particles;
+            for(size_t i = 0; i < particles.size(); ++i)
+                if(active.flags[c][i]) // Closing kick
+                    particles[i].v += acc.cells[c].particles[i].v * (0.5 * strides[c][i] * tickDT);
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef __BLOCK_TIMESTEPS_H__
+#define __BLOCK_TIMESTEPS_H__
+
+#include "Lib/Universe.h"
+
+/*
+ * Hierarchical block timesteps: the step dT is split into 2^maxLevel ticks and each particle is assigned a level L,
+ * meaning that it is integrated with step dT / 2^L. The level is chosen from the particle's velocity and acceleration
+ * at the beginning of the step, so that fast or strongly accelerated particles get small steps, while slow ones
+ * are integrated with the full dT.
+ *
+ * Particles are integrated with kick-drift-kick leapfrog. Positions of all particles drift every tick (which is
+ * cheap), but forces are only evaluated for the particles whose step ends at the current tick. Other particles still
+ * exert forces at their drifted positions. Thus the cost of force evaluation scales with the number of active
+ * particles, plus one full evaluation at the beginning of dT for choosing the levels.
+ */
+
+struct BlockTimestepsWorkspace {
+    UniverseState acc;
+    UniverseBuffers accBuffers; // Only for performance reasons
+    ParticleMask active;
+    std::vector<std::vector<int>> strides; // Ticks per step of each particle
+};
+
+void advanceBlockTimesteps(UniverseState &x, const UniverseDifferentiator &diff, double dT,
+        BlockTimestepsWorkspace &w);
+
+#endif
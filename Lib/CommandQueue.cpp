@@ -0,0 +1,76 @@
+
+#include "Lib/CommandQueue.h"
+
+UniverseCommand UniverseCommand::add(int particleType, const Vector2D &pos, const Vector2D &v) {
+    UniverseCommand command;
+    command.type = CommandType::add;
+    command.particleType = particleType;
+    command.pos = pos;
+    command.v = v;
+    return command;
+}
+
+UniverseCommand UniverseCommand::removeInRadius(const Vector2D &pos, double radius) {
+    UniverseCommand command;
+    command.type = CommandType::removeInRadius;
+    command.pos = pos;
+    command.radius = radius;
+    return command;
+}
+
+UniverseCommand UniverseCommand::impulse(const Vector2D &pos, double radius, const Vector2D &dv) {
+    UniverseCommand command;
+    command.type = CommandType::impulse;
+    command.pos = pos;
+    command.radius = radius;
+    command.v = dv;
+    return command;
+}
+
+UniverseCommand UniverseCommand::heat(const Vector2D &pos, double radius, double factor) {
+    UniverseCommand command;
+    command.type = CommandType::heat;
+    command.pos = pos;
+    command.radius = radius;
+    command.factor = factor;
+    return command;
+}
+
+UniverseCommand UniverseCommand::setThermostats(const std::vector<Thermostat> &thermostats) {
+    UniverseCommand command;
+    command.type = CommandType::setThermostats;
+    command.thermostats = thermostats;
+    return command;
+}
+
+CommandQueue::CommandQueue() {
+    tail = new Node;
+    head.store(tail, std::memory_order_relaxed);
+}
+
+CommandQueue::~CommandQueue() {
+    while(tail) {
+        Node *next = tail->next.load(std::memory_order_relaxed);
+        delete tail;
+        tail = next;
+    }
+}
+
+void CommandQueue::push(UniverseCommand command) {
+    Node *node = new Node;
+    node->command = std::move(command);
+    Node *previous = head.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release); // Until here, the node isn't reachable from tail
+}
+
+size_t CommandQueue::drain(std::vector<UniverseCommand> &commands) {
+    size_t drained = 0;
+    for(Node *next = tail->next.load(std::memory_order_acquire); next;
+            next = tail->next.load(std::memory_order_acquire)) {
+        commands.push_back(std::move(next->command));
+        delete tail;
+        tail = next; // The consumed node becomes the new stub
+        ++drained;
+    }
+    return drained;
+}
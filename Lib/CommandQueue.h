@@ -0,0 +1,67 @@
+#ifndef __COMMAND_QUEUE_H__
+#define __COMMAND_QUEUE_H__
+
+#include <atomic>
+#include <vector>
+#include "Lib/Vector2.h"
+#include "Lib/Thermostat.h"
+
+/*
+ * UniverseCommand is an edit of a running universe, which can be created on any thread. Commands are applied by
+ * the simulation thread in the order they were pushed, at the beginning of the next step:
+ *
+ * add: adds a particle of particleType at pos with velocity v
+ * removeInRadius: removes all particles closer than radius to pos
+ * impulse: adds v to the velocities of the particles closer than radius to pos
+ * heat: multiplies the velocities of the particles closer than radius to pos by factor
+ * setThermostats: replaces the thermostats of the universe
+ */
+
+enum class CommandType { add, removeInRadius, impulse, heat, setThermostats };
+
+struct UniverseCommand {
+    CommandType type = CommandType::add;
+    int particleType = 0;
+    Vector2D pos, v;
+    double radius = 0, factor = 1;
+    std::vector<Thermostat> thermostats;
+
+    static UniverseCommand add(int particleType, const Vector2D &pos, const Vector2D &v = Vector2D());
+    static UniverseCommand removeInRadius(const Vector2D &pos, double radius);
+    static UniverseCommand impulse(const Vector2D &pos, double radius, const Vector2D &dv);
+    static UniverseCommand heat(const Vector2D &pos, double radius, double factor);
+    static UniverseCommand setThermostats(const std::vector<Thermostat> &thermostats);
+
+    inline bool affects(const Vector2D &p) const { return (p - pos).magnitude2() < radius * radius; }
+};
+
+/*
+ * CommandQueue is a lock-free multiple producer, single consumer queue of UniverseCommands (Dmitry Vyukov's
+ * intrusive MPSC queue). push() can be called from any number of threads at any time and never waits for other
+ * threads. drain() may only be called by the thread advancing the universe. A push that is still in progress isn't
+ * visible to drain() yet, its command and the ones pushed after it are left for the next drain().
+ */
+
+class CommandQueue {
+public:
+    CommandQueue();
+    ~CommandQueue();
+    CommandQueue(const CommandQueue &) = delete;
+    CommandQueue & operator=(const CommandQueue &) = delete;
+
+    void push(UniverseCommand command);
+    size_t drain(std::vector<UniverseCommand> &commands); // Appends the available commands, returns their number
+
+private:
+    struct Node {
+        std::atomic<Node *> next{ nullptr };
+        UniverseCommand command;
+    };
+
+    char spacer1[256]; // head is written by producers, tail by the consumer, keep them on different cache lines
+    std::atomic<Node *> head; // Last pushed node
+    char spacer2[256];
+    Node *tail; // Already consumed node, whose next is the oldest command
+};
+
+#endif
@@ -0,0 +1,18 @@
+
+#include "Lib/Conservation.h"
+#include <algorithm>
+#include <cmath>
+
+void ConservationTracker::add(const ObservableSample &sample) {
+    ObservableBin total = sample.grid.total();
+    double energy = total.kineticEnergy + total.potentialEnergy;
+    if(nSamples++ == 0) {
+        initialEnergy = energy;
+        energyScale = std::max(total.kineticEnergy + std::abs(total.potentialEnergy), 1e-300);
+        initialMomentum = total.momentum;
+        return;
+    }
+
+    maxEnergyDrift = std::max(maxEnergyDrift, std::abs(energy - initialEnergy) / energyScale);
+    maxMomentumDrift = std::max(maxMomentumDrift, (total.momentum - initialMomentum).magnitude());
+}
@@ -0,0 +1,28 @@
+#ifndef __CONSERVATION_H__
+#define __CONSERVATION_H__
+
+#include "Lib/Observables.h"
+
+/*
+ * ConservationTracker follows the drift of total energy (kinetic + pair potential) and momentum over observable
+ * samples, one sample at a time. The first sample is the reference. Forces of the walls and gravity aren't
+ * included, so the quantities are only conserved while particles stay away from the walls and gravity is 0.
+ */
+
+class ConservationTracker {
+public:
+    void add(const ObservableSample &sample);
+
+    // Largest deviations so far. Energy drift is relative to the initial kinetic plus absolute potential energy.
+    inline double energyDrift() const { return maxEnergyDrift; }
+    inline double momentumDrift() const { return maxMomentumDrift; }
+    inline size_t samples() const { return nSamples; }
+
+private:
+    size_t nSamples = 0;
+    double initialEnergy = 0, energyScale = 1;
+    Vector2D initialMomentum;
+    double maxEnergyDrift = 0, maxMomentumDrift = 0;
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <chrono>
 #include <cassert>
+#include <limits>
 #include <SDL_ttf.h>
 #include "Display.h"
 #include "Globals.h"
@@ -46,6 +47,9 @@ void CallbackHandler::keyboardCallback(const SDL_Event &event) {
     if(key == 'p') action = MouseAction::push;
     if(key == 'c') action = MouseAction::create;
     if(key == 's') action = MouseAction::spray;
+    if(key == 'v') colorByPhase = ! colorByPhase;
+    if(key == 'b' && rewindPoints < std::numeric_limits<int>::max()) ++rewindPoints;
+    if(key == 'r') rewindPoints = std::numeric_limits<int>::max();
 
     if('1' <= key && key <= '9') {
         int newParticleType = key - '0' - 1;
@@ -56,8 +60,11 @@ void CallbackHandler::keyboardCallback(const SDL_Event &event) {
 
 
 void UniverseModifier::modify(Universe &universe, const CallbackHandler &handler, double dT) {
+    if(handler.rewindPoints) universe.rewind(handler.rewindPoints);
     if(! handler.sign) return; // No action from user
 
+    // Edited particles change the forces on their neighbours within the interaction range as well
+    universe.wake(handler.pos, handler.radius + universe.getInteractionRange());
     modifyExisting(universe, handler, dT);
     addNew(universe, handler, dT);
 }
@@ -193,9 +200,11 @@ const CallbackHandler & Display::update() {
     drawParticles();
     drawDisplayedCaption();
     drawStats();
+    drawPhaseStats();
     drawPointer();
     if(isRecording) recordAndDrawRecordingText();
     SDL_UpdateWindowSurface(window);
+    handler.rewindPoints = 0;
     SDL_Event event;
     while(SDL_PollEvent(& event)) {
         if(event.type == SDL_QUIT)
@@ -247,6 +256,23 @@ void Display::drawStats() {
     drawText("n = " + std::to_string(n), 30, 200);
     drawText("velocity = " + to_string(velocity, prec), 30, 230);
     drawText("temp = " + to_string(temp, prec), 30, 260);
+    drawText("sim speed = " + to_string(simulationSpeed, prec) + " / s", 30, 290);
+
+    if(universe.getObservations().empty()) return;
+    double pressure, potential;
+    std::tie(pressure, potential) = computeObservedStats();
+    drawText("pressure = " + to_string(pressure, prec + 2), 30, 320);
+    drawText("potential = " + to_string(potential, prec), 30, 350);
+}
+
+void Display::drawPhaseStats() {
+    if(! handler.colorByPhase || universe.getPhaseSamples().empty()) return;
+    const PhaseSample &sample = universe.getPhaseSamples().back();
+    double total = std::max(universe.size(), (size_t) 1);
+    drawText("solid " + to_string(100 * sample.phaseCounts[(int) Phase::solid] / total, 0) +
+            "%, liquid " + to_string(100 * sample.phaseCounts[(int) Phase::liquid] / total, 0) +
+            "%, gas " + to_string(100 * sample.phaseCounts[(int) Phase::gas] / total, 0) + "%", 30, 380);
+    drawText("largest cluster = " + std::to_string(sample.largestCluster), 30, 410);
 }
 
 void Display::drawText(const std::string &text, int x, int y) {
@@ -294,11 +320,36 @@ std::tuple<int, double, double> Display::computeStats() const {
     return { n, velocity.magnitude(), temp };
 }
 
+std::tuple<double, double> Display::computeObservedStats() const {
+    // Pressure and potential energy per particle of the observed bins, whose centers are within the pointer
+    const ObservableGrid &grid = universe.getObservations().back().grid;
+    ObservableBin sum;
+    int nBins = 0;
+    for(int y = 0; y < grid.binsY; ++y)
+        for(int x = 0; x < grid.binsX; ++x) {
+            Vector2D center((x + 0.5) * grid.binSize, (y + 0.5) * grid.binSize);
+            if((center - handler.pos).magnitude2() >= handler.radius * handler.radius) continue;
+            sum += grid.bins[y * grid.binsX + x];
+            ++nBins;
+        }
+    if(! nBins) return { 0, 0 };
+    return { sum.pressure(nBins * grid.binSize * grid.binSize), sum.n ? sum.potentialEnergy / sum.n : 0 };
+}
+
 void Display::drawParticles() {
+    // Colors of gas, liquid and solid particles in phase mode
+    static const Uint8 phaseColors[4][3] = { { 255, 255, 255 }, { 255, 90, 90 }, { 90, 150, 255 }, { 90, 255, 120 } };
+
     for(auto it = universe.begin(); it != universe.end(); ++it) {
         auto *particle = (SDL_Surface *) it->type->getSpriteSurface();
         assert(particle != nullptr);
+        if(handler.colorByPhase) {
+            const Uint8 *color = phaseColors[(int) it->phase];
+            SDL_SetSurfaceColorMod(particle, color[0], color[1], color[2]);
+        }
         drawSpriteFromCenter(particle, it->pos.x, it->pos.y);
+        if(handler.colorByPhase)
+            SDL_SetSurfaceColorMod(particle, 255, 255, 255);
     }
 }
 
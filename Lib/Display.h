@@ -18,6 +18,8 @@ struct CallbackHandler {
     double radius = 50;
     bool leftDown = false, rightDown = false;
     bool quit = false;
+    bool colorByPhase = false;
+    int rewindPoints = 0; // Recorded states to go back to, set by keys b (one) and r (all). Reset every frame.
 
     MouseAction action = MouseAction::create;
     int particleTypeIdx = 0;
@@ -40,16 +42,19 @@ public:
             const std::string &_directoryPath, const std::string &recordingPath="");
     ~Display();
     const CallbackHandler & update();
+    inline void setSimulationSpeed(double speed) { simulationSpeed = speed; }
 
 private:
     void drawParticles();
     void drawDisplayedCaption();
     void drawPointer();
     void drawStats();
+    void drawPhaseStats();
     void drawText(const std::string &text, int x, int y);
     void drawSpriteFromCenter(SDL_Surface *sprite, int x, int y);
     void recordAndDrawRecordingText();
     std::tuple<int, double, double> computeStats() const;
+    std::tuple<double, double> computeObservedStats() const;
 
     Universe &universe;
     std::string windowCaption, displayedCaption;
@@ -64,6 +69,7 @@ private:
     bool isRecording;
 
     int timestamp = 0;
+    double simulationSpeed = 0;
 };
 
 std::string to_string(double x, int precision);
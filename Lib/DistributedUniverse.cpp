@@ -0,0 +1,184 @@
+
+#include "Lib/DistributedUniverse.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+DistributedDifferentiator::DistributedDifferentiator(const UniverseConfig &config, std::vector<ParticleType> types,
+        Transport &_transport): diff(config, std::move(types)), transport(_transport) {
+    for(const auto &cell: diff.stencil)
+        ghostRows = std::max(ghostRows, cell.y);
+}
+
+void DistributedDifferentiator::setRows(const UniverseState &state) {
+    int rank = transport.rank(), size = transport.size();
+    if(state.cellsY < size * ghostRows)
+        throw std::runtime_error("DistributedDifferentiator: too many ranks for " +
+                std::to_string(state.cellsY) + " rows of boxes");
+    rowBegin = state.cellsY * rank / size;
+    rowEnd = state.cellsY * (rank + 1) / size;
+}
+
+int DistributedDifferentiator::row(const ParticleState &pState, const UniverseState &state) const {
+    return std::max(0, std::min(state.cellsY - 1, (int) (pState.pos.y / state.sizePerBlock)));
+}
+
+void DistributedDifferentiator::prepareDifferentiation(UniverseState &state) const {
+    int rank = transport.rank(), size = transport.size();
+    clearGhosts(state);
+
+    // Particles that have left the strip are moved to the neighbour in their direction
+    std::vector<WireParticle> down, up;
+    auto route = [&](const ParticleState &pState) { // Returns whether the particle stays on this rank
+        int y = row(pState, state);
+        if(owns(y) || (y < rowBegin && rank == 0) || (y >= rowEnd && rank == size - 1)) return true;
+        WireParticle wire{ (int) (pState.type - diff.types.data()), 0, 0, pState.id, pState.pos, pState.v };
+        (y < rowBegin ? down : up).push_back(wire);
+        return false;
+    };
+    for(auto &cell: state.cells) {
+        auto staying = cell.particles.begin();
+        for(auto it = cell.particles.begin(); it != cell.particles.end(); ++it)
+            if(route(*it)) *staying++ = *it;
+        state.size_ -= cell.particles.end() - staying;
+        cell.particles.erase(staying, cell.particles.end());
+    }
+
+    // A particle can pass several strips within a step, so received particles that don't belong here are handed on.
+    // Upward moving particles are passed in a sweep from rank 0 up, then downward moving ones from the top rank down.
+    std::vector<char> out, in;
+    std::vector<ParticleState> received;
+    auto exchange = [&](int peer, std::vector<WireParticle> &particles) {
+        out.resize(particles.size() * sizeof(WireParticle));
+        if(! particles.empty()) std::memcpy(out.data(), particles.data(), out.size());
+        particles.clear();
+        transport.exchange(peer, out, in);
+        received.clear();
+        unpack(in, received);
+        for(const ParticleState &pState: received)
+            if(route(pState)) state.insert(pState);
+    };
+    std::vector<WireParticle> none;
+    if(rank > 0) exchange(rank - 1, none); // Receives from below
+    if(rank < size - 1) exchange(rank + 1, up);
+    if(rank < size - 1) exchange(rank + 1, none); // Receives from above
+    if(rank > 0) exchange(rank - 1, down);
+    assert(up.empty() && down.empty());
+
+    diff.prepareDifferentiation(state);
+    exchangeGhosts(state);
+}
+
+void DistributedDifferentiator::derivative(UniverseState &der, UniverseBuffers &derBuffers,
+        UniverseState &state) const {
+    // Ghost particles are replaced by the neighbours' particles of the same stage. Boxes and particle counts
+    // don't change within a step, so the layout of state is preserved.
+    if(transport.size() > 1) {
+        clearGhosts(state);
+        exchangeGhosts(state);
+    }
+    diff.derivative(der, derBuffers, state);
+}
+
+void DistributedDifferentiator::clearGhosts(UniverseState &state) const {
+    for(auto &cell: state.cells)
+        if(! owns(cell.y)) {
+            state.size_ -= cell.particles.size();
+            cell.particles.clear();
+        }
+}
+
+void DistributedDifferentiator::exchangeGhosts(UniverseState &state) const {
+    int rank = transport.rank(), size = transport.size();
+    std::vector<char> out, in;
+    if(rank > 0) {
+        pack(out, state, rowBegin, rowBegin + ghostRows);
+        transport.exchange(rank - 1, out, in);
+        unpack(in, state, false);
+    }
+    if(rank < size - 1) {
+        pack(out, state, rowEnd - ghostRows, rowEnd);
+        transport.exchange(rank + 1, out, in);
+        unpack(in, state, false);
+    }
+}
+
+void DistributedDifferentiator::pack(std::vector<char> &msg, const UniverseState &state, int rowFrom, int rowTo) const {
+    msg.clear();
+    for(const auto &cell: state.cells) {
+        if(cell.y < rowFrom || cell.y >= rowTo) continue;
+        for(const auto &pState: cell.particles) {
+            WireParticle wire{ (int) (pState.type - diff.types.data()), cell.x, cell.y, pState.id,
+                    pState.pos, pState.v };
+            const char *bytes = reinterpret_cast<const char *>(& wire);
+            msg.insert(msg.end(), bytes, bytes + sizeof(wire));
+        }
+    }
+}
+
+void DistributedDifferentiator::unpack(const std::vector<char> &msg, UniverseState &state, bool byPosition) const {
+    // Particles are either inserted by their position or into the box they were sent from
+    for(size_t offset = 0; offset + sizeof(WireParticle) <= msg.size(); offset += sizeof(WireParticle)) {
+        WireParticle wire;
+        std::memcpy(& wire, msg.data() + offset, sizeof(wire));
+        ParticleState pState(wire.pos, wire.v);
+        pState.type = & diff.types[wire.type];
+        pState.id = wire.id;
+        if(byPosition) state.insert(pState);
+        else state.insert(pState, wire.x, wire.y);
+    }
+}
+
+void DistributedDifferentiator::unpack(const std::vector<char> &msg, std::vector<ParticleState> &particles) const {
+    for(size_t offset = 0; offset + sizeof(WireParticle) <= msg.size(); offset += sizeof(WireParticle)) {
+        WireParticle wire;
+        std::memcpy(& wire, msg.data() + offset, sizeof(wire));
+        particles.emplace_back(wire.pos, wire.v);
+        particles.back().type = & diff.types[wire.type];
+        particles.back().id = wire.id;
+    }
+}
+
+
+DistributedUniverse::DistributedUniverse(const UniverseConfig &config, const std::vector<ParticleType> &types,
+        Transport &transport): diff(config, types, transport) {
+    state.setInteractionDistance(config, diff.diff.cellSize);
+    diff.setRows(state);
+}
+
+void DistributedUniverse::addParticle(int typeIndex, ParticleState pState) {
+    pState.id = nextParticleId++;
+    if(! diff.owns(diff.row(pState, state))) return;
+    pState.type = & diff.diff.types[typeIndex];
+    state.insert(pState);
+}
+
+void DistributedUniverse::advance(double dT) {
+    advanceRungeKutta4(state, diff, dT, workspace);
+}
+
+size_t DistributedUniverse::ownedSize() const {
+    size_t owned = 0;
+    for(const auto &cell: state.cells)
+        if(diff.owns(cell.y)) owned += cell.particles.size();
+    return owned;
+}
+
+std::vector<ParticleState> DistributedUniverse::gather() {
+    Transport &transport = diff.transport;
+    std::vector<ParticleState> particles;
+    std::vector<char> msg;
+    diff.pack(msg, state, diff.rowBegin, diff.rowEnd);
+    if(transport.rank() > 0) {
+        transport.send(0, msg);
+        return particles;
+    }
+
+    diff.unpack(msg, particles);
+    for(int rank = 1; rank < transport.size(); ++rank) {
+        transport.receive(rank, msg);
+        diff.unpack(msg, particles);
+    }
+    return particles;
+}
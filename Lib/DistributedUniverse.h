@@ -0,0 +1,65 @@
+#ifndef __DISTRIBUTED_UNIVERSE_H__
+#define __DISTRIBUTED_UNIVERSE_H__
+
+#include <vector>
+#include "Lib/Universe.h"
+#include "Lib/Transport.h"
+
+/*
+ * DistributedUniverse splits a universe between the ranks (processes) of a Transport. Each rank owns a horizontal
+ * strip of box rows and only integrates the particles in it. The rows next to the strip are held as ghost rows,
+ * which are copies of the neighbouring ranks' boundary rows (halo) and make the forces near the strip edges complete.
+ *
+ * DistributedDifferentiator wraps UniverseDifferentiator, so that the integrators can be used as they are:
+ * prepareDifferentiation() hands the particles that have left the strip over to the ranks owning them (through the
+ * strips in between, if they moved that far within a step) and receives the ghost rows, and derivative() refreshes
+ * the ghost rows with the neighbours' intermediate states before computing forces. Ghost rows keep their layout
+ * during a step, so the intermediate states of all stages stay compatible.
+ * All ranks have to call the collective methods (advance(), gather()) the same number of times.
+ */
+
+struct DistributedDifferentiator {
+    UniverseDifferentiator diff;
+    Transport &transport;
+    int rowBegin = 0, rowEnd = 0; // Box rows owned by this rank
+    int ghostRows = 1; // Rows needed on both sides of the strip
+
+    DistributedDifferentiator(const UniverseConfig &config, std::vector<ParticleType> types, Transport &_transport);
+    void setRows(const UniverseState &state); // Has to be called once the grid dimensions are known
+    void prepareDifferentiation(UniverseState &state) const;
+    void derivative(UniverseState &der, UniverseBuffers &derBuffers, UniverseState &state) const;
+
+    int row(const ParticleState &pState, const UniverseState &state) const;
+    inline bool owns(int y) const { return y >= rowBegin && y < rowEnd; }
+
+    // Messages of particles. Types are sent as indices into diff.types, so that they are valid on every rank.
+    void pack(std::vector<char> &msg, const UniverseState &state, int rowFrom, int rowTo) const; // Rows [from, to)
+    void unpack(const std::vector<char> &msg, UniverseState &state, bool byPosition) const;
+    void unpack(const std::vector<char> &msg, std::vector<ParticleState> &particles) const;
+
+private:
+    struct WireParticle { int type, x, y; uint32_t id; Vector2D pos, v; };
+
+    void clearGhosts(UniverseState &state) const;
+    void exchangeGhosts(UniverseState &state) const;
+};
+
+class DistributedUniverse {
+public:
+    DistributedUniverse(const UniverseConfig &config, const std::vector<ParticleType> &types, Transport &transport);
+    void addParticle(int typeIndex, ParticleState pState); // Ignored, unless the particle belongs to this rank's strip
+    void advance(double dT);
+    std::vector<ParticleState> gather(); // Returns all particles on rank 0 and nothing elsewhere
+
+    size_t ownedSize() const; // Particles integrated by this rank
+    inline const UniverseConfig & getConfig() const { return diff.diff.config; }
+    inline const std::vector<ParticleType> & getParticleTypes() const { return diff.diff.types; }
+
+private:
+    DistributedDifferentiator diff;
+    UniverseState state;
+    IntegratorWorkspace<UniverseState, UniverseBuffers> workspace;
+    uint32_t nextParticleId = 0; // Counts the particles added on all ranks, so ids are the same as in Universe
+};
+
+#endif
@@ -0,0 +1,207 @@
+
+#include "Lib/Ensemble.h"
+#include "Lib/AtomicCounter.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+template<typename T>
+static std::vector<T> readValues(std::istream &in) {
+    std::vector<T> values;
+    T value;
+    while(in >> value) values.push_back(value);
+    return values;
+}
+
+EnsembleSpec::EnsembleSpec(std::string filePath) {
+    size_t lastBackslash = filePath.rfind('/');
+    directoryPath = lastBackslash == std::string::npos ? "" : filePath.substr(0, lastBackslash + 1);
+
+    std::ifstream fin(filePath);
+    std::string line;
+    while(std::getline(fin, line)) {
+        std::istringstream in(line);
+        std::string key;
+        in >> key;
+
+        if(key == "setup") {
+            std::string setupPath;
+            in >> setupPath;
+            setup = Setup(directoryPath + setupPath);
+        }
+        if(key == "gravity") gravities = readValues<double>(in);
+        if(key == "dipoleScale") dipoleScales = readValues<double>(in);
+        if(key == "temperature") temperatures = readValues<double>(in);
+        if(key == "particles") particles = readValues<size_t>(in);
+        if(key == "coupling") in >> coupling;
+        if(key == "size") in >> sizeX >> sizeY;
+        if(key == "steps") in >> steps;
+        if(key == "sampleSteps") in >> sampleSteps;
+        if(key == "seeds") in >> seeds;
+        if(key == "threads") in >> threads;
+        if(key == "teamParticles") in >> teamParticles;
+        if(key == "output") {
+            in >> outputPath;
+            outputPath = directoryPath + outputPath;
+        }
+    }
+
+    assert(! setup.particleTypes.empty() && "Expected a setup file in the sweep spec");
+    assert(! particles.empty());
+}
+
+std::vector<EnsembleRun> ensembleRuns(const EnsembleSpec &spec) {
+    std::vector<double> gravities = spec.gravities, dipoleScales = spec.dipoleScales, temperatures = spec.temperatures;
+    if(gravities.empty()) gravities.push_back(spec.setup.gravity);
+    if(dipoleScales.empty()) dipoleScales.push_back(1);
+    if(temperatures.empty()) temperatures.push_back(NAN);
+
+    std::vector<EnsembleRun> runs;
+    for(double gravity: gravities)
+        for(double dipoleScale: dipoleScales)
+            for(double temperature: temperatures)
+                for(size_t particles: spec.particles)
+                    for(int seed = 1; seed <= spec.seeds; ++seed)
+                        runs.push_back({ runs.size(), gravity, dipoleScale, temperature, particles, (uint32_t) seed });
+    return runs;
+}
+
+static void fillLattice(Universe &universe, const EnsembleRun &run) {
+    // Rectangular lattice over the whole universe, with Maxwell-Boltzmann velocities of the run's temperature
+    const UniverseConfig &config = universe.getConfig();
+    const std::vector<ParticleType> &types = universe.getParticleTypes();
+    int perRow = std::max((int) std::ceil(std::sqrt((double) run.particles * config.sizeX / config.sizeY)), 1);
+    int rows = std::max((int) ((run.particles + perRow - 1) / perRow), 1);
+    double spacingX = (double) config.sizeX / perRow, spacingY = (double) config.sizeY / rows;
+    double temperature = std::isnan(run.temperature) ? 1 : run.temperature;
+
+    std::mt19937 generator(run.seed);
+    std::normal_distribution<double> normal;
+    for(size_t i = 0; i < run.particles; ++i) {
+        int type = i % types.size();
+        Vector2D pos((i % perRow + 0.5) * spacingX, (i / perRow + 0.5) * spacingY);
+        double sigma = std::sqrt(temperature / types[type].getMass());
+        Vector2D v(sigma * normal(generator), sigma * normal(generator));
+        universe.addParticle(type, ParticleState(pos, v));
+    }
+}
+
+EnsembleResult runEnsembleMember(const EnsembleSpec &spec, const EnsembleRun &run, int threads) {
+    auto begin = std::chrono::steady_clock::now();
+    const Setup &setup = spec.setup;
+    UniverseConfig config = setup.universeConfig();
+    if(spec.sizeX) config.sizeX = spec.sizeX;
+    if(spec.sizeY) config.sizeY = spec.sizeY;
+    config.gravity = run.gravity;
+    config.threads = threads;
+    config.deterministic = true;
+
+    std::vector<ParticleType> types = setup.particleTypes;
+    for(ParticleType &type: types)
+        type.setDipoleMoment(type.getDipoleMoment() * run.dipoleScale);
+
+    Universe universe(config, types);
+    fillLattice(universe, run);
+    if(std::isnan(run.temperature)) {
+        universe.setThermostats(setup.thermostats, run.seed);
+    } else {
+        Thermostat thermostat;
+        thermostat.temperature = run.temperature;
+        thermostat.coupling = spec.coupling;
+        universe.setThermostats({ thermostat }, run.seed);
+    }
+
+    EnsembleResult result;
+    result.run = run;
+    uint64_t sampleSteps = std::max(std::min(spec.sampleSteps, spec.steps), (uint64_t) 1);
+    double area = (double) config.sizeX * config.sizeY;
+    for(uint64_t step = 0; step < spec.steps; ++step) {
+        if(step == spec.steps - sampleSteps) {
+            // One observable bin over the whole universe, and a phase analysis after the last step
+            universe.observe(std::max(config.sizeX, config.sizeY), 1);
+            PhaseAnalysisConfig phaseConfig;
+            phaseConfig.interval = sampleSteps;
+            universe.analysePhases(phaseConfig, 1);
+        }
+        universe.advance(setup.dT);
+        if(step >= spec.steps - sampleSteps) {
+            ObservableBin total = universe.getObservations().back().grid.total();
+            result.temperature += total.temperature() / sampleSteps;
+            result.pressure += total.pressure(area) / sampleSteps;
+            result.potentialEnergy += (total.n ? total.potentialEnergy / total.n : 0) / sampleSteps;
+        }
+    }
+
+    if(! universe.getPhaseSamples().empty() && universe.size()) {
+        const PhaseSample &sample = universe.getPhaseSamples().back();
+        for(size_t i = 0; i < sample.phaseCounts.size(); ++i)
+            result.phaseFractions[i] = (double) sample.phaseCounts[i] / universe.size();
+        result.largestCluster = sample.largestCluster;
+    }
+    result.stateHash = universe.stateHash();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return result;
+}
+
+std::vector<EnsembleResult> runEnsemble(const EnsembleSpec &spec,
+        const std::function<void(const EnsembleResult &)> &finished) {
+    std::vector<EnsembleRun> runs = ensembleRuns(spec);
+    std::vector<EnsembleResult> results(runs.size());
+    std::vector<size_t> small, large;
+    for(const EnsembleRun &run: runs)
+        (run.particles >= spec.teamParticles ? large : small).push_back(run.index);
+
+    std::mutex mutex;
+    auto store = [&](const EnsembleResult &result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        results[result.run.index] = result;
+        if(finished) finished(result);
+    };
+
+    // Large runs one at a time, each parallelized over its boxes with the worker threads of the spec
+    for(size_t index: large)
+        store(runEnsembleMember(spec, runs[index], spec.threads));
+
+    // Small runs single-threaded, one per worker. Workers are dedicated threads rather than tasks of the thread
+    // pool, so that they never wait for the pool they are running on.
+    size_t nWorkers = spec.threads;
+    if(! nWorkers) nWorkers = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    nWorkers = std::min(nWorkers, small.size());
+    AtomicCounter counter(small.size());
+    auto work = [&]() {
+        for(size_t i = counter.next(); i < counter.total(); i = counter.next())
+            store(runEnsembleMember(spec, runs[small[i]], 1));
+    };
+    std::vector<std::thread> workers;
+    for(size_t i = 1; i < nWorkers; ++i)
+        workers.emplace_back(work);
+    if(nWorkers) work();
+    for(std::thread &worker: workers)
+        worker.join();
+
+    return results;
+}
+
+void writeEnsembleHeader(std::ostream &out) {
+    out << "# run seed gravity dipoleScale thermostatTemperature particles"
+           " temperature pressure potentialEnergy gas liquid solid largestCluster stateHash seconds\n";
+}
+
+void writeEnsembleResult(std::ostream &out, const EnsembleResult &result) {
+    const EnsembleRun &run = result.run;
+    std::ostringstream line;
+    line << std::setprecision(8) << run.index << " " << run.seed << " " << run.gravity << " " << run.dipoleScale
+         << " " << run.temperature << " " << run.particles << " " << result.temperature << " " << result.pressure
+         << " " << result.potentialEnergy << " " << result.phaseFractions[(int) Phase::gas]
+         << " " << result.phaseFractions[(int) Phase::liquid] << " " << result.phaseFractions[(int) Phase::solid]
+         << " " << result.largestCluster << " " << std::hex << result.stateHash << std::dec
+         << " " << std::setprecision(4) << result.seconds << "\n";
+    out << line.str();
+}
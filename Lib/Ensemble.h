@@ -0,0 +1,82 @@
+#ifndef __ENSEMBLE_H__
+#define __ENSEMBLE_H__
+
+#include <array>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Lib/Setup.h"
+
+/*
+ * An ensemble is a parameter sweep of many independent universes, e.g. for phase diagrams. Every combination of the
+ * swept gravities, dipole moment scales, temperatures and particle counts is run once per seed, starting from a
+ * lattice that fills the universe, with random velocities of the run's temperature (1 without a thermostat). Each run
+ * reports its observables averaged over the last sampleSteps steps.
+ *
+ * Universes own all of their buffers, so runs are scheduled by size: runs with fewer than teamParticles particles
+ * are single-threaded and run concurrently, one per worker thread, while larger runs are run one at a time with the
+ * worker threads as a team. Runs are deterministic, so the results don't depend on the scheduling.
+ *
+ * Sweep spec files consist of key-value lines like setup files, with a list of values for swept parameters:
+ *     setup ../Setups/default.txt     Particle types, size and dT, relative to the spec file
+ *     gravity 0 0.01                  Overrides the setup
+ *     dipoleScale 0.8 1 1.2           Multiplies the dipole moments of all particle types
+ *     temperature 0.5 1 2             Langevin thermostat over the whole universe, replaces the setup's thermostats
+ *     coupling 0.1                    Of the thermostat
+ *     particles 400 20000
+ *     size 480 270                    Optional, overrides the setup
+ *     steps 2000
+ *     sampleSteps 500
+ *     seeds 2
+ *     threads 0                       Worker threads, 0 means one per hardware thread
+ *     teamParticles 20000
+ *     output results.txt              Relative to the spec file
+ */
+
+struct EnsembleSpec {
+    std::string directoryPath;
+    Setup setup;
+    std::vector<double> gravities, dipoleScales, temperatures; // Empty means the setup's value
+    std::vector<size_t> particles = { 400 };
+    double coupling = 0.1;
+    int sizeX = 0, sizeY = 0; // 0 means the setup's size
+    uint64_t steps = 1000, sampleSteps = 100;
+    int seeds = 1;
+    int threads = 0;
+    size_t teamParticles = 20000;
+    std::string outputPath;
+
+    EnsembleSpec(std::string filePath);
+    inline EnsembleSpec() {
+    }
+};
+
+struct EnsembleRun {
+    size_t index;
+    double gravity, dipoleScale, temperature; // Temperature is NAN without a thermostat
+    size_t particles;
+    uint32_t seed;
+};
+
+struct EnsembleResult {
+    EnsembleRun run;
+    double temperature = 0, pressure = 0, potentialEnergy = 0; // Means over the sampled steps, energy per particle
+    std::array<double, 4> phaseFractions{}; // Indexed by Phase, from the last phase analysis
+    size_t largestCluster = 0;
+    uint64_t stateHash = 0;
+    double seconds = 0;
+};
+
+std::vector<EnsembleRun> ensembleRuns(const EnsembleSpec &spec); // All parameter combinations in output order
+EnsembleResult runEnsembleMember(const EnsembleSpec &spec, const EnsembleRun &run, int threads);
+
+// Runs all runs of the spec and returns their results in run order. finished is called after each run, from the
+// thread that ran it, but never concurrently.
+std::vector<EnsembleResult> runEnsemble(const EnsembleSpec &spec,
+        const std::function<void(const EnsembleResult &)> &finished = nullptr);
+
+void writeEnsembleHeader(std::ostream &out);
+void writeEnsembleResult(std::ostream &out, const EnsembleResult &result); // One line per run
+
+#endif
@@ -0,0 +1,170 @@
+
+#include "Lib/Generators.h"
+#include "Lib/Universe.h"
+#include "Lib/Parallel.h"
+#include "Lib/Philox.h"
+#include <algorithm>
+#include <cmath>
+
+static const size_t velocityChunk = 4096;
+static const int tileCells = 8; // Side of a tile of the random fill in grid cells, at least 3 as darts see 2 cells away
+static const int dartsPerParticle = 30; // Darts thrown per particle of a tile before giving up
+
+bool GeneratorSetup::contains(const Vector2D &pos) const {
+    if(radius > 0) return (pos - center).magnitude2() <= radius * radius;
+    return pos.x >= minX && pos.x <= maxX && pos.y >= minY && pos.y <= maxY;
+}
+
+static void clipToUniverse(const UniverseConfig &config, double &x0, double &y0, double &x1, double &y1) {
+    x0 = std::max(x0, 0.);
+    y0 = std::max(y0, 0.);
+    x1 = std::min(x1, (double) config.sizeX);
+    y1 = std::min(y1, (double) config.sizeY);
+}
+
+static void generateLattice(const GeneratorSetup &generator, const UniverseConfig &config,
+        std::vector<ParticleState> &particles) {
+    // Sites are kept half a spacing inside the region and the universe, so that regions filled next to each other
+    // don't overlap. Rectangles are anchored at their lower left corner and disks at their centre.
+    const double s = generator.spacing, rowHeight = s * std::sqrt(3.) / 2, eps = 1e-9;
+    const bool disk = generator.radius > 0;
+    const double innerRadius = generator.radius - s / 2;
+    if(disk && innerRadius < 0) return;
+    Vector2D anchor = disk ? generator.center : Vector2D(generator.minX + s / 2, generator.minY + s / 2);
+    double x0 = disk ? generator.center.x - innerRadius : generator.minX + s / 2;
+    double y0 = disk ? generator.center.y - innerRadius : generator.minY + s / 2;
+    double x1 = disk ? generator.center.x + innerRadius : generator.maxX - s / 2;
+    double y1 = disk ? generator.center.y + innerRadius : generator.maxY - s / 2;
+    x0 = std::max(x0, s / 2);
+    y0 = std::max(y0, s / 2);
+    x1 = std::min(x1, config.sizeX - s / 2);
+    y1 = std::min(y1, config.sizeY - s / 2);
+    if(x1 < x0 || y1 < y0) return;
+
+    long long firstRow = std::ceil((y0 - anchor.y) / rowHeight - eps);
+    long long nRows = (long long) std::floor((y1 - anchor.y) / rowHeight + eps) - firstRow + 1;
+    if(nRows <= 0) return;
+
+    // Sites of each row, then the rows are filled in parallel from their offsets
+    std::vector<long long> firstSites(nRows);
+    std::vector<size_t> offsets(nRows + 1, 0);
+    for(long long r = 0; r < nRows; ++r) {
+        long long row = firstRow + r;
+        double y = anchor.y + row * rowHeight, lo = x0, hi = x1;
+        if(disk) {
+            double dy = y - generator.center.y;
+            double halfWidth = std::sqrt(std::max(innerRadius * innerRadius - dy * dy, 0.));
+            lo = std::max(lo, generator.center.x - halfWidth);
+            hi = std::min(hi, generator.center.x + halfWidth);
+        }
+        double shift = (row & 1) ? 0.5 : 0;
+        firstSites[r] = std::ceil((lo - anchor.x) / s - shift - eps);
+        long long lastSite = std::floor((hi - anchor.x) / s - shift + eps);
+        offsets[r + 1] = offsets[r] + std::max(lastSite - firstSites[r] + 1, 0LL);
+    }
+
+    size_t base = particles.size();
+    particles.resize(base + offsets.back());
+    ParticleState *out = particles.data() + base;
+    parallelForCounter(config.threads, nRows, [&](AtomicCounter &counter) {
+        for(size_t r = counter.next(); r < counter.total(); r = counter.next()) {
+            long long row = firstRow + r;
+            double shift = (row & 1) ? 0.5 : 0;
+            for(size_t i = offsets[r]; i < offsets[r + 1]; ++i)
+                out[i].pos = Vector2D(anchor.x + (firstSites[r] + (long long) (i - offsets[r]) + shift) * s,
+                        anchor.y + row * rowHeight);
+        }
+    });
+}
+
+static void generateRandom(const GeneratorSetup &generator, const UniverseConfig &config, uint32_t seed,
+        uint32_t index, std::vector<ParticleState> &particles) {
+    const double minDistance = generator.spacing, cellSize = minDistance / std::sqrt(2.);
+    double x0 = generator.radius > 0 ? generator.center.x - generator.radius : generator.minX;
+    double y0 = generator.radius > 0 ? generator.center.y - generator.radius : generator.minY;
+    double x1 = generator.radius > 0 ? generator.center.x + generator.radius : generator.maxX;
+    double y1 = generator.radius > 0 ? generator.center.y + generator.radius : generator.maxY;
+    clipToUniverse(config, x0, y0, x1, y1);
+    if(x1 <= x0 || y1 <= y0 || generator.density <= 0) return;
+
+    int gridX = std::max((int) std::ceil((x1 - x0) / cellSize), 1);
+    int gridY = std::max((int) std::ceil((y1 - y0) / cellSize), 1);
+    int tilesX = (gridX + tileCells - 1) / tileCells, tilesY = (gridY + tileCells - 1) / tileCells;
+    std::vector<Vector2D> grid(gridX * gridY, Vector2D(NAN, NAN)); // Accepted particle of each cell, NaN if none
+
+    for(int pass = 0; pass < 4; ++pass) {
+        int parityX = pass % 2, parityY = pass / 2;
+        int passTilesX = (tilesX - parityX + 1) / 2, passTilesY = (tilesY - parityY + 1) / 2;
+        parallelForCounter(config.threads, passTilesX * passTilesY, [&](AtomicCounter &counter) {
+            for(size_t t = counter.next(); t < counter.total(); t = counter.next()) {
+                int tileX = 2 * (t % passTilesX) + parityX, tileY = 2 * (t / passTilesX) + parityY;
+                uint32_t tile = tileY * tilesX + tileX;
+                double tileX0 = x0 + tileX * tileCells * cellSize, tileY0 = y0 + tileY * tileCells * cellSize;
+                double tileX1 = std::min(tileX0 + tileCells * cellSize, x1);
+                double tileY1 = std::min(tileY0 + tileCells * cellSize, y1);
+
+                // Darts outside the region count as placed, so that tiles on its border get their share
+                double expected = generator.density * (tileX1 - tileX0) * (tileY1 - tileY0);
+                PhiloxCounter roundingBits = philox4x32({ tile, 0, 1, 0 }, { seed, index });
+                uint32_t quota = std::floor(expected) + (philoxUniform(roundingBits[0], roundingBits[1])
+                        < expected - std::floor(expected));
+                uint32_t placed = 0;
+                for(uint32_t dart = 0; placed < quota && dart < dartsPerParticle * quota; ++dart) {
+                    PhiloxCounter bits = philox4x32({ tile, dart, 0, 0 }, { seed, index });
+                    Vector2D pos(tileX0 + (tileX1 - tileX0) * philoxUniform(bits[0], bits[1]),
+                            tileY0 + (tileY1 - tileY0) * philoxUniform(bits[2], bits[3]));
+                    if(! generator.contains(pos)) {
+                        ++placed;
+                        continue;
+                    }
+                    int cellX = std::min((int) ((pos.x - x0) / cellSize), gridX - 1);
+                    int cellY = std::min((int) ((pos.y - y0) / cellSize), gridY - 1);
+                    bool free = std::isnan(grid[cellY * gridX + cellX].x);
+                    for(int y = std::max(cellY - 2, 0); free && y <= std::min(cellY + 2, gridY - 1); ++y)
+                        for(int x = std::max(cellX - 2, 0); x <= std::min(cellX + 2, gridX - 1); ++x) {
+                            const Vector2D &other = grid[y * gridX + x];
+                            if(! std::isnan(other.x) && (other - pos).magnitude2() < minDistance * minDistance) {
+                                free = false;
+                                break;
+                            }
+                        }
+                    if(! free) continue;
+                    grid[cellY * gridX + cellX] = pos;
+                    ++placed;
+                }
+            }
+        });
+    }
+
+    for(const Vector2D &pos: grid)
+        if(! std::isnan(pos.x)) particles.push_back(ParticleState(pos));
+}
+
+static void assignVelocities(const GeneratorSetup &generator, const UniverseConfig &config, double mass,
+        uint32_t seed, uint32_t index, ParticleState *particles, size_t n) {
+    if(generator.temperature <= 0 || n == 0) return;
+    double sigma = std::sqrt(generator.temperature / mass);
+    parallelForCounter(config.threads, (n + velocityChunk - 1) / velocityChunk, [&](AtomicCounter &counter) {
+        for(size_t chunk = counter.next(); chunk < counter.total(); chunk = counter.next())
+            for(size_t i = chunk * velocityChunk; i < std::min((chunk + 1) * velocityChunk, n); ++i) {
+                PhiloxCounter bits = philox4x32({ (uint32_t) i, (uint32_t) ((uint64_t) i >> 32), 2, 0 }, { seed, index });
+                std::array<double, 2> xi = philoxNormal2(bits);
+                particles[i].v = Vector2D(xi[0], xi[1]) * sigma;
+            }
+    });
+
+    Vector2D mean;
+    for(size_t i = 0; i < n; ++i)
+        mean += particles[i].v;
+    mean /= n;
+    for(size_t i = 0; i < n; ++i)
+        particles[i].v -= mean;
+}
+
+void generateParticles(const GeneratorSetup &generator, const UniverseConfig &config, double mass, uint32_t seed,
+        uint32_t index, std::vector<ParticleState> &particles) {
+    size_t base = particles.size();
+    if(generator.kind == GeneratorKind::lattice) generateLattice(generator, config, particles);
+    else generateRandom(generator, config, seed, index, particles);
+    assignVelocities(generator, config, mass, seed, index, particles.data() + base, particles.size() - base);
+}
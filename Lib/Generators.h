@@ -0,0 +1,51 @@
+#ifndef __GENERATORS_H__
+#define __GENERATORS_H__
+
+#include <cstdint>
+#include <vector>
+#include "Lib/Particle.h"
+
+struct UniverseConfig;
+
+/*
+ * Generators fill a region with particles of one type, so that large scenes don't need a line per particle in the
+ * setup file. The region is a rectangle or a disk, clipped to the universe.
+ *
+ * Lattice: a triangular lattice with the given nearest neighbour distance, the densest packing in 2D. Rectangles are
+ * filled from their lower left corner, disks around their centre (droplets). Rows of the lattice are counted first
+ * and then filled in parallel.
+ *
+ * Random: overlap-free random positions at a target number density, with no two particles closer than the minimum
+ * distance (Poisson-disk sampling by dart throwing). Accepted particles are kept in a grid of cells of size
+ * minDistance / sqrt(2), which holds at most one particle per cell, so a dart is checked against the 5x5 cells
+ * around it. The grid is divided into tiles of 8x8 cells and tiles are filled in 4 passes by the parity of their
+ * coordinates, so that tiles filled concurrently are a tile apart and never see each other's cells. Random sequential
+ * packing jams at about 0.7 / minDistance^2, and denser targets are filled as far as the darts get.
+ *
+ * Velocities follow the Maxwell-Boltzmann distribution of the temperature (each component normal with variance
+ * temperature / mass), shifted so that the momentum of the generated particles is zero.
+ *
+ * Random numbers are drawn from Philox keyed by the seed and the index of the generator, and counted by lattice site,
+ * dart or particle, so scenes don't depend on the number of threads.
+ */
+
+enum class GeneratorKind { lattice, random };
+
+struct GeneratorSetup {
+    GeneratorKind kind = GeneratorKind::lattice;
+    int type = 0;
+    double minX = 0, minY = 0, maxX = 0, maxY = 0; // Rectangle
+    Vector2D center; // Disk instead of the rectangle if radius > 0
+    double radius = 0;
+    double spacing = 1; // Lattice: nearest neighbour distance. Random: minimum distance
+    double density = 0; // Random: target particles per unit area
+    double temperature = 0;
+
+    bool contains(const Vector2D &pos) const;
+};
+
+// Appends the particles of the generator with the given index in the setup, in an order that doesn't depend on threads
+void generateParticles(const GeneratorSetup &generator, const UniverseConfig &config, double mass, uint32_t seed,
+        uint32_t index, std::vector<ParticleState> &particles);
+
+#endif
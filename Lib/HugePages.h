@@ -0,0 +1,56 @@
+#ifndef __HUGE_PAGES_H__
+#define __HUGE_PAGES_H__
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(__linux__) && ! defined(__EMSCRIPTEN__)
+#define HUGE_PAGES_ENABLED
+#include <sys/mman.h>
+#endif
+
+/*
+ * HugePageAllocator is for large buffers that live across steps, such as the force accumulators. Allocations of at
+ * least hugePageSize are aligned to it and advised with MADV_HUGEPAGE, so that Linux backs them with transparent huge
+ * pages when /sys/kernel/mm/transparent_hugepage/enabled is "always" or "madvise". A buffer of tens of megabytes then
+ * takes a handful of TLB entries instead of thousands. Smaller allocations, and other platforms, use malloc.
+ */
+
+static const std::size_t hugePageSize = 2 << 20;
+
+inline void * allocateHugePages(std::size_t bytes) {
+    void *ptr = nullptr;
+#ifdef HUGE_PAGES_ENABLED
+    if(bytes >= hugePageSize) {
+        if(posix_memalign(&ptr, hugePageSize, bytes)) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+        return ptr;
+    }
+#endif
+    ptr = std::malloc(bytes ? bytes : 1);
+    if(! ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+template<typename T>
+struct HugePageAllocator {
+    typedef T value_type;
+
+    HugePageAllocator() = default;
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U> &) {}
+
+    T * allocate(std::size_t n) { return (T *) allocateHugePages(n * sizeof(T)); }
+    void deallocate(T *ptr, std::size_t) { std::free(ptr); }
+};
+
+template<typename T, typename U>
+bool operator==(const HugePageAllocator<T> &, const HugePageAllocator<U> &) { return true; }
+
+template<typename T, typename U>
+bool operator!=(const HugePageAllocator<T> &, const HugePageAllocator<U> &) { return false; }
+
+#endif
@@ -0,0 +1,109 @@
+
+#include "Lib/InputRecording.h"
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+static const char magic[4] = { 'P', 'T', 'I', 'N' };
+static const uint32_t version = 1;
+
+template<typename T>
+static char * put(char *buffer, T value) {
+    std::memcpy(buffer, &value, sizeof(T));
+    return buffer + sizeof(T);
+}
+
+template<typename T>
+static const char * get(const char *buffer, T &value) {
+    std::memcpy(&value, buffer, sizeof(T));
+    return buffer + sizeof(T);
+}
+
+InputFrame::InputFrame(const CallbackHandler &handler, int _substeps):
+        pos(handler.pos), radius(handler.radius), sign(handler.sign), action(handler.action),
+        particleTypeIdx(handler.particleTypeIdx), rewindPoints(handler.rewindPoints), substeps(_substeps) {
+}
+
+void InputFrame::applyTo(CallbackHandler &handler) const {
+    handler.pos = pos;
+    handler.radius = radius;
+    handler.sign = sign;
+    handler.action = action;
+    handler.particleTypeIdx = particleTypeIdx;
+    handler.rewindPoints = rewindPoints;
+}
+
+void InputFrame::encode(char *buffer) const {
+    // Mouse positions are integers, so they are exact as floats
+    char *p = buffer;
+    p = put(p, (float) pos.x);
+    p = put(p, (float) pos.y);
+    p = put(p, radius);
+    p = put(p, (int8_t) sign);
+    p = put(p, (uint8_t) action);
+    p = put(p, (uint8_t) particleTypeIdx);
+    p = put(p, (uint8_t) std::min(rewindPoints, 255));
+    put(p, (uint16_t) substeps);
+}
+
+void InputFrame::decode(const char *buffer) {
+    float x, y;
+    int8_t sign8;
+    uint8_t action8, particleTypeIdx8, rewindPoints8;
+    uint16_t substeps16;
+    const char *p = buffer;
+    p = get(p, x);
+    p = get(p, y);
+    p = get(p, radius);
+    p = get(p, sign8);
+    p = get(p, action8);
+    p = get(p, particleTypeIdx8);
+    p = get(p, rewindPoints8);
+    get(p, substeps16);
+
+    pos = Vector2D(x, y);
+    sign = sign8;
+    action = (MouseAction) action8;
+    particleTypeIdx = particleTypeIdx8;
+    rewindPoints = rewindPoints8 == 255 ? std::numeric_limits<int>::max() : rewindPoints8;
+    substeps = substeps16;
+}
+
+InputRecorder::InputRecorder(const std::string &path, uint32_t _seed):
+        out(path, std::ios::binary), seed(_seed) {
+    out.write(magic, sizeof(magic));
+    out.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    out.write(reinterpret_cast<const char *>(&seed), sizeof(seed));
+}
+
+void InputRecorder::record(const CallbackHandler &handler, int substeps) {
+    char buffer[InputFrame::encodedSize];
+    InputFrame(handler, substeps).encode(buffer);
+    out.write(buffer, sizeof(buffer));
+    out.flush(); // Keep the recording usable if the program is killed
+}
+
+InputReplay::InputReplay(const std::string &path):
+        in(path, std::ios::binary) {
+    char header[sizeof(magic) + 2 * sizeof(uint32_t)];
+    if(! in.read(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic)) != 0) return;
+
+    uint32_t fileVersion;
+    get(get(header + sizeof(magic), fileVersion), seed);
+    valid = fileVersion == version;
+}
+
+bool InputReplay::next(InputFrame &frame) {
+    char buffer[InputFrame::encodedSize];
+    if(! valid || ! in.read(buffer, sizeof(buffer))) return false;
+    frame.decode(buffer);
+    return true;
+}
+
+void replayFrame(Universe &universe, const StepScheduler &scheduler, const InputFrame &frame, double modifyDT) {
+    CallbackHandler handler(universe.getParticleTypes().size());
+    frame.applyTo(handler);
+    UniverseModifier::modify(universe, handler, modifyDT);
+    for(int i = 0; i < frame.substeps; ++i)
+        universe.advance(scheduler.substepDT(universe));
+}
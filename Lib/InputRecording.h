@@ -0,0 +1,66 @@
+#ifndef __INPUT_RECORDING_H__
+#define __INPUT_RECORDING_H__
+
+#include <string>
+#include <fstream>
+#include "Lib/Display.h"
+#include "Lib/StepScheduler.h"
+
+/*
+ * Interactive sessions are recorded frame by frame as the state of CallbackHandler that UniverseModifier reacts to,
+ * along with the number of substeps StepScheduler ran in the frame. The size of each substep depends only on the
+ * universe, and the random generators are seeded from the recording, so replaying a recording with the same setup
+ * file reproduces the session without a window, e.g. for benchmarking and profiling.
+ *
+ * File format (host byte order): "PTIN", uint32 version, uint32 seed, then one record of recordSize bytes per
+ * frame: float pos x, float pos y, double radius, int8 sign, uint8 action, uint8 particleTypeIdx,
+ * uint8 rewindPoints (255 for all), uint16 substeps.
+ */
+
+struct InputFrame {
+    Vector2D pos;
+    double radius = 50;
+    int sign = 0;
+    MouseAction action = MouseAction::create;
+    int particleTypeIdx = 0;
+    int rewindPoints = 0;
+    int substeps = 1;
+
+    InputFrame() {}
+    InputFrame(const CallbackHandler &handler, int _substeps);
+    void applyTo(CallbackHandler &handler) const;
+
+    // Record of the file format, also used by StreamClient
+    static const size_t encodedSize = 26;
+    void encode(char *buffer) const;
+    void decode(const char *buffer);
+};
+
+class InputRecorder {
+public:
+    InputRecorder(const std::string &path, uint32_t _seed);
+    void record(const CallbackHandler &handler, int substeps);
+    inline uint32_t getSeed() const { return seed; }
+
+private:
+    std::ofstream out;
+    uint32_t seed;
+};
+
+class InputReplay {
+public:
+    InputReplay(const std::string &path); // Check good() for success
+    bool next(InputFrame &frame); // False at the end of the recording
+    inline bool good() const { return valid; }
+    inline uint32_t getSeed() const { return seed; }
+
+private:
+    std::ifstream in;
+    bool valid = false;
+    uint32_t seed = 0;
+};
+
+// Runs a recorded frame: the modification by the user followed by frame.substeps substeps
+void replayFrame(Universe &universe, const StepScheduler &scheduler, const InputFrame &frame, double modifyDT);
+
+#endif
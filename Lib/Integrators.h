@@ -15,28 +15,91 @@
         void prepareDifferentiation(IntegrableState &state) const; // Run every time before an integration step
         void derivative(IntegrableState &der, const IntegrableState &state) const;
     };
+
+    Additionally, advanceDormandPrince() requires a function that measures the magnitude of an error estimate:
+
+    double integrationError(const IntegrableState &error); // Eg. maximum absolute value of all components
 */
 
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+inline double integrationError(double error) { return std::abs(error); }
+
+/*
+ * AdaptiveStepControl holds the parameters and the state of an adaptive integrator. dT is the size of the next
+ * attempted step and gets updated after each step. accepted/rejected count the steps taken/retried so far.
+ */
+
+struct AdaptiveStepControl {
+    double dT = 1e-2;
+    double minDT = 1e-6, maxDT = 1.;
+    double tolerance = 1e-6; // Maximum allowed local error per step
+    size_t accepted = 0, rejected = 0;
+};
+
+/*
+ * IntegratorWorkspace holds the intermediate states and derivative buffers of the integrators, so that they aren't
+ * reallocated on each step. Each integrated object needs its own workspace for objects to be advanced concurrently.
+ * The overloads without a workspace use one shared by all callers with the same template arguments.
+ */
+
+template<typename IntegrableState, typename Buffers>
+struct IntegratorWorkspace {
+    static const int dormandPrinceStages = 7;
+
+    IntegrableState xInitial, xAdditive, scaled, error;
+    IntegrableState k1, k2, k3, k4;
+    std::array<IntegrableState, dormandPrinceStages> k; // Dormand-Prince
+    Buffers derivativeBuffers; // Only for performance reasons
+};
+
+template<typename IntegrableState, typename Differetiator, typename Buffers>
+void advanceEuler(IntegrableState &x, const Differetiator &diff, double dT,
+        IntegratorWorkspace<IntegrableState, Buffers> &w);
+
 template<typename IntegrableState, typename Differetiator, typename Buffers>
-void advanceEuler(IntegrableState &x, const Differetiator &diff, double dT);
+void advanceRungeKutta4(IntegrableState &x, const Differetiator &diff, double dT,
+        IntegratorWorkspace<IntegrableState, Buffers> &w);
 
 template<typename IntegrableState, typename Differetiator, typename Buffers>
-void advanceRungeKutta4(IntegrableState &x, const Differetiator &diff, double dT);
+double advanceDormandPrince(IntegrableState &x, const Differetiator &diff, AdaptiveStepControl &control,
+        IntegratorWorkspace<IntegrableState, Buffers> &w);
 
 template<typename IntegrableState, typename Differetiator, typename Buffers>
 void advanceEuler(IntegrableState &x, const Differetiator &diff, double dT) {
+    static IntegratorWorkspace<IntegrableState, Buffers> w;
+    advanceEuler(x, diff, dT, w);
+}
+
+template<typename IntegrableState, typename Differetiator, typename Buffers>
+void advanceRungeKutta4(IntegrableState &x, const Differetiator &diff, double dT) {
+    static IntegratorWorkspace<IntegrableState, Buffers> w;
+    advanceRungeKutta4(x, diff, dT, w);
+}
+
+template<typename IntegrableState, typename Differetiator, typename Buffers>
+double advanceDormandPrince(IntegrableState &x, const Differetiator &diff, AdaptiveStepControl &control) {
+    static IntegratorWorkspace<IntegrableState, Buffers> w;
+    return advanceDormandPrince(x, diff, control, w);
+}
+
+template<typename IntegrableState, typename Differetiator, typename Buffers>
+void advanceEuler(IntegrableState &x, const Differetiator &diff, double dT,
+        IntegratorWorkspace<IntegrableState, Buffers> &w) {
     // Compact form: x = x + diff.derivative(x) * dT;
 
     diff.prepareDifferentiation(x);
-    static IntegrableState k1;
-    static Buffers derivativeCache; // Only for performance reasons
-    diff.derivative(k1, derivativeCache, x);
+    IntegrableState &k1 = w.k1;
+    diff.derivative(k1, w.derivativeBuffers, x);
     k1 *= dT;
     x += k1;
 }
 
 template<typename IntegrableState, typename Differetiator, typename Buffers>
-void advanceRungeKutta4(IntegrableState &x, const Differetiator &diff, double dT) {
+void advanceRungeKutta4(IntegrableState &x, const Differetiator &diff, double dT,
+        IntegratorWorkspace<IntegrableState, Buffers> &w) {
     /* Equations from https://en.wikipedia.org/wiki/Runge-Kutta_methods.
        Can be written in more compact form:
 
@@ -48,9 +111,9 @@ void advanceRungeKutta4(IntegrableState &x, const Differetiator &diff, double dT
 
     diff.prepareDifferentiation(x);
 
-    static IntegrableState xInitial, xAdditive;
-    static IntegrableState k1, k2, k3, k4;
-    static Buffers derivativeBuffers; // Only for performance reasons
+    IntegrableState &xInitial = w.xInitial, &xAdditive = w.xAdditive;
+    IntegrableState &k1 = w.k1, &k2 = w.k2, &k3 = w.k3, &k4 = w.k4;
+    Buffers &derivativeBuffers = w.derivativeBuffers;
 
     xInitial = x;
 
@@ -89,4 +152,77 @@ void advanceRungeKutta4(IntegrableState &x, const Differetiator &diff, double dT
     x += xAdditive;
 }
 
+template<typename IntegrableState, typename Differetiator, typename Buffers>
+double advanceDormandPrince(IntegrableState &x, const Differetiator &diff, AdaptiveStepControl &control,
+        IntegratorWorkspace<IntegrableState, Buffers> &w) {
+    /* Dormand-Prince 5(4) method (https://en.wikipedia.org/wiki/Dormand-Prince_method). Takes a single step
+       of 5th order and estimates its error from the embedded 4th order solution. Steps with too large error are
+       rejected and retried with a smaller dT starting from the saved initial state, reusing all buffers.
+       Returns the size of the accepted step.
+
+       The "first same as last" property isn't used, because prepareDifferentiation() may reorder the state,
+       which invalidates the last derivative of the previous step. */
+
+    const int nStages = IntegratorWorkspace<IntegrableState, Buffers>::dormandPrinceStages;
+    static const double a[nStages][nStages] = {
+            {},
+            {1. / 5},
+            {3. / 40, 9. / 40},
+            {44. / 45, -56. / 15, 32. / 9},
+            {19372. / 6561, -25360. / 2187, 64448. / 6561, -212. / 729},
+            {9017. / 3168, -355. / 33, 46732. / 5247, 49. / 176, -5103. / 18656},
+            {35. / 384, 0, 500. / 1113, 125. / 192, -2187. / 6784, 11. / 84} // 5th order solution
+    };
+    static const double e[nStages] = { // Difference between 5th and 4th order weights
+            71. / 57600, 0, -71. / 16695, 71. / 1920, -17253. / 339200, 22. / 525, -1. / 40
+    };
+    const double safety = 0.9, minFactor = 0.2, maxFactor = 5.;
+
+    diff.prepareDifferentiation(x);
+
+    IntegrableState &xInitial = w.xInitial, &scaled = w.scaled, &error = w.error;
+    std::array<IntegrableState, nStages> &k = w.k;
+    Buffers &derivativeBuffers = w.derivativeBuffers;
+
+    xInitial = x;
+    diff.derivative(k[0], derivativeBuffers, x); // Doesn't depend on dT, so it's reused in retries
+
+    for(;;) {
+        double dT = control.dT;
+
+        // Stage s is evaluated at xInitial + dT * sum(a[s][j] * k[j]), the last one being the new state
+        for(int s = 1; s < nStages; ++s) {
+            x = xInitial;
+            for(int j = 0; j < s; ++j) {
+                if(a[s][j] == 0) continue;
+                scaled = k[j];
+                scaled *= a[s][j] * dT;
+                x += scaled;
+            }
+            diff.derivative(k[s], derivativeBuffers, x);
+        }
+
+        error = k[0];
+        error *= e[0] * dT;
+        for(int j = 1; j < nStages; ++j) {
+            if(e[j] == 0) continue;
+            scaled = k[j];
+            scaled *= e[j] * dT;
+            error += scaled;
+        }
+        double errorNorm = integrationError(error);
+
+        double factor = errorNorm > 0 ? safety * std::pow(control.tolerance / errorNorm, 0.2) : maxFactor;
+        factor = std::min(maxFactor, std::max(minFactor, factor));
+        control.dT = std::min(control.maxDT, std::max(control.minDT, dT * factor));
+
+        if(errorNorm <= control.tolerance || dT <= control.minDT) { // Can't go below minDT, so accept anyway
+            ++control.accepted;
+            return dT;
+        }
+
+        ++control.rejected;
+    }
+}
+
 #endif
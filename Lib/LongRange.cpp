@@ -0,0 +1,136 @@
+
+#include "Lib/LongRange.h"
+#include "Lib/Universe.h"
+#include <algorithm>
+#include <cmath>
+
+static uint64_t spreadBits(uint32_t v) {
+    // Moves bit i of v to bit 2 * i
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x << 2)) & 0x3333333333333333ULL;
+    x = (x | (x << 1)) & 0x5555555555555555ULL;
+    return x;
+}
+
+static inline uint64_t mortonCode(int x, int y) {
+    return spreadBits((uint32_t) x) | (spreadBits((uint32_t) y) << 1);
+}
+
+static inline int quadrant(uint64_t code, int level) {
+    return (code >> (2 * level)) & 3;
+}
+
+void BarnesHutTree::build(const UniverseState &state) {
+    nodes.clear();
+    leaves.clear();
+    for(size_t c = 0; c < state.cells.size(); ++c) {
+        for(const ParticleState &p: state.cells[c].particles) {
+            if(p.type->getCharge() != 0) {
+                leaves.emplace_back(mortonCode(state.cells[c].x, state.cells[c].y), c);
+                break;
+            }
+        }
+    }
+    if(leaves.empty()) return;
+    std::sort(leaves.begin(), leaves.end());
+
+    int level = 0; // Root covers 2^level x 2^level boxes
+    while((1 << level) < std::max(state.cellsX, state.cellsY)) ++level;
+    nodes.emplace_back();
+    fillNode(state, 0, 0, leaves.size(), level);
+}
+
+void BarnesHutTree::fillNode(const UniverseState &state, int node, size_t begin, size_t end, int level) {
+    if(end - begin == 1) {
+        LongRangeNode &leaf = nodes[node];
+        leaf.cell = leaves[begin].second;
+        leaf.lower = Vector2D(INFINITY, INFINITY);
+        leaf.upper = Vector2D(-INFINITY, -INFINITY);
+        for(const ParticleState &p: state.cells[leaf.cell].particles) {
+            double q = p.type->getCharge();
+            if(q == 0) continue;
+            leaf.charge += q;
+            leaf.absCharge += std::abs(q);
+            leaf.center += p.pos * std::abs(q);
+            leaf.lower = Vector2D(std::min(leaf.lower.x, p.pos.x), std::min(leaf.lower.y, p.pos.y));
+            leaf.upper = Vector2D(std::max(leaf.upper.x, p.pos.x), std::max(leaf.upper.y, p.pos.y));
+        }
+        leaf.center /= leaf.absCharge;
+        leaf.size = std::max(leaf.upper.x - leaf.lower.x, leaf.upper.y - leaf.lower.y);
+        return;
+    }
+
+    // Levels where all leaves fall into the same quadrant would make chains of single children, skip them
+    while(quadrant(leaves[begin].first, level - 1) == quadrant(leaves[end - 1].first, level - 1))
+        --level;
+
+    size_t bounds[5];
+    int nChildren = 0;
+    bounds[0] = begin;
+    for(size_t i = begin + 1; i < end; ++i)
+        if(quadrant(leaves[i].first, level - 1) != quadrant(leaves[i - 1].first, level - 1))
+            bounds[++nChildren] = i;
+    bounds[++nChildren] = end;
+
+    int firstChild = nodes.size();
+    nodes.resize(firstChild + nChildren);
+    for(int i = 0; i < nChildren; ++i)
+        fillNode(state, firstChild + i, bounds[i], bounds[i + 1], level - 1);
+
+    LongRangeNode &parent = nodes[node];
+    parent.firstChild = firstChild;
+    parent.nChildren = nChildren;
+    parent.lower = Vector2D(INFINITY, INFINITY);
+    parent.upper = Vector2D(-INFINITY, -INFINITY);
+    for(int i = firstChild; i < firstChild + nChildren; ++i) {
+        const LongRangeNode &child = nodes[i];
+        parent.charge += child.charge;
+        parent.absCharge += child.absCharge;
+        parent.center += child.center * child.absCharge;
+        parent.lower = Vector2D(std::min(parent.lower.x, child.lower.x), std::min(parent.lower.y, child.lower.y));
+        parent.upper = Vector2D(std::max(parent.upper.x, child.upper.x), std::max(parent.upper.y, child.upper.y));
+    }
+    parent.center /= parent.absCharge;
+    parent.size = std::max(parent.upper.x - parent.lower.x, parent.upper.y - parent.lower.y);
+}
+
+static inline void addCharge(const Vector2D &pos, const Vector2D &chargePos, double charge, double softening2,
+        Vector2D &field, double &potential) {
+    Vector2D d = pos - chargePos;
+    double inverse = 1 / std::sqrt(d.x * d.x + d.y * d.y + softening2);
+    field += d * (charge * inverse * inverse * inverse);
+    potential += charge * inverse;
+}
+
+void BarnesHutTree::field(const UniverseState &state, const ParticleState &p, double openingAngle,
+        double softening, Vector2D &field, double &potential) const {
+    field = Vector2D(0, 0);
+    potential = 0;
+    if(nodes.empty()) return;
+
+    // Each level pushes at most 4 children in place of their parent, and Morton codes have 32 levels
+    int stack[3 * 32 + 8];
+    int nStack = 0;
+    stack[nStack++] = 0;
+    double softening2 = softening * softening, openingAngle2 = openingAngle * openingAngle;
+    while(nStack) {
+        const LongRangeNode &node = nodes[stack[--nStack]];
+        Vector2D d = p.pos - node.center;
+        bool inside = p.pos.x >= node.lower.x && p.pos.x <= node.upper.x
+                && p.pos.y >= node.lower.y && p.pos.y <= node.upper.y;
+        if(! inside && node.size * node.size < openingAngle2 * (d.x * d.x + d.y * d.y)) {
+            addCharge(p.pos, node.center, node.charge, softening2, field, potential);
+        } else if(node.cell >= 0) {
+            for(const ParticleState &other: state.cells[node.cell].particles) {
+                double q = other.type->getCharge();
+                if(q != 0 && &other != &p) addCharge(p.pos, other.pos, q, softening2, field, potential);
+            }
+        } else {
+            for(int i = 0; i < node.nChildren; ++i)
+                stack[nStack++] = node.firstChild + i;
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef __LONG_RANGE_H__
+#define __LONG_RANGE_H__
+
+#include <vector>
+#include <cstdint>
+#include "Lib/Particle.h"
+
+struct UniverseState;
+
+/*
+ * Optional long-range force between particle charges (ParticleType::getCharge()), e.g. Coulomb forces of charged
+ * species or gravity of self-gravitating clouds (charge proportional to mass and a negative coupling). The force is
+ * an inverse square law softened at short distances, so that it stays finite when particles overlap:
+ *     F_ij = coupling * q_i * q_j * r_ij / (|r_ij|^2 + softening^2)^(3/2)
+ *     U_ij = coupling * q_i * q_j / sqrt(|r_ij|^2 + softening^2)
+ * Positive coupling repels like charges. The force acts on top of the short-range forces and has no cutoff.
+ *
+ * Instead of summing over all pairs, the field is evaluated with a Barnes-Hut quadtree whose leaves are the occupied
+ * boxes of the UniverseState, so the tree is rebuilt from the cell grid before each force computation without
+ * sorting particles. A node far enough away (its size is below openingAngle times its distance) acts as a single
+ * charge at its centre of charge, closer nodes are opened, and the particles of opened leaves are summed directly.
+ * Opening angle 0 opens every node, which is direct summation. Centres of charge are weighted by |q|, so nodes with
+ * mixed charges are approximated less accurately.
+ */
+
+struct LongRangeNode {
+    Vector2D center; // Centre of charge, weighted by |q|
+    double charge = 0, absCharge = 0;
+    Vector2D lower, upper; // Bounding box of the particles
+    double size = 0; // Larger side of the bounding box
+    int firstChild = 0, nChildren = 0; // Children are stored contiguously
+    int cell = -1; // Index of the box in UniverseState::cells for leaves, -1 otherwise
+};
+
+class BarnesHutTree {
+public:
+    // Rebuilds the tree from the boxes of a prepared state (all particles in their boxes)
+    void build(const UniverseState &state);
+
+    // Field (force per unit charge and coupling) and potential at the particle p of state, excluding p itself
+    void field(const UniverseState &state, const ParticleState &p, double openingAngle, double softening,
+            Vector2D &field, double &potential) const;
+
+    inline const std::vector<LongRangeNode> & getNodes() const { return nodes; }
+
+private:
+    // Fills the node from the leaves [begin, end), which share the bits of their codes above level
+    void fillNode(const UniverseState &state, int node, size_t begin, size_t end, int level);
+
+    std::vector<LongRangeNode> nodes; // Root first
+    std::vector<std::pair<uint64_t, int>> leaves; // Morton code of the box and its index, sorted
+};
+
+#endif
@@ -0,0 +1,54 @@
+
+#include "Lib/Observables.h"
+#include <algorithm>
+#include <cassert>
+
+ObservableBin & ObservableBin::operator+=(const ObservableBin &rhs) {
+    n += rhs.n;
+    mass += rhs.mass;
+    momentum += rhs.momentum;
+    kineticEnergy += rhs.kineticEnergy;
+    potentialEnergy += rhs.potentialEnergy;
+    virial += rhs.virial;
+    return *this;
+}
+
+double ObservableBin::thermalEnergy() const {
+    if(mass == 0) return 0;
+    return kineticEnergy - momentum.magnitude2() / (2 * mass);
+}
+
+double ObservableBin::temperature() const {
+    return n ? thermalEnergy() / n : 0;
+}
+
+double ObservableBin::pressure(double area) const {
+    return (thermalEnergy() + virial / 2) / area;
+}
+
+void ObservableGrid::reset(int sizeX, int sizeY, double _binSize) {
+    binSize = _binSize;
+    binsX = sizeX / binSize + 1;
+    binsY = sizeY / binSize + 1;
+    bins.assign(binsX * binsY, ObservableBin());
+}
+
+ObservableBin & ObservableGrid::at(const Vector2D &pos) {
+    int x = std::max(0, std::min(binsX - 1, (int) (pos.x / binSize)));
+    int y = std::max(0, std::min(binsY - 1, (int) (pos.y / binSize)));
+    return bins[y * binsX + x];
+}
+
+ObservableGrid & ObservableGrid::operator+=(const ObservableGrid &rhs) {
+    assert(bins.size() == rhs.bins.size());
+    for(size_t i = 0; i < bins.size(); ++i)
+        bins[i] += rhs.bins[i];
+    return *this;
+}
+
+ObservableBin ObservableGrid::total() const {
+    ObservableBin sum;
+    for(const auto &bin: bins)
+        sum += bin;
+    return sum;
+}
@@ -0,0 +1,44 @@
+#ifndef __OBSERVABLES_H__
+#define __OBSERVABLES_H__
+
+#include <vector>
+#include "Lib/Vector2.h"
+
+/*
+ * Observables are accumulated during force computation into an ObservableGrid, which bins the universe into
+ * coarse square bins. Each thread accumulates into its own grid and the grids are summed afterwards.
+ * Particle quantities go into the bin of the particle, pair quantities are split between the bins of the two
+ * particles. Units are natural (k == 1), so in 2D the kinetic energy relative to the mean velocity equals n * T.
+ */
+
+struct ObservableBin {
+    size_t n = 0;
+    double mass = 0;
+    Vector2D momentum;
+    double kineticEnergy = 0; // Sum of m * v^2 / 2
+    double potentialEnergy = 0;
+    double virial = 0; // Sum of dot(r_ij, F_ij) over pairs
+
+    ObservableBin & operator+=(const ObservableBin &rhs);
+    double thermalEnergy() const; // Kinetic energy relative to the mean velocity of the bin
+    double temperature() const;
+    double pressure(double area) const; // Virial pressure, P * A = n * T + virial / 2
+};
+
+struct ObservableGrid {
+    int binsX = 0, binsY = 0;
+    double binSize = 1;
+    std::vector<ObservableBin> bins; // Row major
+
+    void reset(int sizeX, int sizeY, double _binSize); // Clears the bins
+    ObservableBin & at(const Vector2D &pos); // Positions outside the grid are clamped into it
+    ObservableGrid & operator+=(const ObservableGrid &rhs);
+    ObservableBin total() const;
+};
+
+struct ObservableSample {
+    double time;
+    ObservableGrid grid;
+};
+
+#endif
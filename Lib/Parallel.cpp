@@ -0,0 +1,28 @@
+
+#include "Lib/Parallel.h"
+#include "Lib/ThreadPool.h"
+
+void parallelForCounter(int threads, std::size_t total, void (*call)(void *function, AtomicCounter &counter),
+        void *function) {
+    AtomicCounter counter(total);
+#ifndef THREAD_POOL_ENABLED
+    call(function, counter);
+#else
+    size_t nThreads = threads;
+    if(! nThreads) nThreads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    if(nThreads == 1) {
+        call(function, counter);
+        return;
+    }
+
+    struct Job {
+        void (*call)(void *, AtomicCounter &);
+        void *function;
+        AtomicCounter *counter;
+    } job{ call, function, & counter };
+    threadPool.runOnWorkers(nThreads, [](void *arg) {
+        Job &job = *(Job *) arg;
+        job.call(job.function, *job.counter);
+    }, & job);
+#endif
+}
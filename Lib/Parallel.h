@@ -0,0 +1,25 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <cstddef>
+#include "Lib/AtomicCounter.h"
+
+/*
+ * Runs function(counter) on the given number of threads of the global thread pool (0 means one per hardware thread),
+ * which take work items from the shared counter of total items. Returns when all items are done. Without the thread
+ * pool, or with one thread, function is run on the calling thread.
+ *
+ * function is passed by reference through a plain function pointer rather than wrapped into a std::function, and
+ * the workers are started with ThreadPool::runOnWorkers(), so a parallel loop doesn't allocate.
+ */
+
+void parallelForCounter(int threads, std::size_t total, void (*call)(void *function, AtomicCounter &counter),
+        void *function);
+
+template<typename Function>
+void parallelForCounter(int threads, std::size_t total, const Function &function) {
+    parallelForCounter(threads, total, [](void *f, AtomicCounter &counter) { (*(const Function *) f)(counter); },
+            (void *) & function);
+}
+
+#endif
@@ -29,26 +29,46 @@ ParticleType::ParticleType(const std::string &_name, const std::string &spritePa
 }
 
 Vector2D ParticleType::computeForce(const ParticleType &other, const ParticleState &myState, const ParticleState &otherState) const {
+    Vector2D dVec = myState.pos - otherState.pos;
+    double d = dVec.magnitude();
+    if(d < 1e-6) {
+        return Vector2D(0, 0);
+    }
+
+    return dVec.norm() * computeForceMagnitude(other, d);
+}
+
+double ParticleType::computeForceMagnitude(const ParticleType &other, double d) const {
     const double totalRadius = radius + other.radius;
     const double totalExclusionFactor = exclusionConstant * other.exclusionConstant;
     const double totalDipoleFactor = dipoleMoment * other.dipoleMoment;
     const double minRange = std::min(range, other.range);
 
-    Vector2D dVec = myState.pos - otherState.pos;
-    double d = dVec.magnitude();
     double forceFactor = computeForceFactor(totalRadius, minRange, d);
-    Vector2D direction = dVec.norm();
-    if(forceFactor == 0 || dVec.magnitude() < 1e-6) {
-        return Vector2D(0, 0);
+    if(forceFactor == 0) {
+        return 0;
     }
 
     double dNorm = d / totalRadius;
     double exclusionForce = totalExclusionFactor * computeForceComponent(dNorm);
     double dipoleForce = -totalDipoleFactor * computeForceComponent(0.5 * dNorm);
     double totalForce = exclusionForce + dipoleForce;
-    double cutoffForce = totalForce * forceFactor;
+    return totalForce * forceFactor;
+}
+
+double ParticleType::computeWork(const ParticleType &other, double from, double to, int intervals) const {
+    // Simpson's rule for the integral of force magnitude, intervals has to be even
+    double h = (to - from) / intervals;
+    double sum = computeForceMagnitude(other, from) + computeForceMagnitude(other, to);
+    for(int i = 1; i < intervals; ++i)
+        sum += (i % 2 ? 4 : 2) * computeForceMagnitude(other, from + i * h);
+    return sum * h / 3;
+}
 
-    return direction * cutoffForce;
+double ParticleType::computePotential(const ParticleType &other, double d) const {
+    double minRange = std::min(range, other.range);
+    if(d >= minRange) return 0;
+    return computeWork(other, d, minRange);
 }
 
 double ParticleType::computeForceComponent(double d) const {
@@ -4,12 +4,19 @@
 #include "Lib/Vector2.h"
 #include <SDL2/SDL.h>
 #include <string>
+#include <cstdint>
 
 class ParticleType;
 
+enum class Phase : unsigned char { unknown, gas, liquid, solid }; // See PhaseAnalysis.h
+
 struct ParticleState {
     const ParticleType *type = nullptr;
     Vector2D pos, v;
+    uint32_t id = 0; // Assigned by Universe::addParticle(), not integrated
+    Phase phase = Phase::unknown; // Result of the last phase analysis, not integrated
+    bool asleep = false; // Frozen by sleeping (see Universe::enableSleeping()), not integrated
+    uint16_t quietSteps = 0; // Steps below the sleeping thresholds, or steps asleep
 
     ParticleState();
     ParticleState(const Vector2D &_pos);
@@ -30,12 +37,19 @@ public:
     ParticleType(const std::string &_name, const std::string &spritePath,
         double _mass, double _radius, double _exclusionConstant, double _dipoleMoment, double _range);
     Vector2D computeForce(const ParticleType &other, const ParticleState &myState, const ParticleState &otherState) const;
+    double computeForceMagnitude(const ParticleType &other, double d) const; // Positive if repulsive
+    double computeWork(const ParticleType &other, double from, double to, int intervals = 256) const; // Numerically
+    double computePotential(const ParticleType &other, double d) const; // Zero beyond range
 
     inline const std::string& getName() const { return name; }
     inline const SDL_Surface *getSpriteSurface() const { return spriteSurface; }
     inline double getRange() const { return range; }
     inline double getMass() const { return mass; }
     inline double getRadius() const { return radius; }
+    inline double getDipoleMoment() const { return dipoleMoment; }
+    inline void setDipoleMoment(double _dipoleMoment) { dipoleMoment = _dipoleMoment; }
+    inline double getCharge() const { return charge; } // Of the long-range force, see LongRange.h
+    inline void setCharge(double _charge) { charge = _charge; }
 
 private:
     double computeForceComponent(double d) const;
@@ -44,6 +58,7 @@ private:
 
     std::string name;
     double mass, radius, exclusionConstant, dipoleMoment, range;
+    double charge = 0;
     SDL_Surface *spriteSurface = nullptr;
 };
 
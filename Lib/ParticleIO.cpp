@@ -0,0 +1,326 @@
+#include "Lib/ParticleIO.h"
+#include "Lib/Universe.h"
+#include "Lib/Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef __EMSCRIPTEN__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t magic = 0x42505450; // "PTPB"
+static const uint32_t version = 1;
+static const size_t csvChunkBytes = 1 << 20;
+static const size_t binaryChunkParticles = 1 << 16;
+static const size_t exportChunkParticles = 1 << 14;
+
+struct ParticleFileHeader {
+    uint32_t magic, version;
+    uint64_t count;
+};
+
+static_assert(sizeof(ParticleFileHeader) == 16, "ParticleFileHeader must match the file layout");
+
+// Read-only mapping of a whole file. Web builds have no file mappings, the file is read into memory instead.
+class MappedFile {
+public:
+    MappedFile(const std::string &path) {
+#ifdef __EMSCRIPTEN__
+        std::ifstream in(path, std::ios::binary);
+        if(! in) throw std::runtime_error("importParticles: can't open " + path);
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if(fd < 0 || fstat(fd, & info) != 0) {
+            if(fd >= 0) close(fd);
+            throw std::runtime_error("importParticles: can't open " + path);
+        }
+        size = info.st_size;
+        if(size > 0) {
+            void *mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mem == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("importParticles: can't map " + path);
+            }
+            madvise(mem, size, MADV_SEQUENTIAL);
+            data = static_cast<const char *>(mem);
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef __EMSCRIPTEN__
+        if(size > 0) munmap(const_cast<char *>(data), size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const char *data = nullptr;
+    size_t size = 0;
+
+private:
+#ifdef __EMSCRIPTEN__
+    std::string buffer;
+#endif
+};
+
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Parses the number in [begin, end), which has to be all of it
+static bool parseDouble(const char *begin, const char *end, double &value) {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+            1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const uint64_t maxMantissa = (uint64_t) 1 << 53;
+    if(begin == end) return false;
+
+    // Fast path: the digits form an integer mantissa, which is exact in a double, as is the power of ten, so the
+    // product or quotient is correctly rounded
+    const char *p = begin;
+    bool negative = *p == '-';
+    if(*p == '-' || *p == '+') ++p;
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    bool fits = true, point = false;
+    for(; p < end && (isDigit(*p) || (*p == '.' && ! point)); ++p) {
+        if(*p == '.') {
+            point = true;
+            continue;
+        }
+        ++digits;
+        if(mantissa > (maxMantissa - 9) / 10) fits = false;
+        if(! fits) continue;
+        mantissa = 10 * mantissa + (*p - '0');
+        exponent -= point;
+    }
+    if(digits > 0 && p < end && (*p == 'e' || *p == 'E')) {
+        const char *e = p + 1;
+        bool negativeExponent = e < end && *e == '-';
+        if(e < end && (*e == '-' || *e == '+')) ++e;
+        int explicitExponent = 0;
+        const char *first = e;
+        for(; e < end && isDigit(*e) && explicitExponent < 10000; ++e)
+            explicitExponent = 10 * explicitExponent + (*e - '0');
+        if(e > first) {
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            p = e;
+        }
+    }
+    if(fits && digits > 0 && p == end && std::abs(exponent) <= 22) {
+        value = exponent >= 0 ? mantissa * powers[exponent] : mantissa / powers[-exponent];
+        if(negative) value = -value;
+        return true;
+    }
+
+    // Long mantissas and large exponents
+    char token[128];
+    size_t length = end - begin;
+    if(length >= sizeof(token)) return false;
+    std::memcpy(token, begin, length);
+    token[length] = 0;
+    char *parsedEnd;
+    value = std::strtod(token, & parsedEnd);
+    return parsedEnd == token + length;
+}
+
+// Parses the next field of a line, which ends at a comma, or at the end of the line if it's the last one
+static bool parseField(const char *&p, const char *end, bool last, double &value) {
+    const char *fieldEnd = std::find(p, end, ',');
+    if(last != (fieldEnd == end)) return false;
+    const char *numberBegin = p, *numberEnd = fieldEnd;
+    while(numberBegin < numberEnd && isBlank(*numberBegin)) ++numberBegin;
+    while(numberEnd > numberBegin && isBlank(numberEnd[-1])) --numberEnd;
+    if(! parseDouble(numberBegin, numberEnd, value) || ! std::isfinite(value)) return false;
+    p = last ? end : fieldEnd + 1;
+    return true;
+}
+
+static bool parseLine(const char *p, const char *end, int &type, Vector2D &pos, Vector2D &v) {
+    double fields[5];
+    for(int i = 0; i < 5; ++i)
+        if(! parseField(p, end, i == 4, fields[i])) return false;
+    if(fields[0] != std::floor(fields[0]) || fields[0] < 0 || fields[0] > 1e9) return false;
+    type = fields[0];
+    pos = Vector2D(fields[1], fields[2]);
+    v = Vector2D(fields[3], fields[4]);
+    return true;
+}
+
+static bool isEmptyLine(const char *p, const char *end) {
+    return std::all_of(p, end, isBlank);
+}
+
+static void importCsv(Universe &universe, const MappedFile &file, const std::string &path,
+        std::vector<ParticleState> &particles) {
+    const char *begin = file.data, *end = file.data + file.size;
+    const auto &types = universe.getParticleTypes();
+
+    // A header doesn't start with a number
+    const char *first = begin;
+    while(first < end && isBlank(*first)) ++first;
+    if(first < end && ! isDigit(*first) && *first != '-' && *first != '+' && *first != '.' && *first != '\n') {
+        const char *newline = std::find(first, end, '\n');
+        begin = newline == end ? end : newline + 1;
+    }
+
+    // Chunks start at the beginning of a line
+    std::vector<const char *> bounds(1, begin);
+    while(bounds.back() < end) {
+        const char *next = bounds.back() + std::min<size_t>(csvChunkBytes, end - bounds.back());
+        next = std::find(next, end, '\n');
+        bounds.push_back(next == end ? end : next + 1);
+    }
+    size_t nChunks = bounds.size() - 1;
+
+    std::vector<std::vector<ParticleState>> chunks(nChunks);
+    std::vector<const char *> errors(nChunks, nullptr); // First malformed line of each chunk
+    parallelForCounter(universe.getConfig().threads, nChunks, [&](AtomicCounter &counter) {
+        for(size_t c = counter.next(); c < counter.total(); c = counter.next()) {
+            for(const char *line = bounds[c]; line < bounds[c + 1];) {
+                const char *lineEnd = std::find(line, bounds[c + 1], '\n');
+                int type;
+                Vector2D pos, v;
+                if(! isEmptyLine(line, lineEnd)) {
+                    if(! parseLine(line, lineEnd, type, pos, v) || (size_t) type >= types.size()) {
+                        errors[c] = line;
+                        break;
+                    }
+                    chunks[c].emplace_back(pos, v);
+                    chunks[c].back().type = & types[type];
+                }
+                line = lineEnd + 1;
+            }
+        }
+    });
+
+    for(const char *error: errors)
+        if(error) {
+            size_t line = std::count(file.data, error, '\n') + 1;
+            throw std::runtime_error("importParticles: " + path + ":" + std::to_string(line)
+                    + ": expected type,x,y,vx,vy with a known particle type");
+        }
+
+    size_t n = 0;
+    for(const auto &chunk: chunks)
+        n += chunk.size();
+    particles.reserve(n);
+    for(const auto &chunk: chunks)
+        particles.insert(particles.end(), chunk.begin(), chunk.end());
+}
+
+static void importBinary(Universe &universe, const MappedFile &file, const std::string &path,
+        std::vector<ParticleState> &particles) {
+    ParticleFileHeader header;
+    if(file.size < sizeof(header))
+        throw std::runtime_error("importParticles: " + path + " isn't a binary particle file");
+    std::memcpy(& header, file.data, sizeof(header));
+    if(header.magic != magic || header.version != version
+            || (file.size - sizeof(header)) / sizeof(SnapshotParticle) != header.count
+            || (file.size - sizeof(header)) % sizeof(SnapshotParticle) != 0)
+        throw std::runtime_error("importParticles: " + path + " isn't a binary particle file of this version");
+
+    // The mapping is page aligned and the particles start at 16 bytes, so they can be read in place
+    const SnapshotParticle *records = reinterpret_cast<const SnapshotParticle *>(file.data + sizeof(header));
+    const auto &types = universe.getParticleTypes();
+    size_t n = header.count;
+    particles.resize(n);
+    std::atomic<bool> unknownType(false);
+    parallelForCounter(universe.getConfig().threads, (n + binaryChunkParticles - 1) / binaryChunkParticles,
+            [&](AtomicCounter &counter) {
+        for(size_t chunk = counter.next(); chunk < counter.total(); chunk = counter.next())
+            for(size_t i = chunk * binaryChunkParticles; i < std::min((chunk + 1) * binaryChunkParticles, n); ++i) {
+                const SnapshotParticle &record = records[i];
+                if(record.type >= types.size()) {
+                    unknownType = true;
+                    continue;
+                }
+                particles[i] = ParticleState(Vector2D(record.x, record.y), Vector2D(record.vx, record.vy));
+                particles[i].type = & types[record.type];
+            }
+    });
+    if(unknownType) throw std::runtime_error("importParticles: " + path + " has an unknown particle type");
+}
+
+ParticleFormat parseParticleFormat(const std::string &name) {
+    if(name == "csv") return ParticleFormat::csv;
+    if(name == "binary") return ParticleFormat::binary;
+    throw std::runtime_error("Unknown particle file format " + name + ", expected csv or binary");
+}
+
+void importParticles(Universe &universe, const std::string &path, ParticleFormat format) {
+    std::vector<ParticleState> particles;
+    {
+        MappedFile file(path);
+        if(format == ParticleFormat::csv) importCsv(universe, file, path, particles);
+        else importBinary(universe, file, path, particles);
+    }
+    universe.addParticles(particles);
+}
+
+
+void exportParticles(Universe &universe, const std::string &path, ParticleFormat format) {
+    std::vector<SnapshotParticle> records;
+    records.reserve(universe.size());
+    const ParticleType *types = universe.getParticleTypes().data();
+    for(const ParticleState &p: universe) {
+        SnapshotParticle record;
+        record.id = p.id;
+        record.type = p.type - types;
+        record.phase = (uint8_t) p.phase;
+        record.unused = 0;
+        record.x = p.pos.x;
+        record.y = p.pos.y;
+        record.vx = p.v.x;
+        record.vy = p.v.y;
+        records.push_back(record);
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if(! out) throw std::runtime_error("exportParticles: can't open " + path);
+    if(format == ParticleFormat::binary) {
+        ParticleFileHeader header{ magic, version, records.size() };
+        out.write(reinterpret_cast<const char *>(& header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(SnapshotParticle));
+    } else {
+        // Chunks of lines are formatted in parallel and written in order
+        size_t nChunks = (records.size() + exportChunkParticles - 1) / exportChunkParticles;
+        std::vector<std::string> chunks(nChunks);
+        parallelForCounter(universe.getConfig().threads, nChunks, [&](AtomicCounter &counter) {
+            for(size_t c = counter.next(); c < counter.total(); c = counter.next()) {
+                size_t last = std::min((c + 1) * exportChunkParticles, records.size());
+                for(size_t i = c * exportChunkParticles; i < last; ++i) {
+                    char line[128];
+                    const SnapshotParticle &r = records[i];
+                    int length = std::snprintf(line, sizeof(line), "%d,%.17g,%.17g,%.17g,%.17g\n",
+                            r.type, r.x, r.y, r.vx, r.vy);
+                    chunks[c].append(line, length);
+                }
+            }
+        });
+        out << "type,x,y,vx,vy\n";
+        for(const std::string &chunk: chunks)
+            out.write(chunk.data(), chunk.size());
+    }
+    if(! out.flush()) throw std::runtime_error("exportParticles: can't write " + path);
+}
@@ -0,0 +1,35 @@
+#ifndef __PARTICLE_IO_H__
+#define __PARTICLE_IO_H__
+
+#include <string>
+
+class Universe;
+
+/*
+ * Bulk import and export of particles, for particle sets produced or consumed by other programs.
+ *
+ * CSV: one particle per line as type,x,y,vx,vy, where type is the index of the particle type. A first line that
+ * doesn't start with a number is a header and skipped, as are empty lines; fields may be padded with spaces and lines
+ * may end with \r\n. Exported numbers are written with 17 significant digits, so they are read back exactly.
+ *
+ * Binary: a header of magic "PTPB", version 1 (uint32 each) and the number of particles (uint64), followed by the
+ * particles in the SnapshotParticle layout of SnapshotRing.h, all in the byte order of the machine.
+ *
+ * Files are read through a read-only memory mapping. Binary particles are read in place from the mapping. CSV files
+ * are split into chunks of 1 MiB at line boundaries, which are parsed in parallel on the threads of the universe's
+ * config. Numbers whose digits fit into the 53 bit mantissa of a double and whose decimal exponent is at most 22 are
+ * parsed exactly with one multiplication or division, others fall back to strtod(). Numbers have to be finite. The
+ * particles are then added with Universe::addParticles(), which bins them into the boxes in parallel chunks. Ids and
+ * phases aren't imported, the universe assigns new ids.
+ *
+ * Import and export throw std::runtime_error if the file can't be read or written, or is malformed (with its line
+ * for CSV), or refers to a particle type the universe doesn't have. Nothing is added to the universe then.
+ */
+
+enum class ParticleFormat { csv, binary };
+
+ParticleFormat parseParticleFormat(const std::string &name); // "csv" or "binary", throws std::runtime_error otherwise
+void importParticles(Universe &universe, const std::string &path, ParticleFormat format);
+void exportParticles(Universe &universe, const std::string &path, ParticleFormat format);
+
+#endif
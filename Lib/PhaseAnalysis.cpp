@@ -0,0 +1,142 @@
+
+#include "Lib/PhaseAnalysis.h"
+#include "Lib/Universe.h"
+#include "Lib/Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+
+namespace {
+
+struct Bonds {
+    std::vector<size_t> offsets; // Index of the first particle of each box
+    std::vector<double> pairDistances2; // Squared bond distances of type pairs
+    std::vector<std::array<int, 2>> shell; // Relative poses of all neighbouring boxes, including the box itself
+    std::vector<std::atomic<int>> parent;
+    std::vector<std::complex<double>> psi6;
+    std::vector<int> nBonds;
+
+    explicit Bonds(size_t n): parent(n), psi6(n), nBonds(n) {}
+};
+
+int findRoot(std::vector<std::atomic<int>> &parent, int x) {
+    for(;;) { // Path halving, lost updates only leave longer paths behind
+        int p = parent[x].load(std::memory_order_relaxed);
+        if(p == x) return x;
+        int grandParent = parent[p].load(std::memory_order_relaxed);
+        if(grandParent != p) parent[x].compare_exchange_weak(p, grandParent, std::memory_order_relaxed);
+        x = grandParent;
+    }
+}
+
+void unite(std::vector<std::atomic<int>> &parent, int a, int b) {
+    for(;;) {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if(a == b) return;
+        if(a < b) std::swap(a, b); // Larger root is linked under the smaller one
+        int expected = a;
+        if(parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) return;
+    }
+}
+
+void bondOneThread(Bonds &bonds, const UniverseState &state, const UniverseDifferentiator &diff,
+        AtomicCounter &counter) {
+    // Bonds are found from the full shell of neighbouring boxes, so that each thread only writes to psi6 and nBonds
+    // of its own box
+    size_t nTypes = diff.types.size();
+    for(int c0 = counter.next(); c0 < counter.total(); c0 = counter.next()) {
+        const auto &particles0 = state.cells[c0].particles;
+        for(const auto &pose: bonds.shell) {
+            int c1 = state.cellIndex(state.cells[c0].x + pose[0], state.cells[c0].y + pose[1]);
+            if(c1 < 0) continue;
+            const auto &particles1 = state.cells[c1].particles;
+            for(size_t i0 = 0; i0 < particles0.size(); ++i0) {
+                int index0 = bonds.offsets[c0] + i0;
+                const double *distances2 = &bonds.pairDistances2[nTypes * (particles0[i0].type - diff.types.data())];
+                for(size_t i1 = 0; i1 < particles1.size(); ++i1) {
+                    int index1 = bonds.offsets[c1] + i1;
+                    if(index0 == index1) continue;
+                    Vector2D d = particles1[i1].pos - particles0[i0].pos;
+                    if(d.magnitude2() >= distances2[particles1[i1].type - diff.types.data()]) continue;
+
+                    bonds.psi6[index0] += std::polar(1., 6 * std::atan2(d.y, d.x));
+                    ++bonds.nBonds[index0];
+                    if(index0 < index1) unite(bonds.parent, index0, index1);
+                }
+            }
+        }
+    }
+}
+
+void classifyOneThread(Bonds &bonds, const std::vector<size_t> &clusterSizes, UniverseState &state,
+        const PhaseAnalysisConfig &config, AtomicCounter &counter) {
+    for(int c = counter.next(); c < counter.total(); c = counter.next()) {
+        auto &particles = state.cells[c].particles;
+        for(size_t i = 0; i < particles.size(); ++i) {
+            int index = bonds.offsets[c] + i;
+            int bondCount = bonds.nBonds[index];
+            double order = bondCount ? std::abs(bonds.psi6[index]) / bondCount : 0;
+            if(clusterSizes[findRoot(bonds.parent, index)] < config.minLiquidCluster)
+                particles[i].phase = Phase::gas;
+            else if(bondCount >= config.minSolidBonds && order >= config.minSolidOrder)
+                particles[i].phase = Phase::solid;
+            else
+                particles[i].phase = Phase::liquid;
+        }
+    }
+}
+
+}
+
+PhaseSample analysePhases(UniverseState &state, const UniverseDifferentiator &diff, const PhaseAnalysisConfig &config) {
+    Bonds bonds(state.size());
+    bonds.offsets.resize(state.cells.size() + 1);
+    bonds.offsets[0] = 0;
+    for(size_t c = 0; c < state.cells.size(); ++c)
+        bonds.offsets[c + 1] = bonds.offsets[c] + state.cells[c].particles.size();
+    for(size_t i = 0; i < bonds.parent.size(); ++i)
+        bonds.parent[i].store(i, std::memory_order_relaxed);
+
+    // Bonds can't be longer than the interaction range, which the stencil covers
+    size_t nTypes = diff.types.size();
+    bonds.pairDistances2.resize(nTypes * nTypes);
+    for(size_t t0 = 0; t0 < nTypes; ++t0)
+        for(size_t t1 = 0; t1 < nTypes; ++t1) {
+            double distance = std::min(config.bondFactor * (diff.types[t0].getRadius() + diff.types[t1].getRadius()),
+                    diff.pairRanges[nTypes * t0 + t1]);
+            bonds.pairDistances2[nTypes * t0 + t1] = distance * distance;
+        }
+    for(const auto &cell: diff.stencil) {
+        bonds.shell.push_back({ cell.x, cell.y });
+        if(cell.x || cell.y) bonds.shell.push_back({ -cell.x, -cell.y });
+    }
+
+    parallelForCounter(diff.config.threads, state.cells.size(), [&](AtomicCounter &counter) {
+        bondOneThread(bonds, state, diff, counter);
+    });
+
+    std::vector<size_t> clusterSizes(bonds.parent.size());
+    for(size_t i = 0; i < bonds.parent.size(); ++i)
+        ++clusterSizes[findRoot(bonds.parent, i)];
+
+    parallelForCounter(diff.config.threads, state.cells.size(), [&](AtomicCounter &counter) {
+        classifyOneThread(bonds, clusterSizes, state, config, counter);
+    });
+
+    PhaseSample sample{ 0, {}, {}, 0 };
+    for(const auto &cell: state.cells)
+        for(const auto &pState: cell.particles)
+            ++sample.phaseCounts[(int) pState.phase];
+    for(size_t i = 0; i < clusterSizes.size(); ++i) {
+        size_t size = clusterSizes[i];
+        if(! size) continue;
+        size_t bin = 0;
+        while(size >> (bin + 1)) ++bin;
+        if(sample.clusterSizes.size() <= bin) sample.clusterSizes.resize(bin + 1);
+        ++sample.clusterSizes[bin];
+        sample.largestCluster = std::max(sample.largestCluster, size);
+    }
+    return sample;
+}
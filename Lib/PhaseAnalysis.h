@@ -0,0 +1,42 @@
+#ifndef __PHASE_ANALYSIS_H__
+#define __PHASE_ANALYSIS_H__
+
+#include <array>
+#include <vector>
+#include <cstddef>
+
+struct UniverseState;
+struct UniverseDifferentiator;
+
+/*
+ * Phase analysis classifies each particle as gas, liquid or solid and stores the result in ParticleState::phase.
+ *
+ * Two particles are bonded if they are closer than bondFactor times the sum of their radii. Clusters of bonded
+ * particles are found with a concurrent union-find, where threads process boxes of the grid in parallel and link
+ * the clusters of bonded particles with compare-and-swap. Roots are always the smallest particle index of the
+ * cluster, so the result doesn't depend on the order of the unions.
+ *
+ * The local order is measured by the hexatic order parameter psi6 = |mean(exp(6i * angle))| over the bonds of a
+ * particle, which is 1 in a perfect triangular lattice and small in a disordered neighbourhood. Particles in small
+ * clusters are gas, ordered particles with enough bonds are solid and the rest are liquid.
+ */
+
+struct PhaseAnalysisConfig {
+    int interval = 0; // Universe analyses phases after every interval steps, 0 disables the analysis
+    double bondFactor = 1.5;
+    size_t minLiquidCluster = 5; // Particles in smaller clusters are gas
+    int minSolidBonds = 4;
+    double minSolidOrder = 0.7; // psi6 of a solid particle
+};
+
+struct PhaseSample {
+    double time;
+    std::array<size_t, 4> phaseCounts; // Indexed by Phase
+    std::vector<size_t> clusterSizes; // Number of clusters with size in [2^i, 2^(i+1))
+    size_t largestCluster;
+};
+
+// The state has to be prepared, so that all particles are in their boxes
+PhaseSample analysePhases(UniverseState &state, const UniverseDifferentiator &diff, const PhaseAnalysisConfig &config);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __PHILOX_H__
+#define __PHILOX_H__
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+/*
+ * Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+ * Random numbers are a pure function of a counter and a key, so there is no generator state to share between
+ * threads, and the numbers drawn for a particle don't depend on which thread processes it.
+ */
+
+typedef std::array<uint32_t, 4> PhiloxCounter;
+typedef std::array<uint32_t, 2> PhiloxKey;
+
+inline PhiloxCounter philox4x32(PhiloxCounter counter, PhiloxKey key) {
+    const uint32_t m0 = 0xD2511F53, m1 = 0xCD9E8D57;
+    const uint32_t w0 = 0x9E3779B9, w1 = 0xBB67AE85;
+    for(int round = 0; round < 10; ++round) {
+        uint64_t product0 = (uint64_t) m0 * counter[0], product1 = (uint64_t) m1 * counter[2];
+        counter = {
+                (uint32_t) (product1 >> 32) ^ counter[1] ^ key[0], (uint32_t) product1,
+                (uint32_t) (product0 >> 32) ^ counter[3] ^ key[1], (uint32_t) product0
+        };
+        key[0] += w0;
+        key[1] += w1;
+    }
+    return counter;
+}
+
+// Uniform in (0, 1) from 64 random bits
+inline double philoxUniform(uint32_t high, uint32_t low) {
+    return ((((uint64_t) high << 32 | low) >> 11) + 0.5) * (1. / 9007199254740992.);
+}
+
+// Two independent standard normal numbers (Box-Muller) from one block of random bits
+inline std::array<double, 2> philoxNormal2(const PhiloxCounter &bits) {
+    double r = std::sqrt(-2 * std::log(philoxUniform(bits[0], bits[1])));
+    double phi = 2 * M_PI * philoxUniform(bits[2], bits[3]);
+    return { r * std::cos(phi), r * std::sin(phi) };
+}
+
+#endif
@@ -0,0 +1,212 @@
+
+#include "Lib/Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iomanip>
+
+#if defined(__linux__) && ! defined(__EMSCRIPTEN__)
+#define PERF_EVENTS_ENABLED
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char * const PerfCounts::names[PerfCounts::nCounters] = { "cycles", "instructions", "cacheMisses", "branchMisses" };
+
+PerfCounts & PerfCounts::operator+=(const PerfCounts &rhs) {
+    for(int i = 0; i < nCounters; ++i)
+        values[i] += rhs.values[i];
+    return *this;
+}
+
+PerfCounts PerfCounts::operator-(const PerfCounts &rhs) const {
+    PerfCounts result;
+    for(int i = 0; i < nCounters; ++i)
+        result.values[i] = values[i] - rhs.values[i];
+    return result;
+}
+
+Profiler *Profiler::activeProfiler = nullptr;
+static std::atomic<uint64_t> profilerGenerations(0);
+
+Profiler::Profiler(bool _useCounters, size_t _maxEventsPerThread):
+        useCounters(_useCounters), maxEventsPerThread(_maxEventsPerThread), generation(++profilerGenerations),
+        start(Clock::now()) {
+}
+
+Profiler::~Profiler() {
+    if(activeProfiler == this) activeProfiler = nullptr;
+#ifdef PERF_EVENTS_ENABLED
+    for(auto &thread: threads)
+        for(int fd: thread->counterFds)
+            if(fd >= 0) close(fd);
+#endif
+}
+
+void Profiler::activate(Profiler *profiler) {
+    activeProfiler = profiler;
+}
+
+Profiler::ThreadProfile & Profiler::threadProfile() {
+    struct Cached { uint64_t generation = 0; ThreadProfile *profile = nullptr; };
+    static thread_local Cached cached;
+    if(cached.generation == generation) return *cached.profile;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    threads.emplace_back(new ThreadProfile);
+    ThreadProfile &profile = *threads.back();
+    profile.tid = threads.size() - 1;
+    profile.counterSlots.fill(-1);
+    if(! useCounters) profile.counterFds.assign(1, -1); // Marks the counters as tried
+    cached = { generation, &profile };
+    return profile;
+}
+
+void Profiler::ThreadProfile::openCounters() {
+    counterFds.assign(1, -1);
+#ifdef PERF_EVENTS_ENABLED
+    const std::array<std::pair<uint32_t, uint64_t>, PerfCounts::nCounters> events = {{
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES } }};
+
+    // The first counter that opens leads the group, counters that the hardware doesn't have are left out
+    int nOpen = 0;
+    for(int i = 0; i < PerfCounts::nCounters; ++i) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].first;
+        attr.config = events[i].second;
+        attr.disabled = nOpen == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        int fd = syscall(__NR_perf_event_open, &attr, 0, -1, nOpen ? counterFds[0] : -1, 0); // This thread, any CPU
+        if(fd < 0) continue;
+        if(nOpen == 0) counterFds[0] = fd;
+        else counterFds.push_back(fd);
+        counterSlots[i] = nOpen++;
+    }
+    if(nOpen) ioctl(counterFds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+PerfCounts Profiler::ThreadProfile::readCounters() const {
+    PerfCounts counts;
+#ifdef PERF_EVENTS_ENABLED
+    if(counterFds[0] < 0) return counts;
+    uint64_t group[1 + PerfCounts::nCounters];
+    if(read(counterFds[0], group, sizeof(group)) <= 0) return counts;
+    for(int i = 0; i < PerfCounts::nCounters; ++i)
+        if(counterSlots[i] >= 0 && (uint64_t) counterSlots[i] < group[0])
+            counts.values[i] = group[1 + counterSlots[i]];
+#endif
+    return counts;
+}
+
+bool Profiler::countersAvailable() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(const auto &thread: threads)
+        if(! thread->counterFds.empty() && thread->counterFds[0] >= 0) return true;
+    return false;
+}
+
+std::map<std::string, PhaseStats> Profiler::phaseTotals() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, PhaseStats> totals;
+    for(const auto &thread: threads) {
+        for(const auto &namePhase: thread->phases) {
+            PhaseStats &total = totals[namePhase.first];
+            total.count += namePhase.second.count;
+            total.seconds += namePhase.second.seconds;
+            total.counts += namePhase.second.counts;
+        }
+    }
+    return totals;
+}
+
+void Profiler::writeTrace(std::ostream &out) const {
+    // Complete ("X") events with microsecond timestamps, and the names of the threads
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for(const auto &thread: threads) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->tid
+            << ",\"args\":{\"name\":\"thread " << thread->tid << "\"}}";
+        first = false;
+        for(const Event &event: thread->events) {
+            out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->tid
+                << std::fixed << std::setprecision(3) << ",\"ts\":" << event.begin / 1e3
+                << ",\"dur\":" << event.duration / 1e3;
+            if(event.box >= 0) out << ",\"args\":{\"box\":" << event.box << ",\"particles\":" << event.particles << "}";
+            out << "}";
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    out.unsetf(std::ios::fixed);
+}
+
+static void writeStatsLine(std::ostream &out, const std::string &name, const std::string &thread,
+        const PhaseStats &stats) {
+    const PerfCounts &c = stats.counts;
+    out << std::left << std::setw(16) << name << std::setw(8) << thread << std::right << std::setw(10) << stats.count
+        << std::setw(12) << std::setprecision(4) << stats.seconds;
+    for(uint64_t value: c.values)
+        out << std::setw(14) << value;
+    out << std::setw(8) << std::setprecision(3) << (c.values[0] ? (double) c.values[1] / c.values[0] : 0) << "\n";
+}
+
+void Profiler::writeSummary(std::ostream &out) const {
+    out << "phase           thread       count     seconds        cycles  instructions   cacheMisses  branchMisses     IPC\n";
+    for(const auto &namePhase: phaseTotals())
+        writeStatsLine(out, namePhase.first, "all", namePhase.second);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> names;
+    for(const auto &thread: threads)
+        for(const auto &namePhase: thread->phases)
+            names.push_back(namePhase.first);
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for(const std::string &name: names)
+        for(const auto &thread: threads) {
+            auto it = thread->phases.find(name);
+            if(it != thread->phases.end()) writeStatsLine(out, name, std::to_string(thread->tid), it->second);
+        }
+    uint64_t dropped = 0;
+    for(const auto &thread: threads)
+        dropped += thread->droppedEvents;
+    if(dropped) out << dropped << " trace events dropped\n";
+}
+
+void ProfileSpan::begin(const char *_name, bool _phase, int64_t _box, int64_t _particles) {
+    profiler = Profiler::activeProfiler;
+    profile = & profiler->threadProfile();
+    name = _name;
+    phase = _phase;
+    box = _box;
+    particles = _particles;
+    if(phase) {
+        if(profile->counterFds.empty()) profile->openCounters();
+        beginCounts = profile->readCounters();
+    }
+    beginTime = profiler->now();
+}
+
+void ProfileSpan::end() {
+    int64_t endTime = profiler->now();
+    if(profile->events.size() < profiler->maxEventsPerThread)
+        profile->events.push_back({ name, beginTime, endTime - beginTime, box, particles });
+    else
+        ++profile->droppedEvents;
+    if(phase) {
+        PhaseStats &stats = profile->phases[name];
+        ++stats.count;
+        stats.seconds += (endTime - beginTime) / 1e9;
+        stats.counts += profile->readCounters() - beginCounts;
+    }
+}
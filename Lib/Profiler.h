@@ -0,0 +1,121 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Profiler records spans of the step pipeline on every thread that runs it. While a Profiler is active (see
+ * Profiler::activate()), ProfileSpans are recorded into a per-thread trace, which can be written as Chrome trace-event
+ * JSON (chrome://tracing or https://ui.perfetto.dev) to see load imbalance and idle gaps of the workers.
+ * Force computation records a span per box taken from the AtomicCounter, tagged with the box index and its number
+ * of particles.
+ *
+ * Phase spans (e.g. "forces", "thermostats") are also summed per phase and per thread. With hardware counters, each
+ * thread opens its own perf_event_open() group of cycles, instructions, last level cache misses and branch misses
+ * (user space only) on its first phase span, and the counts within phase spans are summed as well. Counters are
+ * only available on Linux, and only if perf events are permitted (see /proc/sys/kernel/perf_event_paranoid),
+ * otherwise they read as zero.
+ *
+ * Without an active Profiler, a ProfileSpan costs a load and a branch.
+ */
+
+struct PerfCounts {
+    static const int nCounters = 4;
+    static const char * const names[nCounters];
+    std::array<uint64_t, nCounters> values{}; // cycles, instructions, cacheMisses, branchMisses
+
+    PerfCounts & operator+=(const PerfCounts &rhs);
+    PerfCounts operator-(const PerfCounts &rhs) const;
+};
+
+struct PhaseStats {
+    uint64_t count = 0;
+    double seconds = 0;
+    PerfCounts counts;
+};
+
+class Profiler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    Profiler(bool useCounters = true, size_t _maxEventsPerThread = 1 << 22);
+    ~Profiler();
+    Profiler(const Profiler &) = delete;
+    Profiler & operator=(const Profiler &) = delete;
+
+    // Spans are recorded into the active profiler, nullptr stops recording. Must not be changed while other threads
+    // are recording spans.
+    static void activate(Profiler *profiler);
+    static inline Profiler * active() { return activeProfiler; }
+
+    bool countersAvailable() const; // True if some thread has opened its counters
+    std::map<std::string, PhaseStats> phaseTotals() const; // Summed over threads
+    void writeTrace(std::ostream &out) const;
+    void writeSummary(std::ostream &out) const; // Per phase, then per phase and thread
+
+private:
+    friend class ProfileSpan;
+
+    struct Event {
+        const char *name;
+        int64_t begin, duration; // Nanoseconds since the profiler was created
+        int64_t box, particles; // Arguments of box spans, -1 otherwise
+    };
+
+    struct ThreadProfile {
+        int tid;
+        std::vector<Event> events;
+        uint64_t droppedEvents = 0;
+        std::map<std::string, PhaseStats> phases;
+        std::vector<int> counterFds; // Group leader first, -1 if not opened
+        std::array<int, PerfCounts::nCounters> counterSlots; // Position of each counter in a group read, -1 if absent
+
+        void openCounters();
+        PerfCounts readCounters() const;
+    };
+
+    ThreadProfile & threadProfile(); // Of the calling thread, created on first use
+    inline int64_t now() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count(); }
+
+    static Profiler *activeProfiler;
+    bool useCounters;
+    size_t maxEventsPerThread;
+    uint64_t generation; // Tells apart profilers, whose ThreadProfiles are cached in thread local storage
+    Clock::time_point start;
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadProfile>> threads;
+};
+
+class ProfileSpan {
+public:
+    // Phase spans also sum time and hardware counters per phase. name must outlive the profiler (a literal).
+    inline ProfileSpan(const char *_name, bool _phase = false, int64_t _box = -1, int64_t _particles = -1) {
+        if(Profiler::activeProfiler) begin(_name, _phase, _box, _particles);
+    }
+    inline ~ProfileSpan() {
+        if(profile) end();
+    }
+    ProfileSpan(const ProfileSpan &) = delete;
+    ProfileSpan & operator=(const ProfileSpan &) = delete;
+
+private:
+    void begin(const char *_name, bool _phase, int64_t _box, int64_t _particles);
+    void end();
+
+    Profiler *profiler = nullptr;
+    Profiler::ThreadProfile *profile = nullptr;
+    const char *name;
+    bool phase;
+    int64_t box, particles, beginTime;
+    PerfCounts beginCounts;
+};
+
+#endif
@@ -0,0 +1,136 @@
+
+#include "Lib/RadialDistribution.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+void PairHistogram::reset(size_t _nTypes, int _bins, double _binWidth) {
+    nTypes = _nTypes;
+    bins = _bins;
+    binWidth = _binWidth;
+    counts.assign(nTypes * nTypes * bins, 0);
+    typeCounts.assign(nTypes, 0);
+}
+
+void PairHistogram::addPair(size_t t0, size_t t1, double distance) {
+    int bin = distance / binWidth;
+    if(bin >= bins) return;
+    if(t0 > t1) std::swap(t0, t1);
+    counts[(nTypes * t0 + t1) * bins + bin] += 1;
+}
+
+PairHistogram & PairHistogram::operator+=(const PairHistogram &rhs) {
+    assert(counts.size() == rhs.counts.size());
+    for(size_t i = 0; i < counts.size(); ++i)
+        counts[i] += rhs.counts[i];
+    for(size_t i = 0; i < typeCounts.size(); ++i)
+        typeCounts[i] += rhs.typeCounts[i];
+    return *this;
+}
+
+PairHistogram & PairHistogram::operator-=(const PairHistogram &rhs) {
+    assert(counts.size() == rhs.counts.size());
+    for(size_t i = 0; i < counts.size(); ++i)
+        counts[i] -= rhs.counts[i];
+    for(size_t i = 0; i < typeCounts.size(); ++i)
+        typeCounts[i] -= rhs.typeCounts[i];
+    return *this;
+}
+
+
+void RadialDistribution::reset(size_t nTypes, double maxRange, double binWidth, size_t _window, double _area) {
+    sum.reset(nTypes, (int) std::ceil(maxRange / binWidth), binWidth);
+    samples.clear();
+    window = std::max(_window, (size_t) 1);
+    area = _area;
+}
+
+PairHistogram & RadialDistribution::beginSample() {
+    if(samples.size() >= window) { // Oldest sample is rotated to the back and reused, which doesn't allocate
+        sum -= samples.front();
+        std::rotate(samples.begin(), samples.begin() + 1, samples.end());
+    } else {
+        samples.emplace_back();
+    }
+    samples.back().reset(sum.nTypes, sum.bins, sum.binWidth);
+    return samples.back();
+}
+
+void RadialDistribution::endSample() {
+    sum += samples.back();
+}
+
+double RadialDistribution::expectedPairs(double typePairs, int bin) const {
+    // Pairs of an ideal gas in the ring of the bin, summed over the samples
+    double r0 = bin * sum.binWidth, r1 = r0 + sum.binWidth;
+    return typePairs * M_PI * (r1 * r1 - r0 * r0) / area;
+}
+
+double RadialDistribution::g(size_t t0, size_t t1, int bin) const {
+    if(t0 > t1) std::swap(t0, t1);
+    // Particle counts are summed over samples, so pairs are approximated by n0 * n1 / samples
+    double n0 = sum.typeCounts[t0], n1 = sum.typeCounts[t1], nSamples = samples.size();
+    double typePairs = t0 == t1 ? n0 * (n0 / nSamples - 1) / 2 : n0 * n1 / nSamples;
+    double expected = expectedPairs(typePairs, bin);
+    return expected > 0 ? sum.counts[(sum.nTypes * t0 + t1) * sum.bins + bin] / expected : 0;
+}
+
+double RadialDistribution::g(int bin) const {
+    double n = 0, count = 0;
+    for(double typeCount: sum.typeCounts)
+        n += typeCount;
+    for(size_t t0 = 0; t0 < sum.nTypes; ++t0)
+        for(size_t t1 = t0; t1 < sum.nTypes; ++t1)
+            count += sum.counts[(sum.nTypes * t0 + t1) * sum.bins + bin];
+    double expected = expectedPairs(n * (n / samples.size() - 1) / 2, bin);
+    return expected > 0 ? count / expected : 0;
+}
+
+static double besselJ0(double x) {
+    // J0(x) = 1/pi * integral of cos(x sin(t)) over [0, pi]. The integrand is periodic and smooth, so the trapezoid
+    // rule converges quickly once there are clearly more points than x.
+    int n = 32 + (int) std::abs(x);
+    double total = 0;
+    for(int i = 0; i < n; ++i)
+        total += std::cos(x * std::sin(M_PI * (i + 0.5) / n));
+    return total / n;
+}
+
+double RadialDistribution::structureFactor(double k, double maxRadius) const {
+    double n = 0;
+    for(double typeCount: sum.typeCounts)
+        n += typeCount;
+    double density = n / samples.size() / area;
+
+    double integral = 0;
+    int maxBin = std::min(sum.bins, (int) (maxRadius / sum.binWidth));
+    for(int bin = 0; bin < maxBin; ++bin) {
+        double r = (bin + 0.5) * sum.binWidth;
+        integral += (g(bin) - 1) * 2 * M_PI * r * besselJ0(k * r) * sum.binWidth;
+    }
+    return 1 + density * integral;
+}
+
+void RadialDistribution::write(std::ostream &out, double maxRadius, int kValues) const {
+    if(empty()) return;
+    out << "# r g";
+    for(size_t t0 = 0; t0 < sum.nTypes; ++t0)
+        for(size_t t1 = t0; t1 < sum.nTypes; ++t1)
+            out << " g_" << t0 << "_" << t1;
+    out << "\n";
+    for(int bin = 0; bin < sum.bins; ++bin) {
+        out << (bin + 0.5) * sum.binWidth << " " << g(bin);
+        for(size_t t0 = 0; t0 < sum.nTypes; ++t0)
+            for(size_t t1 = t0; t1 < sum.nTypes; ++t1)
+                out << " " << g(t0, t1, bin);
+        out << "\n";
+    }
+
+    // k is sampled up to the Nyquist limit of the bins
+    out << "\n\n# k S\n";
+    double maxK = M_PI / sum.binWidth;
+    for(int i = 1; i <= kValues; ++i) {
+        double k = maxK * i / kValues;
+        out << k << " " << structureFactor(k, maxRadius) << "\n";
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef __RADIAL_DISTRIBUTION_H__
+#define __RADIAL_DISTRIBUTION_H__
+
+#include <deque>
+#include <ostream>
+#include <vector>
+
+/*
+ * PairHistogram counts pairs of particles by distance for each unordered pair of types. It is filled during force
+ * computation, which already enumerates all pairs within the interaction range, so only pairs closer than the
+ * range of their types are counted. Bins beyond the range of a type pair stay empty.
+ *
+ * RadialDistribution averages the histograms of the last window samples into the radial distribution function
+ * g(r), which is normalized by an ideal gas of the same density in the whole universe (walls aren't corrected for).
+ * The structure factor S(k) is computed from the total g(r) by the 2D Fourier transform
+ * S(k) = 1 + rho * integral (g(r) - 1) * 2 pi r J0(k r) dr, truncated at the smallest interaction range.
+ */
+
+struct PairHistogram {
+    size_t nTypes = 0;
+    int bins = 0;
+    double binWidth = 1;
+    std::vector<double> counts; // Indexed by (nTypes * t0 + t1) * bins + bin with t0 <= t1
+    std::vector<double> typeCounts; // Particles of each type
+
+    void reset(size_t _nTypes, int _bins, double _binWidth);
+    void addPair(size_t t0, size_t t1, double distance);
+    PairHistogram & operator+=(const PairHistogram &rhs);
+    PairHistogram & operator-=(const PairHistogram &rhs);
+};
+
+class RadialDistribution {
+public:
+    void reset(size_t nTypes, double maxRange, double binWidth, size_t _window, double _area);
+    PairHistogram & beginSample(); // Returns an empty histogram to be filled
+    void endSample(); // Adds the filled histogram to the average
+
+    inline bool empty() const { return samples.empty(); }
+    inline int bins() const { return sum.bins; }
+    inline double binWidth() const { return sum.binWidth; }
+    double g(size_t t0, size_t t1, int bin) const;
+    double g(int bin) const; // Of all particles regardless of type
+    double structureFactor(double k, double maxRadius) const;
+
+    // Writes columns r, g, g_0_0, g_0_1... and after an empty line k, S for the given number of k values
+    void write(std::ostream &out, double maxRadius, int kValues = 200) const;
+
+private:
+    double expectedPairs(double typePairs, int bin) const;
+
+    std::deque<PairHistogram> samples;
+    PairHistogram sum;
+    size_t window = 1;
+    double area = 1;
+};
+
+#endif
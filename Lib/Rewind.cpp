@@ -0,0 +1,95 @@
+
+#include "Lib/Rewind.h"
+#include "Lib/Universe.h"
+#include <algorithm>
+
+static bool sameParticles(const std::vector<ParticleState> &a, const std::vector<ParticleState> &b) {
+    if(a.size() != b.size()) return false;
+    for(size_t i = 0; i < a.size(); ++i)
+        if(a[i].id != b[i].id || a[i].type != b[i].type || a[i].pos.x != b[i].pos.x || a[i].pos.y != b[i].pos.y
+                || a[i].v.x != b[i].v.x || a[i].v.y != b[i].v.y || a[i].phase != b[i].phase)
+            return false;
+    return true;
+}
+
+// Boxes, mode and sparse index, regardless of the particles in the boxes
+static bool sameLayout(const UniverseState &a, const UniverseState &b) {
+    if(a.cells.size() != b.cells.size() || a.sparse != b.sparse || a.appendedCells != b.appendedCells
+            || a.cellsX != b.cellsX || a.cellsY != b.cellsY || a.sizePerBlock != b.sizePerBlock)
+        return false;
+    for(size_t c = 0; c < a.cells.size(); ++c)
+        if(a.cells[c].x != b.cells[c].x || a.cells[c].y != b.cells[c].y) return false;
+    return true;
+}
+
+void RewindPoint::restore(UniverseState &state) const {
+    // The layout may be shared by points with different numbers of particles, so the size is counted
+    state.copyLayout(*layout);
+    state.size_ = 0;
+    for(size_t c = 0; c < state.cells.size(); ++c) {
+        if(particles[c]) state.cells[c].particles = *particles[c];
+        else state.cells[c].particles.clear();
+        state.size_ += state.cells[c].particles.size();
+    }
+}
+
+bool RewindPoint::matches(const UniverseState &state) const {
+    if(state.cells.size() != layout->cells.size()) return false;
+    for(size_t c = 0; c < state.cells.size(); ++c) {
+        const auto &cell = state.cells[c];
+        if(cell.x != layout->cells[c].x || cell.y != layout->cells[c].y) return false;
+        if(particles[c] ? ! sameParticles(*particles[c], cell.particles) : ! cell.particles.empty()) return false;
+    }
+    return true;
+}
+
+void RewindBuffer::reset(size_t _maxPoints, uint64_t _interval) {
+    maxPoints = _maxPoints;
+    interval = std::max(_interval, (uint64_t) 1);
+    while(points.size() > maxPoints)
+        points.pop_front();
+}
+
+void RewindBuffer::afterStep(const UniverseState &state, double time, uint64_t steps) {
+    if(maxPoints == 0 || steps % interval != 0) return;
+
+    // The layout is shared with the previous point while the boxes don't change
+    const RewindPoint *previous = points.empty() ? nullptr : & points.back();
+    RewindPoint point{ time, steps, nullptr, {} };
+    if(previous && sameLayout(*previous->layout, state)) point.layout = previous->layout;
+    else {
+        point.layout = std::make_shared<UniverseState>();
+        point.layout->copyLayout(state);
+    }
+    point.particles.resize(state.cells.size());
+
+    // Boxes usually keep their order between points, so a box is compared with the box of the same index
+    for(size_t c = 0; c < state.cells.size(); ++c) {
+        const auto &particles = state.cells[c].particles;
+        if(particles.empty()) continue;
+        if(previous && c < previous->particles.size() && previous->particles[c]
+                && previous->layout->cells[c].x == state.cells[c].x && previous->layout->cells[c].y == state.cells[c].y
+                && sameParticles(*previous->particles[c], particles))
+            point.particles[c] = previous->particles[c];
+        else
+            point.particles[c] = std::make_shared<const std::vector<ParticleState>>(particles);
+    }
+
+    if(points.size() >= maxPoints) points.pop_front();
+    points.push_back(std::move(point));
+}
+
+size_t RewindBuffer::sharedBoxes() const {
+    size_t shared = 0;
+    for(const auto &point: points)
+        for(const auto &particles: point.particles)
+            if(particles && particles.use_count() > 1) ++shared;
+    return shared;
+}
+
+size_t RewindBuffer::sharedLayouts() const {
+    size_t shared = 0;
+    for(const auto &point: points)
+        shared += point.layout.use_count() > 1;
+    return shared;
+}
@@ -0,0 +1,52 @@
+#ifndef __REWIND_H__
+#define __REWIND_H__
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+struct UniverseState;
+struct ParticleState;
+
+/*
+ * RewindBuffer keeps the last maxPoints states of a universe, recorded after every interval steps, so that the
+ * universe can be rewound e.g. after a mis-click. Points are copies deduplicated against the previous point, not
+ * copy-on-write views of the live state: recording compares every box of the live state with the same box of the
+ * previous point, which is an O(N) pass once per interval steps. A box whose particles haven't changed (e.g. empty
+ * boxes or particles frozen at rest) is shared with the previous point and costs no memory or copying. Boxes of
+ * moving particles are copied, so a point costs about as much memory as the particles of the universe.
+ * The box layout, including the sparse index (CellIndex, held by value in UniverseState), is copied when the boxes
+ * change and shared with the previous point while they don't.
+ */
+
+struct RewindPoint {
+    double time;
+    uint64_t steps;
+    std::shared_ptr<UniverseState> layout; // Particles are empty, may be shared with other points
+    std::vector<std::shared_ptr<const std::vector<ParticleState>>> particles; // Per box of layout, nullptr if empty
+
+    void restore(UniverseState &state) const;
+    bool matches(const UniverseState &state) const; // Same boxes and particles, e.g. nothing was edited since
+};
+
+class RewindBuffer {
+public:
+    // maxPoints 0 disables recording and drops the points
+    void reset(size_t maxPoints, uint64_t interval);
+    void afterStep(const UniverseState &state, double time, uint64_t steps); // Records every interval steps
+
+    inline size_t size() const { return points.size(); }
+    inline const RewindPoint & newest() const { return points.back(); }
+    inline const RewindPoint & oldest() const { return points.front(); }
+    inline void dropNewest() { points.pop_back(); }
+    size_t sharedBoxes() const; // Boxes of the points which are shared with another point
+    size_t sharedLayouts() const; // Points whose layout is shared with another point
+
+private:
+    size_t maxPoints = 0;
+    uint64_t interval = 1;
+    std::deque<RewindPoint> points;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <string>
 #include <algorithm>
 #include <cassert>
+#include <limits>
 
 Setup::Setup(std::string filePath) {
     size_t lastBackslash = filePath.rfind('/');
@@ -32,16 +33,81 @@ Setup::Setup(std::string filePath) {
 
             particleTypes.emplace_back(name, directoryPath + spriteLocation, mass, radius, exclusionConstant, dipoleMoment, range);
         }
+        if(key == "particleCharge") {
+            // particleCharge typeIndex charge, of the long-range force
+            size_t type;
+            double charge;
+            fin >> type >> charge;
+            assert(type < particleTypes.size());
+            particleTypes[type].setCharge(charge);
+        }
         if(key == "particle") {
             ParticleSetup p;
             fin >> p.pos.x >> p.pos.y >> p.v.x >> p.v.y >> p.type;
             particles.push_back(p);
         }
+        if(key == "latticeFill" || key == "randomFill" || key == "droplet" || key == "slab") {
+            // latticeFill type minX minY maxX maxY spacing temperature
+            // randomFill type minX minY maxX maxY density minDistance temperature
+            // droplet type x y radius spacing temperature
+            // slab type minY maxY spacing temperature, spanning the width of the universe
+            GeneratorSetup generator;
+            generator.kind = key == "randomFill" ? GeneratorKind::random : GeneratorKind::lattice;
+            fin >> generator.type;
+            if(key == "latticeFill" || key == "randomFill")
+                fin >> generator.minX >> generator.minY >> generator.maxX >> generator.maxY;
+            if(key == "droplet") fin >> generator.center.x >> generator.center.y >> generator.radius;
+            if(key == "slab") {
+                fin >> generator.minY >> generator.maxY;
+                generator.maxX = std::numeric_limits<double>::infinity(); // Clipped to the universe
+            }
+            if(key == "randomFill") fin >> generator.density;
+            fin >> generator.spacing >> generator.temperature;
+            assert(generator.spacing > 0);
+            generators.push_back(generator);
+        }
+        if(key == "generatorSeed") fin >> generatorSeed;
+        if(key == "importParticles" || key == "exportParticles") {
+            // importParticles|exportParticles path csv|binary, see ParticleIO.h
+            std::string path, format;
+            fin >> path >> format;
+            ParticleFileSetup file{ directoryPath + path, parseParticleFormat(format) };
+            if(key == "importParticles") particleImports.push_back(file);
+            else particleExport = file;
+        }
+        if(key == "thermostat" || key == "thermostatRegion") {
+            // thermostat langevin|berendsen temperature coupling [minX minY maxX maxY for thermostatRegion]
+            std::string type;
+            Thermostat thermostat;
+            fin >> type >> thermostat.temperature >> thermostat.coupling;
+            assert(type == "langevin" || type == "berendsen");
+            thermostat.type = type == "langevin" ? ThermostatType::langevin : ThermostatType::berendsen;
+            if(key == "thermostatRegion")
+                fin >> thermostat.minX >> thermostat.minY >> thermostat.maxX >> thermostat.maxY;
+            thermostats.push_back(thermostat);
+        }
         if(key == "sizeX") fin >> sizeX;
         if(key == "sizeY") fin >> sizeY;
         if(key == "gravity") fin >> gravity;
         if(key == "forceFactor") fin >> forceFactor;
         if(key == "dT") fin >> dT;
+        if(key == "frameTime") fin >> frameTime;
+        if(key == "maxTimestepLevel") fin >> maxTimestepLevel;
+        if(key == "cellsPerRange") fin >> cellsPerRange;
+        if(key == "observableBinSize") fin >> observableBinSize;
+        if(key == "phaseAnalysisInterval") fin >> phaseAnalysisInterval;
+        if(key == "radialDistribution") {
+            fin >> radialDistributionBinWidth >> radialDistributionPath;
+            radialDistributionPath = directoryPath + radialDistributionPath;
+        }
+        if(key == "rewind") fin >> rewindPoints >> rewindInterval;
+        if(key == "longRange") fin >> longRangeCoupling >> openingAngle >> longRangeSoftening;
+        if(key == "sleep") fin >> sleep.maxVelocity >> sleep.maxAcceleration >> sleep.steps;
+        if(key == "snapshotRing") fin >> snapshotRingName >> snapshotSlots >> snapshotCapacity >> snapshotInterval;
+        if(key == "inputRecording") {
+            fin >> inputRecordingPath;
+            inputRecordingPath = directoryPath + inputRecordingPath;
+        }
     }
 
     assert(particleTypes.size() > 0);
@@ -49,7 +115,41 @@ Setup::Setup(std::string filePath) {
 }
 
 
+UniverseConfig Setup::universeConfig() const {
+    UniverseConfig config{ sizeX, sizeY, forceFactor, gravity };
+    config.maxTimestepLevel = maxTimestepLevel;
+    config.cellsPerRange = cellsPerRange;
+    config.longRangeCoupling = longRangeCoupling;
+    config.openingAngle = openingAngle;
+    config.longRangeSoftening = longRangeSoftening;
+    return config;
+}
+
+void Setup::configureUniverse(Universe &universe) const {
+    universe.observe(observableBinSize);
+    PhaseAnalysisConfig phaseConfig;
+    phaseConfig.interval = phaseAnalysisInterval;
+    universe.analysePhases(phaseConfig);
+    universe.measureRadialDistribution(radialDistributionBinWidth);
+    universe.enableRewind(rewindPoints, rewindInterval);
+    universe.enableSleeping(sleep);
+}
+
 void Setup::addParticlesToUniverse(Universe &universe) const {
     for(const ParticleSetup &p: particles)
         universe.addParticle(p.type, ParticleState(p.pos, p.v));
+
+    std::vector<ParticleState> generated;
+    for(size_t i = 0; i < generators.size(); ++i) {
+        const GeneratorSetup &generator = generators[i];
+        generated.clear();
+        const ParticleType &type = universe.getParticleTypes()[generator.type];
+        generateParticles(generator, universe.getConfig(), type.getMass(), generatorSeed, i, generated);
+        for(ParticleState &p: generated)
+            p.type = &type;
+        universe.addParticles(generated);
+    }
+
+    for(const ParticleFileSetup &file: particleImports)
+        importParticles(universe, file.path, file.format);
 }
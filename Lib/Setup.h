@@ -5,27 +5,57 @@
 #include <vector>
 #include "Lib/Particle.h"
 #include "Lib/Universe.h"
+#include "Lib/Thermostat.h"
+#include "Lib/Generators.h"
+#include "Lib/ParticleIO.h"
 
 struct ParticleSetup {
     int type;
     Vector2D pos, v;
 };
 
+struct ParticleFileSetup {
+    std::string path;
+    ParticleFormat format;
+};
+
 struct Setup {
     std::string directoryPath;
     std::string recordingPrefix;
     std::string displayedCaption;
     std::vector<ParticleType> particleTypes;
     std::vector<ParticleSetup> particles;
+    std::vector<GeneratorSetup> generators; // Run after the particles are added, in file order
+    uint32_t generatorSeed = 0;
+    std::vector<ParticleFileSetup> particleImports; // Added after the generators, in file order
+    ParticleFileSetup particleExport{ "", ParticleFormat::csv }; // Particles are written here on exit
     int sizeX = 0, sizeY = 0;
     double gravity = 0;
     double forceFactor = 1e-2;
     double dT = 0.5;
+    double frameTime = 1. / 60;
+    int maxTimestepLevel = 0;
+    int cellsPerRange = 1;
+    double observableBinSize = 0;
+    int phaseAnalysisInterval = 0;
+    double radialDistributionBinWidth = 0;
+    std::string radialDistributionPath; // g(r) and S(k) are written here on exit
+    std::string inputRecordingPath; // User input of each frame is recorded here, see InputRecorder
+    std::string snapshotRingName; // Shared memory snapshots for other processes, see SnapshotWriter
+    int rewindPoints = 0, rewindInterval = 1; // States kept for rewinding with keys b and r, see RewindBuffer
+    int snapshotSlots = 4, snapshotCapacity = 0, snapshotInterval = 1;
+    double longRangeCoupling = 0, openingAngle = 0.5, longRangeSoftening = 4; // See LongRange.h
+    SleepConfig sleep; // Quiet boxes are frozen, see Universe::enableSleeping()
+    std::vector<Thermostat> thermostats;
 
     Setup(std::string filePath);
     inline Setup() {
     }
 
+    UniverseConfig universeConfig() const;
+    // Observation, phase analysis, g(r), rewinding and sleeping as set in the file. Thermostats need a seed and are
+    // set by the program.
+    void configureUniverse(Universe &universe) const;
     void addParticlesToUniverse(Universe &universe) const;
 };
 
@@ -0,0 +1,165 @@
+#include "Lib/SnapshotRing.h"
+#include <stdexcept>
+#include <algorithm>
+
+#ifndef __EMSCRIPTEN__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Shared memory layout: the ring header, then nSlots slots, each a slot header followed by nCapacity particles.
+// Atomics are lock-free, so they work across processes.
+
+static const uint32_t magic = 0x50545352; // "PTSR"
+static const uint32_t version = 1;
+static const size_t headerSize = 64;
+
+struct SnapshotRingHeader {
+    std::atomic<uint32_t> magic; // Written last
+    uint32_t version, slots, capacity;
+    uint64_t slotSize;
+    std::atomic<uint64_t> published;
+};
+
+struct SnapshotSlotHeader {
+    std::atomic<uint64_t> sequence; // Odd while the slot is being written
+    uint64_t generation, step;
+    double time;
+    uint64_t count, total;
+};
+
+static_assert(sizeof(SnapshotRingHeader) <= headerSize && sizeof(SnapshotSlotHeader) <= headerSize,
+        "Headers must fit into their space");
+static_assert(sizeof(SnapshotParticle) == 40, "SnapshotParticle must have the same layout in all processes");
+
+SnapshotRing::~SnapshotRing() {
+#ifndef __EMSCRIPTEN__
+    if(memory) munmap(memory, size);
+#endif
+}
+
+uint64_t SnapshotRing::published() const {
+    return reinterpret_cast<const SnapshotRingHeader *>(memory)->published.load(std::memory_order_acquire);
+}
+
+SnapshotSlotHeader * SnapshotRing::slot(uint64_t generation) const {
+    return reinterpret_cast<SnapshotSlotHeader *>(memory + headerSize + (generation - 1) % nSlots * slotSize);
+}
+
+SnapshotParticle * SnapshotRing::slotParticles(uint64_t generation) const {
+    return reinterpret_cast<SnapshotParticle *>(reinterpret_cast<char *>(slot(generation)) + headerSize);
+}
+
+
+SnapshotWriter::SnapshotWriter(const std::string &_name, uint32_t _slots, uint32_t _capacity) {
+#ifdef __EMSCRIPTEN__
+    throw std::runtime_error("SnapshotWriter: shared memory isn't available");
+#else
+    name = _name;
+    nSlots = std::max(_slots, (uint32_t) 1);
+    nCapacity = _capacity;
+    slotSize = (headerSize + nCapacity * sizeof(SnapshotParticle) + 63) / 64 * 64;
+    size = headerSize + nSlots * slotSize;
+
+    // A new object is zero filled, which is an empty ring with even sequence numbers
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0 || ftruncate(fd, size) != 0)
+        throw std::runtime_error("SnapshotWriter: can't create shared memory " + name);
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED)
+        throw std::runtime_error("SnapshotWriter: can't map shared memory " + name);
+    memory = static_cast<char *>(mem);
+
+    SnapshotRingHeader *header = reinterpret_cast<SnapshotRingHeader *>(memory);
+    header->slots = nSlots;
+    header->capacity = nCapacity;
+    header->slotSize = slotSize;
+    header->version = version;
+    header->published.store(0, std::memory_order_relaxed);
+    header->magic.store(magic, std::memory_order_release);
+#endif
+}
+
+SnapshotWriter::~SnapshotWriter() {
+#ifndef __EMSCRIPTEN__
+    shm_unlink(name.c_str());
+#endif
+}
+
+SnapshotParticle * SnapshotWriter::begin(double time, uint64_t step) {
+    uint64_t generation = published() + 1;
+    SnapshotSlotHeader *s = slot(generation);
+    uint64_t sequence = s->sequence.load(std::memory_order_relaxed);
+    s->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // Readers see the odd sequence before any of the writes
+    s->generation = generation;
+    s->step = step;
+    s->time = time;
+    return slotParticles(generation);
+}
+
+void SnapshotWriter::commit(size_t count, size_t total) {
+    SnapshotRingHeader *header = reinterpret_cast<SnapshotRingHeader *>(memory);
+    uint64_t generation = header->published.load(std::memory_order_relaxed) + 1;
+    SnapshotSlotHeader *s = slot(generation);
+    s->count = std::min(count, (size_t) nCapacity);
+    s->total = total;
+    s->sequence.store(s->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    header->published.store(generation, std::memory_order_release);
+}
+
+
+SnapshotReader::SnapshotReader(const std::string &_name) {
+#ifdef __EMSCRIPTEN__
+    throw std::runtime_error("SnapshotReader: shared memory isn't available");
+#else
+    name = _name;
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    struct stat info;
+    if(fd < 0 || fstat(fd, & info) != 0 || (size_t) info.st_size < headerSize) {
+        if(fd >= 0) close(fd);
+        throw std::runtime_error("SnapshotReader: can't open shared memory " + name);
+    }
+    size = info.st_size;
+    void *mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED)
+        throw std::runtime_error("SnapshotReader: can't map shared memory " + name);
+    memory = static_cast<char *>(mem);
+
+    const SnapshotRingHeader *header = reinterpret_cast<const SnapshotRingHeader *>(memory);
+    if(header->magic.load(std::memory_order_acquire) != magic
+            || header->version != version || headerSize + header->slots * header->slotSize > size)
+        throw std::runtime_error("SnapshotReader: " + name + " isn't a snapshot ring of this version");
+    nSlots = header->slots;
+    nCapacity = header->capacity;
+    slotSize = header->slotSize;
+#endif
+}
+
+SnapshotReader::~SnapshotReader() {
+}
+
+bool SnapshotReader::read(uint64_t generation, SnapshotView &view) const {
+    if(generation == 0 || generation > published()) return false;
+    const SnapshotSlotHeader *s = slot(generation);
+    view.sequence = s->sequence.load(std::memory_order_acquire);
+    if(view.sequence % 2 != 0) return false;
+
+    view.generation = s->generation;
+    view.step = s->step;
+    view.time = s->time;
+    view.count = std::min(s->count, (uint64_t) nCapacity);
+    view.total = s->total;
+    view.particles = slotParticles(generation);
+    return view.generation == generation && stillValid(view);
+}
+
+bool SnapshotReader::stillValid(const SnapshotView &view) const {
+    std::atomic_thread_fence(std::memory_order_acquire); // The reads of the slot happen before the check
+    return slot(view.generation)->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
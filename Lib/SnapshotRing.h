@@ -0,0 +1,91 @@
+#ifndef __SNAPSHOT_RING_H__
+#define __SNAPSHOT_RING_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+ * SnapshotWriter publishes snapshots of the particles into a ring of slots in POSIX shared memory, so that other
+ * processes can analyse a running simulation. SnapshotReader maps the ring read only and reads the snapshots in
+ * place. The writer never waits for readers: each slot is guarded by a sequence lock, whose sequence number is odd
+ * while the slot is being written. A reader checks the sequence number before and after reading a slot and
+ * discards the results if the slot was overwritten meanwhile, which only happens if it falls behind by the number
+ * of slots.
+ *
+ * Usage of the reader, without copying the particles:
+ *
+ * SnapshotView view;
+ * if(reader.read(reader.published(), view)) {
+ *     ... use view.particles[0 .. view.count - 1] ...
+ *     if(! reader.stillValid(view)) ... discard the results ...
+ * }
+ *
+ * Shared memory isn't available in web builds, where the SnapshotWriter and SnapshotReader constructors throw.
+ */
+
+struct SnapshotParticle {
+    uint32_t id;
+    uint8_t type; // Index of the particle type
+    uint8_t phase; // Phase from Particle.h
+    uint16_t unused;
+    double x, y, vx, vy;
+};
+
+struct SnapshotView {
+    uint64_t generation = 0; // Snapshots are numbered 1, 2, ... in the order of publishing
+    uint64_t step = 0; // Universe::getSteps()
+    double time = 0;
+    size_t count = 0; // Number of particles in the snapshot
+    size_t total = 0; // Number of particles in the universe, larger than count if they didn't fit into the slot
+    const SnapshotParticle *particles = nullptr;
+    uint64_t sequence = 0; // Sequence number of the slot at the beginning of the read
+};
+
+struct SnapshotRingHeader;
+struct SnapshotSlotHeader;
+
+class SnapshotRing {
+public:
+    SnapshotRing(const SnapshotRing &) = delete;
+    SnapshotRing & operator=(const SnapshotRing &) = delete;
+
+    uint64_t published() const; // Generation of the newest complete snapshot, 0 if there is none
+    inline uint32_t slots() const { return nSlots; }
+    inline uint32_t capacity() const { return nCapacity; } // Maximum number of particles per snapshot
+
+protected:
+    SnapshotRing() {}
+    ~SnapshotRing();
+    SnapshotSlotHeader * slot(uint64_t generation) const;
+    SnapshotParticle * slotParticles(uint64_t generation) const;
+
+    std::string name;
+    char *memory = nullptr;
+    size_t size = 0;
+    uint32_t nSlots = 0, nCapacity = 0;
+    size_t slotSize = 0;
+};
+
+class SnapshotWriter: public SnapshotRing {
+public:
+    // Creates (or replaces) the shared memory object called name, e.g. "/PhaseTransition". Throws on failure.
+    SnapshotWriter(const std::string &_name, uint32_t _slots, uint32_t _capacity);
+    ~SnapshotWriter(); // Removes the name, readers keep their mapping
+
+    // Writing a snapshot: fill at most capacity() particles returned by begin(), then call commit()
+    SnapshotParticle * begin(double time, uint64_t step);
+    void commit(size_t count, size_t total);
+};
+
+class SnapshotReader: public SnapshotRing {
+public:
+    SnapshotReader(const std::string &_name); // Throws if the ring doesn't exist
+    ~SnapshotReader();
+
+    // Points view to the snapshot of the given generation. False if it isn't in the ring or is being written.
+    bool read(uint64_t generation, SnapshotView &view) const;
+    bool stillValid(const SnapshotView &view) const; // False if the slot was overwritten after read()
+};
+
+#endif
@@ -0,0 +1,63 @@
+
+#include "Lib/StepScheduler.h"
+#include <algorithm>
+
+static const double smoothing = 0.1; // Weight of the newest measurement in moving averages
+
+static double secondsBetween(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+StepScheduler::StepScheduler(const StepSchedulerConfig &_config):
+        config(_config), substeps(_config.minSubsteps) {
+}
+
+void StepScheduler::beginFrame() {
+    frameBegin = Clock::now();
+}
+
+void StepScheduler::advanceFrame(Universe &universe) {
+    auto simulationBegin = Clock::now();
+    double simulatedTime = 0;
+    for(int i = 0; i < substeps; ++i) {
+        double dT = substepDT(universe);
+        universe.advance(dT);
+        simulatedTime += dT;
+    }
+    auto simulationEnd = Clock::now();
+
+    double newStepCost = secondsBetween(simulationBegin, simulationEnd) / substeps;
+    double newOverhead = std::max(0., secondsBetween(frameBegin, simulationBegin));
+    if(stepCost == 0) {
+        stepCost = newStepCost;
+        frameOverhead = newOverhead;
+    } else {
+        stepCost = (1 - smoothing) * stepCost + smoothing * newStepCost;
+        frameOverhead = (1 - smoothing) * frameOverhead + smoothing * newOverhead;
+    }
+
+    if(hasLastFrame) {
+        double wallTime = secondsBetween(lastFrameBegin, frameBegin);
+        double newSpeed = wallTime > 0 ? simulatedTime / wallTime : 0;
+        simulationSpeed = (1 - smoothing) * simulationSpeed + smoothing * newSpeed;
+    }
+    hasLastFrame = true;
+    lastFrameBegin = frameBegin;
+
+    double budget = config.frameTime - frameOverhead;
+    int fitting = stepCost > 0 ? (int) (budget / stepCost) : config.maxSubsteps;
+    substeps = std::max(config.minSubsteps, std::min(config.maxSubsteps, fitting));
+}
+
+double StepScheduler::substepDT(const Universe &universe) const {
+    double maxVelocity = universe.maxVelocity();
+    if(maxVelocity <= 0) return config.maxSubstepDT;
+
+    double minRadius = universe.getParticleTypes().front().getRadius();
+    for(const auto &type: universe.getParticleTypes())
+        minRadius = std::min(minRadius, type.getRadius());
+
+    // With block timesteps, the fastest particles are integrated with dT / 2^maxTimestepLevel
+    double guard = config.stabilityFactor * minRadius / maxVelocity * (1 << universe.getConfig().maxTimestepLevel);
+    return std::min(config.maxSubstepDT, guard);
+}
@@ -0,0 +1,45 @@
+#ifndef __STEP_SCHEDULER_H__
+#define __STEP_SCHEDULER_H__
+
+#include "Lib/Universe.h"
+#include <chrono>
+
+/*
+ * StepScheduler decides how many Universe::advance() substeps are run per displayed frame. It measures the
+ * wall-clock cost of a substep and of everything else happening in a frame (drawing, event handling), and picks
+ * the number of substeps that fits into the target frame time. beginFrame() marks the start of a frame, so that
+ * idle time between frames (e.g. waiting for the browser's next animation frame) isn't counted as frame overhead.
+ *
+ * The size of a substep is capped by maxSubstepDT and by a stability guard: the fastest particle may move at most
+ * stabilityFactor * (smallest particle radius) during one substep.
+ */
+
+struct StepSchedulerConfig {
+    double frameTime = 1. / 60; // Target wall-clock time of a frame in seconds
+    double maxSubstepDT = 0.1;
+    double stabilityFactor = 0.1;
+    int minSubsteps = 1, maxSubsteps = 100;
+};
+
+class StepScheduler {
+public:
+    StepScheduler(const StepSchedulerConfig &_config);
+    void beginFrame();
+    void advanceFrame(Universe &universe);
+    double substepDT(const Universe &universe) const;
+
+    inline int getSubsteps() const { return substeps; }
+    inline double getSimulationSpeed() const { return simulationSpeed; } // Simulated time per wall-clock second
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    StepSchedulerConfig config;
+    int substeps;
+    double stepCost = 0, frameOverhead = 0; // Exponential moving averages in seconds
+    double simulationSpeed = 0;
+    bool hasLastFrame = false;
+    Clock::time_point frameBegin, lastFrameBegin;
+};
+
+#endif
@@ -0,0 +1,391 @@
+#include "Lib/Streaming.h"
+#include "Lib/InputRecording.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+
+#ifndef __EMSCRIPTEN__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+static void putVarint(std::vector<char> &msg, uint64_t x) {
+    while(x >= 0x80) {
+        msg.push_back((char) (x | 0x80));
+        x >>= 7;
+    }
+    msg.push_back((char) x);
+}
+
+static void putSigned(std::vector<char> &msg, int64_t x) {
+    putVarint(msg, ((uint64_t) x << 1) ^ (uint64_t) (x >> 63)); // Zigzag
+}
+
+template<typename T>
+static void putRaw(std::vector<char> &msg, T x) {
+    const char *bytes = reinterpret_cast<const char *>(& x);
+    msg.insert(msg.end(), bytes, bytes + sizeof(T));
+}
+
+// Reads values from a message, any read past its end makes it invalid
+struct MessageReader {
+    const std::vector<char> &msg;
+    size_t pos = 0;
+    bool valid = true;
+
+    MessageReader(const std::vector<char> &_msg): msg(_msg) {}
+
+    uint64_t varint() {
+        uint64_t x = 0;
+        for(int shift = 0; shift < 64; shift += 7) {
+            if(pos >= msg.size()) break;
+            uint8_t byte = msg[pos++];
+            x |= (uint64_t) (byte & 0x7f) << shift;
+            if(! (byte & 0x80)) return x;
+        }
+        valid = false;
+        return 0;
+    }
+
+    int64_t signedVarint() {
+        uint64_t x = varint();
+        return (int64_t) (x >> 1) ^ -(int64_t) (x & 1);
+    }
+
+    template<typename T>
+    T raw() {
+        T x{};
+        if(pos + sizeof(T) > msg.size()) {
+            valid = false;
+            return x;
+        }
+        std::memcpy(& x, msg.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return x;
+    }
+};
+
+static int32_t quantise(double x) {
+    return (int32_t) std::lround(x * positionScale);
+}
+
+uint64_t streamTimestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void StreamHeader::encode(std::vector<char> &msg) const {
+    msg.clear();
+    putRaw(msg, sizeX);
+    putRaw(msg, sizeY);
+    putVarint(msg, radii.size());
+    for(double radius: radii)
+        putRaw(msg, radius);
+}
+
+bool StreamHeader::decode(const std::vector<char> &msg) {
+    MessageReader in(msg);
+    sizeX = in.raw<double>();
+    sizeY = in.raw<double>();
+    radii.resize(std::min(in.varint(), (uint64_t) 256));
+    for(double &radius: radii)
+        radius = in.raw<double>();
+    return in.valid && in.pos == msg.size();
+}
+
+
+void DeltaEncoder::encode(Universe &universe, uint64_t timestamp, std::vector<char> &msg) {
+    ++frame;
+    added.clear();
+    moved.clear();
+    removed.clear();
+    size_t nAdded = 0, nCells = 0;
+
+    // Moved particles are grouped by box. The count of a box is only known after its particles, so each box is
+    // encoded into cellBuffer first.
+    size_t nMoved = 0;
+    uint32_t previousId = 0;
+    const UniverseCell *cell = nullptr;
+    auto flushCell = [&]() {
+        if(nMoved == 0) return;
+        putVarint(moved, cell->x);
+        putVarint(moved, cell->y);
+        putVarint(moved, nMoved);
+        moved.insert(moved.end(), cellBuffer.begin(), cellBuffer.end());
+        ++nCells;
+    };
+
+    for(auto it = universe.begin(); it != universe.end(); ++it) {
+        if(& *it.itC != cell) {
+            flushCell();
+            cell = & *it.itC;
+            cellBuffer.clear();
+            nMoved = 0;
+            previousId = 0;
+        }
+
+        int32_t x = quantise(it->pos.x), y = quantise(it->pos.y);
+        auto found = sent.find(it->id);
+        if(found == sent.end()) {
+            sent[it->id] = { x, y, frame };
+            putVarint(added, it->id);
+            putVarint(added, it->type - universe.getParticleTypes().data());
+            putSigned(added, x);
+            putSigned(added, y);
+            ++nAdded;
+            continue;
+        }
+
+        Sent &s = found->second;
+        s.frame = frame;
+        if(s.x == x && s.y == y) continue;
+        putSigned(cellBuffer, (int64_t) it->id - previousId);
+        putSigned(cellBuffer, x - s.x);
+        putSigned(cellBuffer, y - s.y);
+        previousId = it->id;
+        s.x = x;
+        s.y = y;
+        ++nMoved;
+    }
+    flushCell();
+
+    msg.clear();
+    putVarint(msg, frame);
+    putRaw(msg, timestamp);
+    putVarint(msg, nAdded);
+    msg.insert(msg.end(), added.begin(), added.end());
+
+    size_t nRemoved = 0;
+    for(auto it = sent.begin(); it != sent.end();) {
+        if(it->second.frame == frame) {
+            ++it;
+            continue;
+        }
+        putVarint(removed, it->first);
+        ++nRemoved;
+        it = sent.erase(it);
+    }
+    putVarint(msg, nRemoved);
+    msg.insert(msg.end(), removed.begin(), removed.end());
+
+    putVarint(msg, nCells);
+    msg.insert(msg.end(), moved.begin(), moved.end());
+}
+
+
+bool DeltaDecoder::decode(const std::vector<char> &msg) {
+    MessageReader in(msg);
+    frame = in.varint();
+    timestamp = in.raw<uint64_t>();
+
+    for(uint64_t n = in.varint(); n > 0 && in.valid; --n) {
+        uint32_t id = in.varint();
+        StreamParticle &p = particles[id];
+        p.type = in.varint();
+        p.x = in.signedVarint();
+        p.y = in.signedVarint();
+    }
+    for(uint64_t n = in.varint(); n > 0 && in.valid; --n)
+        particles.erase(in.varint());
+    for(uint64_t cells = in.varint(); cells > 0 && in.valid; --cells) {
+        in.varint(); // Box coordinates aren't needed for drawing
+        in.varint();
+        int64_t id = 0;
+        for(uint64_t n = in.varint(); n > 0 && in.valid; --n) {
+            id += in.signedVarint();
+            auto it = particles.find(id);
+            int32_t dx = in.signedVarint(), dy = in.signedVarint();
+            if(it == particles.end()) return false;
+            it->second.x += dx;
+            it->second.y += dy;
+        }
+    }
+    return in.valid && in.pos == msg.size();
+}
+
+#ifndef __EMSCRIPTEN__
+
+static const std::string unixPrefix = "unix:";
+
+static bool isUnixAddress(const std::string &address) {
+    return address.compare(0, unixPrefix.size(), unixPrefix) == 0;
+}
+
+static sockaddr_un unixAddress(const std::string &address) {
+    sockaddr_un result{};
+    result.sun_family = AF_UNIX;
+    std::string path = address.substr(unixPrefix.size());
+    if(path.size() >= sizeof(result.sun_path)) throw std::runtime_error("Stream: too long socket path " + path);
+    std::strcpy(result.sun_path, path.c_str());
+    return result;
+}
+
+static sockaddr_in tcpAddress(const std::string &address) {
+    size_t colon = address.rfind(':');
+    if(colon == std::string::npos) throw std::runtime_error("Stream: expected host:port instead of " + address);
+    sockaddr_in result{};
+    result.sin_family = AF_INET;
+    result.sin_addr.s_addr = inet_addr(address.substr(0, colon).c_str());
+    result.sin_port = htons(std::stoi(address.substr(colon + 1)));
+    return result;
+}
+
+StreamConnection::StreamConnection(int _socket): socket(_socket) {
+    int yes = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, & yes, sizeof(yes)); // Fails harmlessly on Unix sockets
+}
+
+StreamConnection::~StreamConnection() {
+    close(socket);
+}
+
+std::unique_ptr<StreamConnection> StreamConnection::connect(const std::string &address) {
+    int s;
+    int result;
+    if(isUnixAddress(address)) {
+        sockaddr_un un = unixAddress(address);
+        s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        result = ::connect(s, (sockaddr *) & un, sizeof(un));
+    } else {
+        sockaddr_in in = tcpAddress(address);
+        s = ::socket(AF_INET, SOCK_STREAM, 0);
+        result = ::connect(s, (sockaddr *) & in, sizeof(in));
+    }
+    if(result != 0) {
+        close(s);
+        throw std::runtime_error("Stream: can't connect to " + address);
+    }
+    return std::unique_ptr<StreamConnection>(new StreamConnection(s));
+}
+
+static bool sendAll(int socket, const char *p, size_t left, int flags) {
+    while(left > 0) {
+        ssize_t n = ::send(socket, p, left, flags | MSG_NOSIGNAL);
+        if(n <= 0) return false;
+        p += n;
+        left -= n;
+    }
+    return true;
+}
+
+void StreamConnection::send(const std::vector<char> &msg) {
+    if(closed) return;
+    // The length prefix is sent with MSG_MORE rather than copied in front of the message
+    uint32_t size = msg.size();
+    if(! sendAll(socket, (const char *) & size, sizeof(size), MSG_MORE)
+            || ! sendAll(socket, msg.data(), msg.size(), 0)) {
+        closed = true;
+        return;
+    }
+    bytesSent += sizeof(size) + msg.size();
+}
+
+bool StreamConnection::receive(std::vector<char> &msg, bool wait) {
+    while(true) {
+        // Messages are taken by advancing incomingOffset, the buffer is only compacted before more bytes are read
+        uint32_t size;
+        size_t available = incoming.size() - incomingOffset;
+        if(available >= sizeof(size)) {
+            const char *begin = incoming.data() + incomingOffset;
+            std::memcpy(& size, begin, sizeof(size));
+            if(available >= sizeof(size) + size) {
+                msg.assign(begin + sizeof(size), begin + sizeof(size) + size);
+                incomingOffset += sizeof(size) + size;
+                return true;
+            }
+        }
+        if(closed) return false;
+
+        char buffer[1 << 16];
+        ssize_t n = recv(socket, buffer, sizeof(buffer), wait ? 0 : MSG_DONTWAIT);
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && ! wait) return false;
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) {
+            closed = true;
+            return false;
+        }
+        incoming.erase(incoming.begin(), incoming.begin() + incomingOffset);
+        incomingOffset = 0;
+        incoming.insert(incoming.end(), buffer, buffer + n);
+    }
+}
+
+StreamListener::StreamListener(const std::string &_address): address(_address) {
+    int result;
+    if(isUnixAddress(address)) {
+        sockaddr_un un = unixAddress(address);
+        unlink(un.sun_path);
+        socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        result = bind(socket, (sockaddr *) & un, sizeof(un));
+    } else {
+        sockaddr_in in = tcpAddress(address);
+        socket = ::socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, & yes, sizeof(yes));
+        result = bind(socket, (sockaddr *) & in, sizeof(in));
+    }
+    if(result != 0 || listen(socket, 1) != 0) {
+        close(socket);
+        throw std::runtime_error("Stream: can't listen on " + address);
+    }
+}
+
+StreamListener::~StreamListener() {
+    close(socket);
+    if(isUnixAddress(address))
+        unlink(address.substr(unixPrefix.size()).c_str());
+}
+
+std::unique_ptr<StreamConnection> StreamListener::accept() {
+    int s = ::accept(socket, nullptr, nullptr);
+    if(s < 0) throw std::runtime_error("Stream: accept failed on " + address);
+    return std::unique_ptr<StreamConnection>(new StreamConnection(s));
+}
+
+
+StreamServer::StreamServer(Universe &_universe, std::unique_ptr<StreamConnection> _connection):
+        universe(_universe), connection(std::move(_connection)) {
+    StreamHeader header;
+    header.sizeX = universe.getConfig().sizeX;
+    header.sizeY = universe.getConfig().sizeY;
+    for(const ParticleType &type: universe.getParticleTypes())
+        header.radii.push_back(type.getRadius());
+    header.encode(msg);
+    connection->send(msg);
+}
+
+void StreamServer::receiveInput(CallbackHandler &handler) {
+    int rewindPoints = 0;
+    while(connection->receive(msg, false)) {
+        MessageReader in(msg);
+        uint64_t timestamp = in.raw<uint64_t>();
+        if(! in.valid || msg.size() != sizeof(timestamp) + InputFrame::encodedSize) continue;
+
+        InputFrame frame;
+        frame.decode(msg.data() + sizeof(timestamp));
+        frame.applyTo(handler);
+        const int all = std::numeric_limits<int>::max();
+        rewindPoints = frame.rewindPoints >= all - rewindPoints ? all : rewindPoints + frame.rewindPoints;
+
+        latency = (streamTimestamp() - timestamp) * 1e-9;
+        latencySum += latency;
+        ++latencySamples;
+    }
+    handler.rewindPoints = rewindPoints;
+}
+
+void StreamServer::sendFrame() {
+    encoder.encode(universe, streamTimestamp(), msg);
+    connection->send(msg);
+}
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef __STREAMING_H__
+#define __STREAMING_H__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include "Lib/Universe.h"
+#include "Lib/Display.h"
+
+/*
+ * A universe running on a headless server is streamed to thin viewers, which draw the particles themselves and send
+ * the user's input back. All messages are length prefixed. Integers are varints (7 bits per byte, signed ones
+ * zigzag encoded), other values are in host byte order.
+ *
+ * Server to viewer, first message: double sizeX, sizeY, varint number of types, double radius per type.
+ * Server to viewer, one message per frame:
+ *     varint frame, uint64 timestamp (nanoseconds of the server's steady clock)
+ *     varint added, per particle: varint id, varint type, signed varint x, signed varint y
+ *     varint removed, per particle: varint id
+ *     varint cells, per box with moved particles: varint box x, varint box y, varint moved,
+ *         per particle: signed varint id - previous id in the box, signed varint dx, signed varint dy
+ * Positions are quantised to 1 / positionScale pixels. A particle counts as moved if its quantised position
+ * changed, and x, y, dx and dy are relative to the position the viewer already has, so errors don't accumulate.
+ * Boxes are those of the server's universe, and ids within a box are usually close, so a moved particle takes about
+ * 4 bytes.
+ *
+ * Viewer to server, after each received frame: uint64 timestamp of the newest received frame, which gives the
+ * end-to-end latency of frame and input, and an InputFrame record (see InputRecording.h).
+ */
+
+static const int positionScale = 16;
+
+struct StreamParticle {
+    int type;
+    int32_t x, y; // Quantised
+
+    inline Vector2D pos() const { return Vector2D((double) x / positionScale, (double) y / positionScale); }
+};
+
+struct StreamHeader {
+    double sizeX = 0, sizeY = 0;
+    std::vector<double> radii; // Per particle type
+
+    void encode(std::vector<char> &msg) const;
+    bool decode(const std::vector<char> &msg);
+};
+
+class DeltaEncoder {
+public:
+    // Encodes the changes of the universe since the last frame. The first frame contains all particles.
+    void encode(Universe &universe, uint64_t timestamp, std::vector<char> &msg);
+    inline uint32_t getFrame() const { return frame; }
+
+private:
+    struct Sent { int32_t x, y; uint32_t frame; };
+    std::unordered_map<uint32_t, Sent> sent; // By id
+    uint32_t frame = 0;
+    std::vector<char> added, moved, cellBuffer, removed; // Kept across frames, so encoding doesn't allocate
+};
+
+class DeltaDecoder {
+public:
+    bool decode(const std::vector<char> &msg); // False if the message is malformed
+    inline const std::unordered_map<uint32_t, StreamParticle> & getParticles() const { return particles; }
+    inline uint32_t getFrame() const { return frame; }
+    inline uint64_t getTimestamp() const { return timestamp; }
+
+private:
+    std::unordered_map<uint32_t, StreamParticle> particles; // By id
+    uint32_t frame = 0;
+    uint64_t timestamp = 0;
+};
+
+uint64_t streamTimestamp(); // Nanoseconds of the steady clock
+
+#ifndef __EMSCRIPTEN__
+
+/*
+ * StreamConnection sends and receives length prefixed messages over a TCP ("host:port") or Unix domain socket
+ * ("unix:path"). Sending blocks until the message is handed to the kernel.
+ */
+
+class StreamConnection {
+public:
+    StreamConnection(int _socket);
+    ~StreamConnection();
+    StreamConnection(const StreamConnection &) = delete;
+    StreamConnection & operator=(const StreamConnection &) = delete;
+
+    static std::unique_ptr<StreamConnection> connect(const std::string &address); // Throws on failure
+
+    void send(const std::vector<char> &msg);
+    // Takes the next complete message. Without wait, returns false if none has arrived yet.
+    // Also returns false if the peer has closed the connection, see isClosed().
+    bool receive(std::vector<char> &msg, bool wait);
+    inline bool isClosed() const { return closed; }
+    inline uint64_t getBytesSent() const { return bytesSent; }
+
+private:
+    int socket;
+    bool closed = false;
+    std::vector<char> incoming;
+    size_t incomingOffset = 0; // Start of the first message not taken yet, the bytes before are dropped on recv
+    uint64_t bytesSent = 0;
+};
+
+class StreamListener {
+public:
+    StreamListener(const std::string &_address); // Throws on failure
+    ~StreamListener();
+    std::unique_ptr<StreamConnection> accept(); // Blocks until a viewer connects
+
+private:
+    std::string address;
+    int socket;
+};
+
+/*
+ * StreamServer serves a universe to a connected viewer: sends the header on construction, then a frame per
+ * sendFrame(), and applies the input the viewer sent back.
+ */
+
+class StreamServer {
+public:
+    StreamServer(Universe &_universe, std::unique_ptr<StreamConnection> _connection);
+    // Sets handler to the newest input received since the last call, without waiting. Rewinds are summed up.
+    void receiveInput(CallbackHandler &handler);
+    void sendFrame();
+
+    inline bool isConnected() const { return ! connection->isClosed(); }
+    inline uint32_t getFrames() const { return encoder.getFrame(); }
+    inline uint64_t getBytes() const { return connection->getBytesSent(); }
+    inline double getLatency() const { return latency; } // Seconds from sending a frame to receiving its input
+    inline double getMeanLatency() const { return latencySamples ? latencySum / latencySamples : 0; }
+
+private:
+    Universe &universe;
+    std::unique_ptr<StreamConnection> connection;
+    DeltaEncoder encoder;
+    std::vector<char> msg;
+    double latency = 0, latencySum = 0;
+    uint64_t latencySamples = 0;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+
+#include "Lib/Thermostat.h"
+#include "Lib/Universe.h"
+#include "Lib/Parallel.h"
+#include "Lib/Philox.h"
+#include <algorithm>
+
+static int findThermostat(const std::vector<Thermostat> &thermostats, const Vector2D &pos) {
+    for(size_t i = 0; i < thermostats.size(); ++i)
+        if(thermostats[i].contains(pos.x, pos.y)) return i;
+    return -1;
+}
+
+void applyThermostats(UniverseState &state, const UniverseConfig &config, const std::vector<Thermostat> &thermostats,
+        uint32_t seed, uint64_t step, double dT) {
+    ThermostatWorkspace w;
+    applyThermostats(state, config, thermostats, seed, step, dT, w);
+}
+
+void applyThermostats(UniverseState &state, const UniverseConfig &config, const std::vector<Thermostat> &thermostats,
+        uint32_t seed, uint64_t step, double dT, ThermostatWorkspace &w) {
+    if(thermostats.empty()) return;
+    size_t nThermostats = thermostats.size();
+
+    // Berendsen needs the temperatures of the regions: sums per box, then over the boxes
+    bool berendsen = std::any_of(thermostats.begin(), thermostats.end(),
+            [](const Thermostat &thermostat) { return thermostat.type == ThermostatType::berendsen; });
+    std::vector<ObservableBin> &regions = w.regions, &cellRegions = w.cellRegions;
+    regions.assign(nThermostats, ObservableBin());
+    if(berendsen) {
+        cellRegions.assign(state.cells.size() * nThermostats, ObservableBin());
+        parallelForCounter(config.threads, state.cells.size(), [&](AtomicCounter &counter) {
+            for(int c = counter.next(); c < counter.total(); c = counter.next())
+                for(const auto &pState: state.cells[c].particles) {
+                    int t = pState.asleep ? -1 : findThermostat(thermostats, pState.pos);
+                    if(t < 0 || thermostats[t].type != ThermostatType::berendsen) continue;
+                    ObservableBin &region = cellRegions[c * nThermostats + t];
+                    double mass = pState.type->getMass();
+                    ++region.n;
+                    region.mass += mass;
+                    region.momentum += pState.v * mass;
+                    region.kineticEnergy += pState.v.magnitude2() * mass / 2;
+                }
+        });
+        for(size_t c = 0; c < state.cells.size(); ++c)
+            for(size_t t = 0; t < nThermostats; ++t)
+                regions[t] += cellRegions[c * nThermostats + t];
+    }
+
+    std::vector<double> &scales = w.scales;
+    std::vector<Vector2D> &meanVelocities = w.meanVelocities;
+    scales.assign(nThermostats, 1);
+    meanVelocities.assign(nThermostats, Vector2D());
+    for(size_t t = 0; t < nThermostats; ++t) {
+        if(thermostats[t].type != ThermostatType::berendsen || ! regions[t].n) continue;
+        double temperature = regions[t].temperature();
+        if(temperature > 0)
+            scales[t] = std::sqrt(std::max(0., 1 + thermostats[t].coupling * dT *
+                    (thermostats[t].temperature / temperature - 1)));
+        meanVelocities[t] = regions[t].momentum / regions[t].mass;
+    }
+
+    parallelForCounter(config.threads, state.cells.size(), [&](AtomicCounter &counter) {
+        for(int c = counter.next(); c < counter.total(); c = counter.next())
+            for(auto &pState: state.cells[c].particles) {
+                int t = pState.asleep ? -1 : findThermostat(thermostats, pState.pos);
+                if(t < 0) continue;
+                const Thermostat &thermostat = thermostats[t];
+                if(thermostat.type == ThermostatType::berendsen) {
+                    pState.v = meanVelocities[t] + (pState.v - meanVelocities[t]) * scales[t];
+                    continue;
+                }
+
+                PhiloxCounter bits = philox4x32({ pState.id, (uint32_t) step, (uint32_t) (step >> 32), 0 },
+                        { seed, 0x5EED });
+                std::array<double, 2> xi = philoxNormal2(bits);
+                double friction = std::exp(-thermostat.coupling * dT);
+                double sigma = std::sqrt((1 - friction * friction) * thermostat.temperature / pState.type->getMass());
+                pState.v = pState.v * friction + Vector2D(xi[0], xi[1]) * sigma;
+            }
+    });
+}
@@ -0,0 +1,53 @@
+#ifndef __THERMOSTAT_H__
+#define __THERMOSTAT_H__
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "Lib/Observables.h"
+
+struct UniverseState;
+struct UniverseConfig;
+
+/*
+ * Thermostats drive the temperature of the particles within their region towards a target temperature. They are
+ * applied after each step as a parallel pass over the boxes. A particle is controlled by the first thermostat whose
+ * region contains it.
+ *
+ * Langevin: each velocity component gets friction and a random kick, v = c * v + sqrt((1 - c^2) * T / m) * xi with
+ * c = exp(-coupling * dT). Random numbers come from Philox keyed by the seed, particle id and step, so the results
+ * don't depend on the number of threads.
+ *
+ * Berendsen: velocities relative to the mean velocity of the region are scaled by
+ * sqrt(1 + coupling * dT * (T / T_region - 1)). Region temperatures are summed per box and then over the boxes in
+ * their order, which doesn't depend on the number of threads either.
+ *
+ * Sleeping particles (see Universe::enableSleeping()) are left out of both.
+ */
+
+enum class ThermostatType { langevin, berendsen };
+
+struct Thermostat {
+    ThermostatType type = ThermostatType::langevin;
+    double temperature = 1;
+    double coupling = 0.1; // Friction rate of Langevin, inverse relaxation time of Berendsen
+    double minX = -std::numeric_limits<double>::infinity(), minY = -std::numeric_limits<double>::infinity();
+    double maxX = std::numeric_limits<double>::infinity(), maxY = std::numeric_limits<double>::infinity();
+
+    inline bool contains(double x, double y) const { return x >= minX && x < maxX && y >= minY && y < maxY; }
+};
+
+// Buffers of applyThermostats(), kept between steps to reuse their memory
+struct ThermostatWorkspace {
+    std::vector<ObservableBin> cellRegions, regions;
+    std::vector<double> scales;
+    std::vector<Vector2D> meanVelocities;
+};
+
+void applyThermostats(UniverseState &state, const UniverseConfig &config, const std::vector<Thermostat> &thermostats,
+        uint32_t seed, uint64_t step, double dT, ThermostatWorkspace &w);
+
+void applyThermostats(UniverseState &state, const UniverseConfig &config, const std::vector<Thermostat> &thermostats,
+        uint32_t seed, uint64_t step, double dT);
+
+#endif
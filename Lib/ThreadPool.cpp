@@ -2,6 +2,6 @@
 #include <thread>
 #include "Lib/ThreadPool.h"
 
-#ifndef __EMSCRIPTEN__
+#ifdef THREAD_POOL_ENABLED
 ThreadPool threadPool(std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1);
 #endif
@@ -21,7 +21,8 @@
  * distribution.
  */
 
-// Per pt. 2: In addition to the original source by Jakob Progsch and Václav Zeman, a global ThreadPool object is declared.
+// Per pt. 2: In addition to the original source by Jakob Progsch and Václav Zeman, a global ThreadPool object is declared
+// and runOnWorkers() is added.
 
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
@@ -42,16 +43,30 @@ public:
     template<class F, class... Args>
     auto enqueue(F&& f, Args&&... args)
     -> std::future<typename std::result_of<F(Args...)>::type>;
+    // Runs task(arg) on n workers and returns when all of them have finished. Unlike enqueue(), it doesn't allocate:
+    // the job lives on the caller's stack and is taken by the workers before queued tasks. Must not be called
+    // from a worker.
+    void runOnWorkers(size_t n, void (*task)(void *), void *arg);
     ~ThreadPool();
 private:
+    struct BulkJob {
+        void (*task)(void *);
+        void *arg;
+        size_t unclaimed, running; // Workers yet to take the job, and yet to finish it
+        BulkJob *next;
+    };
+
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
     // the task queue
     std::queue< std::function<void()> > tasks;
 
+    // jobs of runOnWorkers(), oldest first
+    BulkJob *bulkHead = nullptr, *bulkTail = nullptr;
+
     // synchronization
     std::mutex queue_mutex;
-    std::condition_variable condition;
+    std::condition_variable condition, bulkDone;
     bool stop;
 };
 
@@ -66,15 +81,40 @@ inline ThreadPool::ThreadPool(size_t threads)
                     for(;;)
                     {
                         std::function<void()> task;
+                        BulkJob *job = nullptr;
 
                         {
                             std::unique_lock<std::mutex> lock(this->queue_mutex);
                             this->condition.wait(lock,
-                                                 [this]{ return this->stop || !this->tasks.empty(); });
-                            if(this->stop && this->tasks.empty())
-                                return;
-                            task = std::move(this->tasks.front());
-                            this->tasks.pop();
+                                                 [this]{ return this->stop || !this->tasks.empty() || this->bulkHead; });
+                            if(this->bulkHead)
+                            {
+                                job = this->bulkHead;
+                                if(--job->unclaimed == 0)
+                                {
+                                    this->bulkHead = job->next;
+                                    if(!this->bulkHead) this->bulkTail = nullptr;
+                                }
+                            }
+                            else
+                            {
+                                if(this->stop && this->tasks.empty())
+                                    return;
+                                task = std::move(this->tasks.front());
+                                this->tasks.pop();
+                            }
+                        }
+
+                        if(job)
+                        {
+                            job->task(job->arg);
+                            {
+                                // job is gone as soon as its caller sees running reach 0
+                                std::unique_lock<std::mutex> lock(this->queue_mutex);
+                                --job->running;
+                            }
+                            this->bulkDone.notify_all();
+                            continue;
                         }
 
                         task();
@@ -108,6 +148,25 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
     return res;
 }
 
+inline void ThreadPool::runOnWorkers(size_t n, void (*task)(void *), void *arg)
+{
+    if(n == 0)
+        return;
+    BulkJob job{ task, arg, n, n, nullptr };
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if(stop)
+            throw std::runtime_error("runOnWorkers on stopped ThreadPool");
+        if(bulkTail) bulkTail->next = &job;
+        else bulkHead = &job;
+        bulkTail = &job;
+    }
+    condition.notify_all();
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    bulkDone.wait(lock, [&job]{ return job.running == 0; });
+}
+
 // the destructor joins all threads
 inline ThreadPool::~ThreadPool()
 {
@@ -120,7 +179,9 @@ inline ThreadPool::~ThreadPool()
         worker.join();
 }
 
-#ifndef __EMSCRIPTEN__
+// Web builds only have threads when compiled with -pthread (requires cross-origin isolation in browsers)
+#if ! defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define THREAD_POOL_ENABLED
 extern ThreadPool threadPool;
 #endif
 
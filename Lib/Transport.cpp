@@ -0,0 +1,180 @@
+
+#include "Lib/Transport.h"
+#include <stdexcept>
+#include <thread>
+#include <cstring>
+
+#ifndef __EMSCRIPTEN__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+Transport::Transport(int _rank, int _size): rank_(_rank), size_(_size) {
+}
+
+void Transport::exchange(int peer, const std::vector<char> &out, std::vector<char> &in) {
+    if(rank_ < peer) {
+        send(peer, out);
+        receive(peer, in);
+    } else {
+        receive(peer, in);
+        send(peer, out);
+    }
+}
+
+#ifndef __EMSCRIPTEN__
+
+struct ShmTransport::Mailbox {
+    static const size_t capacity = 1 << 20;
+
+    // written == read means that the slot is empty. Atomics are lock-free, so they work across processes.
+    std::atomic<uint64_t> written, read;
+    uint64_t messageSize, chunkSize;
+    char data[capacity];
+};
+
+ShmTransport::ShmTransport(const std::string &_name, int _rank, int _size):
+        Transport(_rank, _size), name(_name) {
+}
+
+ShmTransport::~ShmTransport() {
+    for(auto &link: mailboxes) {
+        munmap(link.second, sizeof(Mailbox));
+        if(link.first.second == rank_) // Receiver removes the name
+            shm_unlink(mailboxName(link.first.first, link.first.second).c_str());
+    }
+}
+
+std::string ShmTransport::mailboxName(int from, int to) const {
+    return "/" + name + "-" + std::to_string(from) + "-" + std::to_string(to);
+}
+
+ShmTransport::Mailbox * ShmTransport::mailbox(int from, int to) {
+    auto it = mailboxes.find({ from, to });
+    if(it != mailboxes.end()) return it->second;
+
+    // Both sides create the object if it doesn't exist yet. ftruncate() zero fills, which is an empty mailbox.
+    int fd = shm_open(mailboxName(from, to).c_str(), O_CREAT | O_RDWR, 0600);
+    if(fd < 0 || ftruncate(fd, sizeof(Mailbox)) != 0)
+        throw std::runtime_error("ShmTransport: can't create shared memory " + mailboxName(from, to));
+    void *mem = mmap(nullptr, sizeof(Mailbox), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED)
+        throw std::runtime_error("ShmTransport: can't map shared memory " + mailboxName(from, to));
+
+    Mailbox *box = static_cast<Mailbox *>(mem);
+    mailboxes[{ from, to }] = box;
+    return box;
+}
+
+void ShmTransport::send(int to, const std::vector<char> &msg) {
+    Mailbox *box = mailbox(rank_, to);
+    size_t sent = 0;
+    do { // Sends at least one chunk, even for an empty message
+        while(box->read.load(std::memory_order_acquire) != box->written.load(std::memory_order_relaxed))
+            std::this_thread::yield();
+
+        size_t chunk = std::min(Mailbox::capacity, msg.size() - sent);
+        std::memcpy(box->data, msg.data() + sent, chunk);
+        box->messageSize = msg.size();
+        box->chunkSize = chunk;
+        box->written.fetch_add(1, std::memory_order_release);
+        sent += chunk;
+    } while(sent < msg.size());
+}
+
+void ShmTransport::receive(int from, std::vector<char> &msg) {
+    Mailbox *box = mailbox(from, rank_);
+    size_t received = 0;
+    do {
+        while(box->written.load(std::memory_order_acquire) == box->read.load(std::memory_order_relaxed))
+            std::this_thread::yield();
+
+        msg.resize(box->messageSize);
+        std::memcpy(msg.data() + received, box->data, box->chunkSize);
+        received += box->chunkSize;
+        box->read.fetch_add(1, std::memory_order_release);
+    } while(received < msg.size());
+}
+
+
+static void sendAll(int socket, const char *data, size_t size) {
+    while(size > 0) {
+        ssize_t n = ::send(socket, data, size, MSG_NOSIGNAL);
+        if(n <= 0) throw std::runtime_error("TcpTransport: send failed");
+        data += n;
+        size -= n;
+    }
+}
+
+static void receiveAll(int socket, char *data, size_t size) {
+    while(size > 0) {
+        ssize_t n = ::recv(socket, data, size, 0);
+        if(n <= 0) throw std::runtime_error("TcpTransport: receive failed");
+        data += n;
+        size -= n;
+    }
+}
+
+TcpTransport::TcpTransport(const std::string &host, int basePort, int _rank, int _size):
+        Transport(_rank, _size), sockets(_size, -1) {
+    // Each rank accepts connections from higher ranks and connects to lower ones
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, & yes, sizeof(yes));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(host.c_str());
+    address.sin_port = htons(basePort + rank_);
+    if(bind(listener, (sockaddr *) & address, sizeof(address)) != 0 || listen(listener, size_) != 0)
+        throw std::runtime_error("TcpTransport: can't listen on port " + std::to_string(basePort + rank_));
+
+    for(int peer = 0; peer < rank_; ++peer) {
+        int s = socket(AF_INET, SOCK_STREAM, 0);
+        address.sin_port = htons(basePort + peer);
+        while(connect(s, (sockaddr *) & address, sizeof(address)) != 0) { // Peer might not be listening yet
+            close(s);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            s = socket(AF_INET, SOCK_STREAM, 0);
+        }
+        int32_t myRank = rank_;
+        sendAll(s, (const char *) & myRank, sizeof(myRank));
+        sockets[peer] = s;
+    }
+    for(int i = rank_ + 1; i < size_; ++i) {
+        int s = accept(listener, nullptr, nullptr);
+        int32_t peer;
+        receiveAll(s, (char *) & peer, sizeof(peer));
+        sockets[peer] = s;
+    }
+    close(listener);
+
+    for(int s: sockets)
+        if(s >= 0) setsockopt(s, IPPROTO_TCP, TCP_NODELAY, & yes, sizeof(yes));
+}
+
+TcpTransport::~TcpTransport() {
+    for(int s: sockets)
+        if(s >= 0) close(s);
+}
+
+void TcpTransport::send(int to, const std::vector<char> &msg) {
+    uint64_t size = msg.size();
+    sendAll(sockets[to], (const char *) & size, sizeof(size));
+    sendAll(sockets[to], msg.data(), msg.size());
+}
+
+void TcpTransport::receive(int from, std::vector<char> &msg) {
+    uint64_t size;
+    receiveAll(sockets[from], (char *) & size, sizeof(size));
+    msg.resize(size);
+    receiveAll(sockets[from], msg.data(), size);
+}
+
+#endif
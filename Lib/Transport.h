@@ -0,0 +1,67 @@
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Transport sends byte messages between the ranks (processes) of a distributed simulation. Messages between a pair
+ * of ranks are delivered in order. send() may block until the receiver has taken (a part of) the message, so
+ * two ranks must not send to each other at the same time. exchange() orders the two transfers by rank to avoid that.
+ *
+ * ShmTransport uses POSIX shared memory mailboxes and works between processes of the same host.
+ * TcpTransport uses TCP connections, eg. over loopback for testing.
+ */
+
+class Transport {
+public:
+    Transport(int _rank, int _size);
+    virtual ~Transport() {}
+    virtual void send(int to, const std::vector<char> &msg) = 0;
+    virtual void receive(int from, std::vector<char> &msg) = 0;
+    void exchange(int peer, const std::vector<char> &out, std::vector<char> &in);
+
+    inline int rank() const { return rank_; }
+    inline int size() const { return size_; }
+
+protected:
+    int rank_, size_;
+};
+
+#ifndef __EMSCRIPTEN__
+
+class ShmTransport: public Transport {
+public:
+    // All ranks must use the same name, which must be unique among concurrently running simulations
+    ShmTransport(const std::string &_name, int _rank, int _size);
+    ~ShmTransport();
+    void send(int to, const std::vector<char> &msg) override;
+    void receive(int from, std::vector<char> &msg) override;
+
+private:
+    struct Mailbox; // Single message chunk slot in shared memory, written by one rank and read by another
+    Mailbox * mailbox(int from, int to);
+    std::string mailboxName(int from, int to) const;
+
+    std::string name;
+    std::map<std::pair<int, int>, Mailbox *> mailboxes;
+};
+
+class TcpTransport: public Transport {
+public:
+    // Rank r listens on basePort + r. Blocks until connected to all other ranks.
+    TcpTransport(const std::string &host, int basePort, int _rank, int _size);
+    ~TcpTransport();
+    void send(int to, const std::vector<char> &msg) override;
+    void receive(int from, std::vector<char> &msg) override;
+
+private:
+    std::vector<int> sockets; // Indexed by rank
+};
+
+#endif
+
+#endif
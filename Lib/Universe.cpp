@@ -1,72 +1,237 @@
 
 #include "Lib/Integrators.h"
 #include "Lib/Universe.h"
+#include "Lib/BlockTimesteps.h"
+#include "Lib/Parallel.h"
+#include "Lib/Profiler.h"
 #include <vector>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <future>
+#include <limits>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+// Sparse mode is entered below the lower occupancy and left above the higher one, so that modes don't alternate
+static const double sparseOccupancy = 1. / 16, denseOccupancy = 1. / 8;
+
+// Grows capacity geometrically from a few particles, so that the buffers of boxes quickly reach their working sizes
+static const size_t minParticleCapacity = 4;
+
+static inline void reserveParticles(std::vector<ParticleState> &particles, size_t n) {
+    if(n > particles.capacity())
+        particles.reserve(std::max(std::max(n, 2 * particles.capacity()), minParticleCapacity));
+}
+
+// Sets the first n copies to value, keeping the buffers of all copies for later steps
+template<typename T>
+static void copyInto(std::vector<T> &copies, size_t n, const T &value) {
+    if(copies.size() < n) copies.resize(n);
+    for(size_t i = 0; i < n; ++i)
+        copies[i] = value;
+}
+
+static long long cellKey(int x, int y, int cellsX) {
+    return (long long) y * cellsX + x;
+}
+
+static inline double distance2(const Vector2D &lhs, const Vector2D &rhs) {
+    // Squared distance of candidate pairs is the most frequent operation in the force loop
+#ifdef __wasm_simd128__
+    v128_t d = wasm_f64x2_sub(wasm_v128_load(& lhs), wasm_v128_load(& rhs));
+    d = wasm_f64x2_mul(d, d);
+    return wasm_f64x2_extract_lane(d, 0) + wasm_f64x2_extract_lane(d, 1);
+#else
+    return (lhs - rhs).magnitude2();
+#endif
+}
 
 void UniverseState::setInteractionDistance(const UniverseConfig &config, double dist) {
     assert(size_ == 0);
     sizePerBlock = std::max(dist, 1.0);
-    state.resize(config.sizeY / sizePerBlock + 1);
-    for(auto &ySlice: state) {
-        ySlice.resize(config.sizeX / sizePerBlock + 1);
-    }
+    cellsX = config.sizeX / sizePerBlock + 1;
+    cellsY = config.sizeY / sizePerBlock + 1;
+    cells.clear();
+    sparse = true; // Empty universe is as sparse as it gets
+    appendedCells = false;
+    rebuildSparseIndex();
 }
 
 void UniverseState::prepareDifferentiation() {
-    std::vector<ParticleState> current;
-    for(size_t y = 0; y < state.size(); ++y) {
-        for(size_t x = 0; x < state[y].size(); ++x) {
-            current.swap(state[y][x]);
-            state[y][x].clear();
-            size_ -= current.size();
-            for(size_t i = 0; i < current.size(); ++i) {
-                insert(current[i]);
-            }
+    // Moves particles, which have left their cells
+    leaving.clear();
+    for(auto &cell: cells) {
+        auto staying = cell.particles.begin();
+        for(auto it = cell.particles.begin(); it != cell.particles.end(); ++it) {
+            int x = std::max(0, std::min(cellsX - 1, (int) (it->pos.x / sizePerBlock)));
+            int y = std::max(0, std::min(cellsY - 1, (int) (it->pos.y / sizePerBlock)));
+            if(x == cell.x && y == cell.y) *staying++ = *it;
+            else leaving.push_back(*it);
         }
+        cell.particles.erase(staying, cell.particles.end());
     }
+    size_ -= leaving.size();
+    for(const auto &pState: leaving)
+        insert(pState);
+
+    size_t occupied = 0;
+    for(const auto &cell: cells)
+        occupied += ! cell.particles.empty();
+    double occupancy = (double) occupied / ((double) cellsX * cellsY);
+
+    // Sparse cells are only compacted and sorted when boxes were appended or emptied
+    if(sparse && occupancy > denseOccupancy) toDense();
+    else if(sparse ? appendedCells || occupied < cells.size() : occupancy < sparseOccupancy) toSparse();
 }
 
-UniverseState & UniverseState::operator=(const UniverseState &rhs) {
-    state.resize(rhs.state.size());
-    for(size_t y = 0; y < state.size(); ++y) {
-        state[y].resize(rhs.state[y].size());
-        for(size_t x = 0; x < state[y].size(); ++x) {
-            state[y][x] = rhs.state[y][x];
+void UniverseState::toDense() {
+    std::vector<UniverseCell> grid(cellsX * cellsY);
+    for(int y = 0; y < cellsY; ++y)
+        for(int x = 0; x < cellsX; ++x) {
+            grid[y * cellsX + x].x = x;
+            grid[y * cellsX + x].y = y;
         }
+    for(auto &cell: cells)
+        grid[cell.y * cellsX + cell.x].particles.swap(cell.particles);
+
+    cells.swap(grid);
+    sparse = false;
+    appendedCells = false;
+    sparseIndex.clear(0);
+}
+
+void UniverseState::toSparse() {
+    // Removes empty cells and restores row major order of the cells, which new cells have been appended to.
+    // Empty cells are swapped to the end rather than overwritten, so that their buffers become spares.
+    size_t occupied = 0;
+    for(size_t c = 0; c < cells.size(); ++c)
+        if(! cells[c].particles.empty()) std::swap(cells[occupied++], cells[c]);
+    resizeCells(occupied);
+    std::sort(cells.begin(), cells.end(), [](const UniverseCell &lhs, const UniverseCell &rhs) {
+        return lhs.y != rhs.y ? lhs.y < rhs.y : lhs.x < rhs.x;
+    });
+    sparse = true;
+    appendedCells = false;
+    rebuildSparseIndex();
+}
+
+void UniverseState::rebuildSparseIndex() {
+    sparseIndex.clear(cells.size());
+    for(size_t i = 0; i < cells.size(); ++i)
+        sparseIndex.insert(cellKey(cells[i].x, cells[i].y, cellsX), i);
+}
+
+void UniverseState::resizeCells(size_t n) {
+    for(size_t c = n; c < cells.size(); ++c) {
+        if(! cells[c].particles.capacity()) continue;
+        cells[c].particles.clear();
+        spareBuffers.emplace_back();
+        spareBuffers.back().swap(cells[c].particles);
+    }
+    size_t oldSize = cells.size();
+    cells.resize(n);
+    for(size_t c = oldSize; c < n && ! spareBuffers.empty(); ++c) {
+        cells[c].particles.swap(spareBuffers.back());
+        spareBuffers.pop_back();
+    }
+}
+
+void UniverseState::copyLayout(const UniverseState &rhs) {
+    cellsX = rhs.cellsX;
+    cellsY = rhs.cellsY;
+    sparse = rhs.sparse;
+    appendedCells = rhs.appendedCells;
+    sparseIndex = rhs.sparseIndex;
+    size_ = rhs.size_;
+    sizePerBlock = rhs.sizePerBlock;
+    resizeCells(rhs.cells.size());
+    for(size_t c = 0; c < cells.size(); ++c) {
+        cells[c].x = rhs.cells[c].x;
+        cells[c].y = rhs.cells[c].y;
+    }
+}
+
+UniverseState & UniverseState::operator=(const UniverseState &rhs) {
+    copyLayout(rhs);
+    for(size_t c = 0; c < cells.size(); ++c) {
+        reserveParticles(cells[c].particles, rhs.cells[c].particles.size());
+        cells[c].particles = rhs.cells[c].particles;
     }
     return *this;
 }
 
 UniverseState & UniverseState::operator+=(const UniverseState &rhs) {
-    assert(state.size() == rhs.state.size());
-    for(size_t y = 0; y < state.size(); ++y) {
-        assert(state[y].size() == rhs.state[y].size());
-        for(size_t x = 0; x < state[y].size(); ++x) {
-            assert(state[y][x].size() == rhs.state[y][x].size());
-            for(size_t i = 0; i < state[y][x].size(); ++i) {
-                state[y][x][i] += rhs.state[y][x][i];
-            }
+    assert(cells.size() == rhs.cells.size());
+    for(size_t c = 0; c < cells.size(); ++c) {
+        auto &particles = cells[c].particles;
+        const auto &rhsParticles = rhs.cells[c].particles;
+        assert(particles.size() == rhsParticles.size());
+        for(size_t i = 0; i < particles.size(); ++i) {
+            particles[i] += rhsParticles[i];
         }
     }
     return *this;
 }
 
 UniverseState & UniverseState::operator*=(double rhs) {
-    for(size_t y = 0; y < state.size(); ++y) {
-        for(size_t x = 0; x < state[y].size(); ++x) {
-            for(size_t i = 0; i < state[y][x].size(); ++i) {
-                state[y][x][i] *= rhs;
-            }
+    for(auto &cell: cells) {
+        for(auto &pState: cell.particles) {
+            pState *= rhs;
         }
     }
     return *this;
 }
 
+int UniverseState::cellIndex(int x, int y) const {
+    if(x < 0 || y < 0 || x >= cellsX || y >= cellsY)
+        return -1;
+    if(! sparse)
+        return y * cellsX + x;
+    return sparseIndex.find(cellKey(x, y, cellsX));
+}
+
+
+void CellIndex::clear(size_t expectedSize) {
+    size_t nSlots = slots.empty() ? 16 : slots.size();
+    while(nSlots < 2 * expectedSize) nSlots *= 2;
+    slots.assign(nSlots, { -1, -1 });
+    size = 0;
+}
+
+static inline size_t cellIndexSlot(long long key, size_t nSlots) {
+    return (size_t) (((uint64_t) key * 0x9E3779B97F4A7C15ULL) >> 32) & (nSlots - 1);
+}
+
+void CellIndex::insert(long long key, int idx) {
+    if(2 * (size + 1) > slots.size()) rehash(std::max(2 * slots.size(), (size_t) 16));
+    size_t slot = cellIndexSlot(key, slots.size());
+    while(slots[slot].first != -1 && slots[slot].first != key)
+        slot = (slot + 1) & (slots.size() - 1);
+    size += slots[slot].first == -1;
+    slots[slot] = { key, idx };
+}
+
+int CellIndex::find(long long key) const {
+    if(slots.empty()) return -1;
+    for(size_t slot = cellIndexSlot(key, slots.size()); slots[slot].first != -1; slot = (slot + 1) & (slots.size() - 1))
+        if(slots[slot].first == key) return slots[slot].second;
+    return -1;
+}
+
+void CellIndex::rehash(size_t nSlots) {
+    std::vector<std::pair<long long, int>> old(nSlots, { -1, -1 });
+    old.swap(slots);
+    size = 0;
+    for(const auto &entry: old)
+        if(entry.first != -1) insert(entry.first, entry.second);
+}
+
 
 bool UniverseState::iterator::operator==(const UniverseState::iterator &rhs) const {
-    return obj == rhs.obj && itY == rhs.itY && itX == rhs.itX && itI == rhs.itI;
+    return obj == rhs.obj && itC == rhs.itC && (itC == obj->cells.end() || itI == rhs.itI);
 }
 
 bool UniverseState::iterator::operator!=(const UniverseState::iterator &rhs) const {
@@ -87,49 +252,182 @@ ParticleState * UniverseState::iterator::operator->() const {
 }
 
 UniverseState::iterator & UniverseState::iterator::normalize() {
-    while(itI == itX->end()) {
-        ++itX;
-        if(itX == itY->end()) {
-            ++itY;
-            if(itY == obj->state.end()) {
-                return *this;
-            }
-            itX = itY->begin();
-        }
-        itI = itX->begin();
+    while(itC != obj->cells.end() && itI == itC->particles.end()) {
+        ++itC;
+        if(itC != obj->cells.end())
+            itI = itC->particles.begin();
     }
     return *this;
 }
 
 
 UniverseState::iterator UniverseState::begin() {
-    UniverseState::iterator it{ this, state.begin(), state.front().begin(), state.front().front().begin() };
+    if(cells.empty()) return end();
+    UniverseState::iterator it{ this, cells.begin(), cells.front().particles.begin() };
     return it.normalize();
 }
 
 UniverseState::iterator UniverseState::end() {
-    return { this, state.end(), state.back().end(), state.back().back().end() };
+    return { this, cells.end(), {} };
 }
 
 void UniverseState::insert(const ParticleState &pState) {
-    assert(! state.empty());
-    int x = std::max(0, std::min((int) state[0].size() - 1, (int) (pState.pos.x / sizePerBlock)));
-    int y = std::max(0, std::min((int) state.size() - 1, (int) (pState.pos.y / sizePerBlock)));
-    state[y][x].push_back(pState);
+    int x = std::max(0, std::min(cellsX - 1, (int) (pState.pos.x / sizePerBlock)));
+    int y = std::max(0, std::min(cellsY - 1, (int) (pState.pos.y / sizePerBlock)));
+    insert(pState, x, y);
+}
+
+void UniverseState::insert(const ParticleState &pState, int x, int y) {
+    int idx = findOrAddCell(x, y);
+    reserveParticles(cells[idx].particles, cells[idx].particles.size() + 1);
+    cells[idx].particles.push_back(pState);
     ++size_;
 }
 
+static const size_t insertChunkParticles = 1 << 14; // Fewest particles binned by each thread of a bulk insert
+
+void UniverseState::insert(const ParticleState *particles, size_t n, int threads) {
+    // The particles are split into one chunk per thread. Boxes are looked up and counted per chunk, each buffer is
+    // grown once to its final size, and the chunks scatter their particles to the offsets given by the prefix sums of
+    // the counts, so that the particles of each box stay in their original order
+    size_t nThreads = threads;
+    if(! nThreads) nThreads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    size_t nChunks = std::max(std::min(nThreads, n / insertChunkParticles), (size_t) 1);
+    auto chunkBegin = [n, nChunks](size_t chunk) { return n * chunk / nChunks; };
+    auto boxOf = [this](const ParticleState &pState, int &x, int &y) {
+        x = std::max(0, std::min(cellsX - 1, (int) (pState.pos.x / sizePerBlock)));
+        y = std::max(0, std::min(cellsY - 1, (int) (pState.pos.y / sizePerBlock)));
+    };
+
+    // Lookups don't change the boxes. Boxes missing in sparse mode are collected by each chunk in the order of their
+    // first particle, and then added in chunk order, so they are appended in the same order as by single inserts.
+    std::vector<int> boxes(n);
+    std::vector<CellIndex> chunkIndices(nChunks);
+    std::vector<std::vector<std::pair<int, int>>> missing(nChunks);
+    parallelForCounter(threads, nChunks, [&](AtomicCounter &counter) {
+        for(size_t chunk = counter.next(); chunk < counter.total(); chunk = counter.next())
+            for(size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); ++i) {
+                int x, y;
+                boxOf(particles[i], x, y);
+                boxes[i] = cellIndex(x, y);
+                if(boxes[i] >= 0 || chunkIndices[chunk].find(cellKey(x, y, cellsX)) >= 0) continue;
+                chunkIndices[chunk].insert(cellKey(x, y, cellsX), 0);
+                missing[chunk].emplace_back(x, y);
+            }
+    });
+    for(const auto &boxesOfChunk: missing)
+        for(const auto &box: boxesOfChunk)
+            findOrAddCell(box.first, box.second);
+
+    size_t nCells = cells.size();
+    std::vector<size_t> offsets(nChunks * nCells, 0); // Counts of each chunk and box, then where the chunk writes
+    parallelForCounter(threads, nChunks, [&](AtomicCounter &counter) {
+        for(size_t chunk = counter.next(); chunk < counter.total(); chunk = counter.next())
+            for(size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); ++i) {
+                if(boxes[i] < 0) { // Added above
+                    int x, y;
+                    boxOf(particles[i], x, y);
+                    boxes[i] = cellIndex(x, y);
+                }
+                ++offsets[chunk * nCells + boxes[i]];
+            }
+    });
+    for(size_t c = 0; c < nCells; ++c) {
+        size_t end = cells[c].particles.size();
+        for(size_t chunk = 0; chunk < nChunks; ++chunk) {
+            size_t count = offsets[chunk * nCells + c];
+            offsets[chunk * nCells + c] = end;
+            end += count;
+        }
+        if(end == cells[c].particles.size()) continue;
+        reserveParticles(cells[c].particles, end);
+        cells[c].particles.resize(end);
+    }
+    parallelForCounter(threads, nChunks, [&](AtomicCounter &counter) {
+        for(size_t chunk = counter.next(); chunk < counter.total(); chunk = counter.next())
+            for(size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); ++i)
+                cells[boxes[i]].particles[offsets[chunk * nCells + boxes[i]]++] = particles[i];
+    });
+    size_ += n;
+}
+
+int UniverseState::findOrAddCell(int x, int y) {
+    int idx = cellIndex(x, y);
+    if(idx < 0) { // Sparse mode, new cell is appended and put into its place by the next prepareDifferentiation()
+        idx = cells.size();
+        sparseIndex.insert(cellKey(x, y, cellsX), idx);
+        resizeCells(idx + 1);
+        cells.back().x = x;
+        cells.back().y = y;
+        appendedCells = true;
+    }
+    return idx;
+}
+
 UniverseState::iterator UniverseState::erase(UniverseState::iterator it) {
     --size_;
-    it.itX->erase(it.itI);
+    it.itI = it.itC->particles.erase(it.itI);
     return it.normalize();
 }
 
 
+double integrationError(const UniverseState &error) {
+    double maxError = 0;
+    for(const auto &cell: error.cells)
+        for(const auto &pError: cell.particles) {
+            maxError = std::max(maxError, std::max(std::abs(pError.pos.x), std::abs(pError.pos.y)));
+            maxError = std::max(maxError, std::max(std::abs(pError.v.x), std::abs(pError.v.y)));
+        }
+    return maxError;
+}
+
+void ParticleMask::resize(const UniverseState &state) {
+    flags.resize(state.cells.size());
+    cellCounts.assign(state.cells.size(), 0);
+    for(size_t c = 0; c < state.cells.size(); ++c)
+        flags[c].assign(state.cells[c].particles.size(), 0);
+}
+
+
 UniverseDifferentiator::UniverseDifferentiator(const UniverseConfig &_config, std::vector<ParticleType> _types):
     config(_config), types(std::move(_types)) {
+    maxRange = 0;
+    for(const auto &type: types) {
+        maxRange = std::max(maxRange, type.getRange());
+    }
+    cellSize = std::max(maxRange / std::max(config.cellsPerRange, 1), 1.0);
+
+    pairRanges.resize(types.size() * types.size());
+    for(size_t t0 = 0; t0 < types.size(); ++t0)
+        for(size_t t1 = 0; t1 < types.size(); ++t1)
+            pairRanges[types.size() * t0 + t1] = std::min(types[t0].getRange(), types[t1].getRange());
+
+    // Potentials are integrated from the end of the range inwards, one sample interval at a time
+    pairPotentials.resize(pairRanges.size() * (potentialSamples + 1));
+    for(size_t pair = 0; pair < pairRanges.size(); ++pair) {
+        const ParticleType &type0 = types[pair / types.size()], &type1 = types[pair % types.size()];
+        double *potentials = &pairPotentials[pair * (potentialSamples + 1)];
+        double step = pairRanges[pair] / potentialSamples;
+        potentials[potentialSamples] = 0;
+        for(int i = potentialSamples - 1; i >= 0; --i)
+            potentials[i] = potentials[i + 1] + type0.computeWork(type1, i * step, (i + 1) * step, 8);
+    }
+
+    // Half-shell: the box itself, boxes to the right on the same row and all boxes on the rows below,
+    // which can contain particles within the interaction range
+    int reach = (int) std::ceil(maxRange / cellSize);
+    stencil.push_back({ 0, 0, 0 });
+    for(int y = 0; y <= reach; ++y)
+        for(int x = -reach; x <= reach; ++x) {
+            if(y == 0 && x <= 0) continue;
+            double gapX = std::max(std::abs(x) - 1, 0) * cellSize, gapY = std::max(y - 1, 0) * cellSize;
+            double minDist = std::sqrt(gapX * gapX + gapY * gapY);
+            if(minDist < maxRange) stencil.push_back({ x, y, minDist });
+        }
 }
+
 void UniverseDifferentiator::prepareDifferentiation(UniverseState &state) const {
+    ProfileSpan span("prepare", true);
     state.prepareDifferentiation();
 }
 
@@ -137,94 +435,285 @@ void UniverseDifferentiator::derivative(UniverseState &der, UniverseBuffers &der
     // Using derivative cache as another accumulator for forces to avoid data race
 
     initForces(der, state);
-    for (size_t i = 0; i < derBuffers.size(); ++i)
-        initForces(derBuffers[i], state);
+    initBuffers(derBuffers, state);
 
-    computeForces(der, derBuffers, state);
-    forcesToAccel(der, derBuffers);
+    ObservableGrid *observables = observeNext; // Taken by computeForces()
+    const ParticleMask *active = awakeMask(state);
+    computeForces(der, derBuffers, state, active);
+    addLongRangeForces(der, state, active, observables);
+    forcesToAccel(der, derBuffers, active);
 }
 
-void UniverseDifferentiator::initForces(UniverseState &der, const UniverseState &state) const {
-    der.state.resize(state.state.size());
-    for(size_t y = 0; y < state.state.size(); ++y) {
-        der.state[y].resize(state.state[y].size());
-        for(size_t x = 0; x < state.state[y].size(); ++x) {
-            der.state[y][x].assign(state.state[y][x].size(), ParticleState());
-            for(size_t i = 0; i < state.state[y][x].size(); ++i) {
-                der.state[y][x][i].type = state.state[y][x][i].type;
-                der.state[y][x][i].pos = state.state[y][x][i].v;
+const ParticleMask * UniverseDifferentiator::awakeMask(const UniverseState &state) const {
+    // Sleeping particles have zero velocity, so their derivative is zero as set by initForces()
+    bool anyAsleep = false;
+    for(const auto &cell: state.cells) {
+        for(const auto &pState: cell.particles)
+            if(pState.asleep) {
+                anyAsleep = true;
+                break;
             }
+        if(anyAsleep) break;
+    }
+    if(! anyAsleep) return nullptr;
+
+    awake.resize(state);
+    for(size_t c = 0; c < state.cells.size(); ++c) {
+        const auto &particles = state.cells[c].particles;
+        int count = 0;
+        for(size_t i = 0; i < particles.size(); ++i) {
+            awake.flags[c][i] = ! particles[i].asleep;
+            count += ! particles[i].asleep;
         }
+        awake.cellCounts[c] = count;
     }
+    return & awake;
 }
 
-void UniverseDifferentiator::computeForces(UniverseState &der, UniverseBuffers &derBuffers, const UniverseState &state) const {
-    assert(! state.state.empty());
+void UniverseDifferentiator::initAccelerations(UniverseState &acc, UniverseBuffers &accBuffers,
+        const UniverseState &state) const {
+    initForces(acc, state);
+    initBuffers(accBuffers, state);
+}
 
-    AtomicCounter counter(state.state.size() * state.state[0].size());
+void UniverseDifferentiator::activeAccelerations(UniverseState &acc, UniverseBuffers &accBuffers,
+        const UniverseState &state, const ParticleMask &active) const {
+    resetActiveForces(acc, accBuffers, active);
 
-#ifdef __EMSCRIPTEN__
-    computeForcesOneThread(der, derBuffers, state, counter);
+    ObservableGrid *observables = observeNext; // Taken by computeForces()
+    computeForces(acc, accBuffers, state, & active);
+    addLongRangeForces(acc, state, & active, observables);
+    forcesToAccel(acc, accBuffers, & active);
+}
+
+void UniverseDifferentiator::initForces(UniverseState &der, const UniverseState &state) const {
+    der.copyLayout(state);
+    for(size_t c = 0; c < state.cells.size(); ++c) {
+        const auto &particles = state.cells[c].particles;
+        auto &derParticles = der.cells[c].particles;
+        reserveParticles(derParticles, particles.size());
+        derParticles.assign(particles.size(), ParticleState());
+        for(size_t i = 0; i < particles.size(); ++i) {
+            derParticles[i].type = particles[i].type;
+            derParticles[i].pos = particles[i].v;
+            derParticles[i].asleep = particles[i].asleep; // Carried into the intermediate states of integrators
+        }
+    }
+}
+
+void UniverseDifferentiator::initBuffers(UniverseBuffers &derBuffers, const UniverseState &state) const {
+    derBuffers.offsets.resize(state.cells.size() + 1);
+    derBuffers.offsets[0] = 0;
+    for(size_t c = 0; c < state.cells.size(); ++c)
+        derBuffers.offsets[c + 1] = derBuffers.offsets[c] + state.cells[c].particles.size();
+
+    derBuffers.forces.resize(stencil.size() - 1);
+    for(auto &forces: derBuffers.forces)
+        forces.assign(derBuffers.offsets.back(), Vector2D());
+}
+
+void UniverseDifferentiator::resetActiveForces(UniverseState &der, UniverseBuffers &derBuffers,
+        const ParticleMask &active) const {
+    // Forces of unselected particles are left as they are, they are never read
+    for(size_t c = 0; c < der.cells.size(); ++c) {
+        if(! active.cellCounts[c]) continue;
+        for(auto &pDer: der.cells[c].particles)
+            pDer.v = Vector2D(0, 0);
+        for(auto &forces: derBuffers.forces)
+            std::fill(forces.begin() + derBuffers.offsets[c], forces.begin() + derBuffers.offsets[c + 1], Vector2D());
+    }
+}
+
+void UniverseDifferentiator::computeForces(UniverseState &der, UniverseBuffers &derBuffers, const UniverseState &state,
+        const ParticleMask *active) const {
+    AtomicCounter counter(state.cells.size());
+    ObservableGrid *observables = observeNext;
+    PairHistogram *histogram = histogramNext;
+    observeNext = nullptr;
+    histogramNext = nullptr;
+
+    if(config.deterministic && (observables || histogram)) {
+        computeForcesDeterministic(der, derBuffers, state, active, observables, histogram);
+        return;
+    }
+
+#ifndef THREAD_POOL_ENABLED
+    computeForcesOneThread(der, derBuffers, state, active, counter, observables, histogram);
 #else
-    size_t nThreads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
-    std::vector<std::future<void>> futures;
-    for(size_t i = 0; i < nThreads; ++i) {
-        futures.push_back(threadPool.enqueue(& UniverseDifferentiator::computeForcesOneThread, this,
-                std::ref(der), std::ref(derBuffers), std::cref(state), std::ref(counter)));
-    }
-    for(size_t i = 0; i < futures.size(); ++i)
-        futures[i].wait();
+    size_t nThreads = config.threads;
+    if(! nThreads) nThreads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    if(nThreads == 1) {
+        computeForcesOneThread(der, derBuffers, state, active, counter, observables, histogram);
+        return;
+    }
+
+    // Each thread accumulates observables and histograms into its own copies, which are summed afterwards
+    if(observables) copyInto(partialObservables, nThreads, *observables);
+    if(histogram) copyInto(partialHistograms, nThreads, *histogram);
+    std::atomic<size_t> nextThread(0);
+    parallelForCounter(nThreads, state.cells.size(), [&](AtomicCounter &threadCounter) {
+        size_t i = nextThread++;
+        computeForcesOneThread(der, derBuffers, state, active, threadCounter,
+                observables ? & partialObservables[i] : nullptr, histogram ? & partialHistograms[i] : nullptr);
+    });
+    for(size_t i = 0; observables && i < nThreads; ++i)
+        *observables += partialObservables[i];
+    for(size_t i = 0; histogram && i < nThreads; ++i)
+        *histogram += partialHistograms[i];
 #endif
 }
 
+void UniverseDifferentiator::computeForcesDeterministic(UniverseState &der, UniverseBuffers &derBuffers,
+        const UniverseState &state, const ParticleMask *active, ObservableGrid *observables,
+        PairHistogram *histogram) const {
+    // Boxes are split into a fixed number of contiguous chunks, each of which is processed in order by one thread
+    // and has its own accumulators. Accumulators are summed in chunk order, so that the sums don't depend on
+    // the number of threads or on scheduling.
+    size_t nChunks = std::max(std::min(state.cells.size(), (size_t) deterministicChunks), (size_t) 1);
+    if(observables) copyInto(partialObservables, nChunks, *observables);
+    if(histogram) copyInto(partialHistograms, nChunks, *histogram);
+
+    parallelForCounter(config.threads, nChunks, [&](AtomicCounter &counter) {
+        ProfileSpan span("forces", true);
+        for(size_t chunk = counter.next(); chunk < counter.total(); chunk = counter.next()) {
+            ProfileSpan chunkSpan("chunk", false, chunk, -1);
+            size_t begin = state.cells.size() * chunk / nChunks, end = state.cells.size() * (chunk + 1) / nChunks;
+            ObservableGrid *observablesOfChunk = observables ? & partialObservables[chunk] : nullptr;
+            PairHistogram *histogramOfChunk = histogram ? & partialHistograms[chunk] : nullptr;
+            for(size_t c0 = begin; c0 < end; ++c0)
+                computeCellForces(der, derBuffers, state, active, c0, observablesOfChunk, histogramOfChunk);
+        }
+    });
+
+    for(size_t chunk = 0; observables && chunk < nChunks; ++chunk)
+        *observables += partialObservables[chunk];
+    for(size_t chunk = 0; histogram && chunk < nChunks; ++chunk)
+        *histogram += partialHistograms[chunk];
+}
+
 void UniverseDifferentiator::computeForcesOneThread(UniverseState &der, UniverseBuffers &derBuffers,
-        const UniverseState &state, AtomicCounter &counter) const {
-    assert(! state.state.empty());
-
-    struct OtherCell { UniverseState &other; int x; int y; };
-    std::array<OtherCell, 5> cells = {
-            OtherCell{der, 0, 0},
-            OtherCell{derBuffers[0], 1, 0},
-            OtherCell{derBuffers[1], -1, 1},
-            OtherCell{derBuffers[2], 0, 1},
-            OtherCell{derBuffers[3], 1, 1},
-    };
+        const UniverseState &state, const ParticleMask *active, AtomicCounter &counter,
+        ObservableGrid *observables, PairHistogram *histogram) const {
+    ProfileSpan span("forces", true);
+    for (int c0 = counter.next(); c0 < counter.total(); c0 = counter.next()) {
+        ProfileSpan boxSpan("box", false, c0, state.cells[c0].particles.size());
+        computeCellForces(der, derBuffers, state, active, c0, observables, histogram);
+    }
+}
+
+void UniverseDifferentiator::computeCellForces(UniverseState &der, UniverseBuffers &derBuffers,
+        const UniverseState &state, const ParticleMask *active, int c0,
+        ObservableGrid *observables, PairHistogram *histogram) const {
+    // If active is given, only interactions involving at least one selected particle are computed.
+    // If observables or histogram are given, they are accumulated for the computed particles and interactions.
 
-    const int sizeX = state.state[0].size();
-    for (int idx = counter.next(); idx < counter.total(); idx = counter.next()) {
-        int y0 = idx / sizeX;
-        int x0 = idx % sizeX;
-        for (size_t i0 = 0; i0 < state.state[y0][x0].size(); ++i0) { // Compute forces by edges and gravity
-            const auto &pState0 = state.state[y0][x0][i0];
-            auto &pDer0 = der.state[y0][x0][i0];
-            pDer0.v.x += boundForce(-pState0.pos.x);
-            pDer0.v.x -= boundForce(pState0.pos.x - config.sizeX);
-            pDer0.v.y += boundForce(-pState0.pos.y);
-            pDer0.v.y -= boundForce(pState0.pos.y - config.sizeY);
-            pDer0.v.y += config.gravity * pState0.type->getMass();
+    const auto &particles0 = state.cells[c0].particles;
+    auto &ders0 = der.cells[c0].particles;
+    for (size_t i0 = 0; i0 < particles0.size(); ++i0) { // Compute forces by edges and gravity
+        if (active && ! active->flags[c0][i0])
+            continue;
+        const auto &pState0 = particles0[i0];
+        auto &pDer0 = ders0[i0];
+        pDer0.v.x += boundForce(-pState0.pos.x);
+        pDer0.v.x -= boundForce(pState0.pos.x - config.sizeX);
+        pDer0.v.y += boundForce(-pState0.pos.y);
+        pDer0.v.y -= boundForce(pState0.pos.y - config.sizeY);
+        pDer0.v.y += config.gravity * pState0.type->getMass();
+
+        if (observables) {
+            ObservableBin &bin = observables->at(pState0.pos);
+            double mass = pState0.type->getMass();
+            ++bin.n;
+            bin.mass += mass;
+            bin.momentum += pState0.v * mass;
+            bin.kineticEnergy += pState0.v.magnitude2() * mass / 2;
         }
+        if (histogram)
+            histogram->typeCounts[typeIndex(pState0)] += 1;
+    }
 
-        for (size_t cellIdx = 0; cellIdx < cells.size(); ++cellIdx) { // Compute interaction forces
-            OtherCell &cell = cells[cellIdx];
-            int y1 = y0 + cell.y;
-            int x1 = x0 + cell.x;
-            if (y1 < 0 || x1 < 0 || y1 >= state.state.size() || x1 >= state.state[y1].size())
-                continue;
+    for (size_t cellIdx = 0; cellIdx < stencil.size(); ++cellIdx) { // Compute interaction forces
+        const StencilCell &cell = stencil[cellIdx];
+        int c1 = state.cellIndex(state.cells[c0].x + cell.x, state.cells[c0].y + cell.y);
+        if (c1 < 0)
+            continue;
+        if (active && ! active->cellCounts[c0] && ! active->cellCounts[c1])
+            continue;
+
+        const auto &particles1 = state.cells[c1].particles;
+        auto &ders1 = der.cells[c1].particles; // Used only for the box itself, the others use buffers
+        Vector2D *forces1 = cellIdx == 0 ? nullptr : &derBuffers.forces[cellIdx - 1][derBuffers.offsets[c1]];
+        for (size_t i0 = 0; i0 < particles0.size(); ++i0) {
+            const auto &pState0 = particles0[i0];
+            auto &pDer0 = ders0[i0];
+            bool active0 = ! active || active->flags[c0][i0];
+            const double *ranges0 = &pairRanges[types.size() * typeIndex(pState0)];
+            size_t maxI1 = cellIdx == 0 ? i0 : particles1.size();
+            for (size_t i1 = 0; i1 < maxI1; ++i1) {
+                if (! active0 && ! active->flags[c1][i1])
+                    continue;
+                const auto &pState1 = particles1[i1];
+                double range = ranges0[typeIndex(pState1)];
+                if (range <= cell.minDist) // Type pair can't interact at this distance
+                    continue;
+                double dist2 = distance2(pState0.pos, pState1.pos);
+                if (dist2 >= range * range)
+                    continue;
+                Vector2D f = pState0.computeForce(pState1);
+                pDer0.v += f;
+                if (forces1) forces1[i1] -= f;
+                else ders1[i1].v -= f;
+
+                if (observables) { // Split half and half between the bins of the particles
+                    Vector2D d = pState0.pos - pState1.pos;
+                    double potential = pairPotential(types.size() * typeIndex(pState0) + typeIndex(pState1),
+                            d.magnitude()) / 2;
+                    double virial = dotProduct(d, f) / 2;
+                    ObservableBin &bin0 = observables->at(pState0.pos), &bin1 = observables->at(pState1.pos);
+                    bin0.potentialEnergy += potential;
+                    bin0.virial += virial;
+                    bin1.potentialEnergy += potential;
+                    bin1.virial += virial;
+                }
+                if (histogram)
+                    histogram->addPair(typeIndex(pState0), typeIndex(pState1), std::sqrt(dist2));
+            }
+        }
+    }
+}
 
-            for (size_t i0 = 0; i0 < state.state[y0][x0].size(); ++i0) {
-                const auto &pState0 = state.state[y0][x0][i0];
-                auto &pDer0 = der.state[y0][x0][i0];
-                size_t maxI1 = cellIdx == 0 ? i0 : state.state[y1][x1].size();
+PairCounts UniverseDifferentiator::countPairs(const UniverseState &state) const {
+    PairCounts counts;
+    for (size_t c0 = 0; c0 < state.cells.size(); ++c0) {
+        const auto &particles0 = state.cells[c0].particles;
+        for (size_t cellIdx = 0; cellIdx < stencil.size(); ++cellIdx) {
+            const StencilCell &cell = stencil[cellIdx];
+            int c1 = state.cellIndex(state.cells[c0].x + cell.x, state.cells[c0].y + cell.y);
+            if (c1 < 0)
+                continue;
+            const auto &particles1 = state.cells[c1].particles;
+            for (size_t i0 = 0; i0 < particles0.size(); ++i0) {
+                size_t maxI1 = cellIdx == 0 ? i0 : particles1.size();
                 for (size_t i1 = 0; i1 < maxI1; ++i1) {
-                    const auto &pState1 = state.state[y1][x1][i1];
-                    auto &pDer1 = cell.other.state[y1][x1][i1];
-                    Vector2D f = pState0.computeForce(pState1);
-                    pDer0.v += f;
-                    pDer1.v -= f;
+                    double range = pairRanges[types.size() * typeIndex(particles0[i0]) + typeIndex(particles1[i1])];
+                    if (range <= cell.minDist)
+                        continue;
+                    ++counts.candidates;
+                    counts.inRange += distance2(particles0[i0].pos, particles1[i1].pos) < range * range;
                 }
             }
         }
     }
+    return counts;
+}
+
+double UniverseDifferentiator::pairPotential(size_t pair, double d) const {
+    // Linear interpolation of the sampled potential
+    double t = d / pairRanges[pair] * potentialSamples;
+    if(t >= potentialSamples) return 0;
+    int i = (int) t;
+    const double *potentials = &pairPotentials[pair * (potentialSamples + 1)];
+    return potentials[i] + (potentials[i + 1] - potentials[i]) * (t - i);
 }
 
 double UniverseDifferentiator::boundForce(double overEdge) const {
@@ -232,40 +721,441 @@ double UniverseDifferentiator::boundForce(double overEdge) const {
     return config.forceFactor * overEdge * overEdge * overEdge * overEdge;
 }
 
-void UniverseDifferentiator::forcesToAccel(UniverseState &der, const UniverseBuffers &derBuffers) const {
-    for(size_t y = 0; y < der.state.size(); ++y)
-        for(size_t x = 0; x < der.state[y].size(); ++x)
-            for(size_t i = 0; i < der.state[y][x].size(); ++i) {
-                auto &pDer = der.state[y][x][i];
-                for(const UniverseState &buffer: derBuffers) {
-                    auto &pDerCache = buffer.state[y][x][i];
-                    pDer.v += pDerCache.v;
-                }
-                pDer.v *= 1. / pDer.type->getMass();
-            }
+void UniverseDifferentiator::forcesToAccel(UniverseState &der, const UniverseBuffers &derBuffers,
+        const ParticleMask *active) const {
+    for(size_t c = 0; c < der.cells.size(); ++c)
+        for(size_t i = 0; i < der.cells[c].particles.size(); ++i) {
+            if(active && ! active->flags[c][i])
+                continue;
+            auto &pDer = der.cells[c].particles[i];
+            size_t offset = derBuffers.offsets[c] + i;
+            for(const auto &forces: derBuffers.forces)
+                pDer.v += forces[offset];
+            pDer.v *= 1. / pDer.type->getMass();
+        }
 }
 
-Universe::Universe(const UniverseConfig &_config, const std::vector<ParticleType> &_types):
-        diff(_config, _types) {
-    double interDist = 0;
-    for(const auto &type: _types) {
-        interDist = std::max(interDist, type.getRange());
+void UniverseDifferentiator::addLongRangeForces(UniverseState &der, const UniverseState &state,
+        const ParticleMask *active, ObservableGrid *observables) const {
+    if(config.longRangeCoupling == 0) return;
+    ProfileSpan span("longRange", true);
+    longRangeTree.build(state);
+    if(longRangeTree.getNodes().empty()) return; // No charges
+
+    // Each box is written by one thread. Potential energies are added to the observables afterwards in box order,
+    // so that the sums don't depend on the number of threads.
+    if(observables) {
+        longRangeOffsets.resize(state.cells.size() + 1);
+        longRangeOffsets[0] = 0;
+        for(size_t c = 0; c < state.cells.size(); ++c)
+            longRangeOffsets[c + 1] = longRangeOffsets[c] + state.cells[c].particles.size();
+        longRangeObservations.assign(longRangeOffsets.back(), { 0, 0 });
+    }
+    parallelForCounter(config.threads, state.cells.size(), [&](AtomicCounter &counter) {
+        for(size_t c = counter.next(); c < counter.total(); c = counter.next()) {
+            if(active && ! active->cellCounts[c]) continue;
+            const auto &particles = state.cells[c].particles;
+            for(size_t i = 0; i < particles.size(); ++i) {
+                double q = particles[i].type->getCharge();
+                if(q == 0 || (active && ! active->flags[c][i])) continue;
+                Vector2D field;
+                double potential;
+                longRangeTree.field(state, particles[i], config.openingAngle, config.longRangeSoftening,
+                        field, potential);
+                Vector2D force = field * (config.longRangeCoupling * q);
+                der.cells[c].particles[i].v += force;
+                // Sum of dot(r_i, F_i) equals the virial sum over pairs for pairwise forces
+                if(observables) longRangeObservations[longRangeOffsets[c] + i] = { config.longRangeCoupling * q * potential,
+                        particles[i].pos.x * force.x + particles[i].pos.y * force.y };
+            }
+        }
+    });
+
+    if(! observables) return;
+    for(size_t c = 0; c < state.cells.size(); ++c) {
+        if(active && ! active->cellCounts[c]) continue;
+        const auto &particles = state.cells[c].particles;
+        for(size_t i = 0; i < particles.size(); ++i) {
+            ObservableBin &bin = observables->at(particles[i].pos);
+            const LongRangeObservation &observation = longRangeObservations[longRangeOffsets[c] + i];
+            bin.potentialEnergy += 0.5 * observation.potentialEnergy; // Half of each pair
+            bin.virial += observation.virial;
+        }
     }
+}
 
-    state.setInteractionDistance(_config, interDist);
+Universe::Universe(const UniverseConfig &_config, const std::vector<ParticleType> &_types):
+        diff(_config, _types), blockTimestepsWorkspace(new BlockTimestepsWorkspace), commands(new CommandQueue) {
+    state.setInteractionDistance(_config, diff.cellSize);
 }
 
+Universe::Universe(Universe &&) = default;
+Universe::~Universe() = default;
+
 void Universe::addParticle(int typeIndex, ParticleState pState) {
     pState.type = & diff.types[typeIndex];
+    pState.id = nextParticleId++;
+    wake(pState.pos, diff.maxRange); // The new particle exerts forces on its neighbours
     state.insert(pState);
 }
 
+void Universe::addParticles(std::vector<ParticleState> &particles) {
+    for(ParticleState &pState: particles) {
+        assert(pState.type >= diff.types.data() && pState.type < diff.types.data() + diff.types.size());
+        pState.id = nextParticleId++;
+    }
+
+    // One wake pass over the boxes within the interaction range of the boxes the new particles land in
+    if(sleepConfig.steps > 0 && sleepingParticles > 0) {
+        int reach = (int) std::ceil(diff.maxRange / state.sizePerBlock);
+        CellIndex landed;
+        for(const ParticleState &pState: particles) {
+            int x = std::max(0, std::min(state.cellsX - 1, (int) (pState.pos.x / state.sizePerBlock)));
+            int y = std::max(0, std::min(state.cellsY - 1, (int) (pState.pos.y / state.sizePerBlock)));
+            if(landed.find(cellKey(x, y, state.cellsX)) >= 0) continue;
+            landed.insert(cellKey(x, y, state.cellsX), 0);
+            for(int wy = std::max(0, y - reach); wy <= std::min(state.cellsY - 1, y + reach); ++wy)
+                for(int wx = std::max(0, x - reach); wx <= std::min(state.cellsX - 1, x + reach); ++wx)
+                    wakeBox(wx, wy);
+        }
+    }
+    state.insert(particles.data(), particles.size(), diff.config.threads);
+}
+
 void Universe::removeParticle(int index) {
-    state.state.erase(state.state.begin() + index);
+    auto it = state.begin();
+    for(int i = 0; i < index; ++i) ++it;
+    state.erase(it);
 }
 
 void Universe::advance(double dT) {
-    advanceRungeKutta4<UniverseState, UniverseDifferentiator, UniverseBuffers>(state, diff, dT);
+    ProfileSpan span("step", true);
+    applyCommands();
+    beginObservation();
+    if(diff.config.maxTimestepLevel > 0) {
+        if(sleepingParticles) wakeAll();
+        advanceBlockTimesteps(state, diff, dT, *blockTimestepsWorkspace);
+    } else {
+        advanceRungeKutta4(state, diff, dT, workspace);
+        if(sleepConfig.steps > 0) updateSleep(dT);
+    }
+    time += dT;
+    endStep(dT);
+}
+
+void Universe::enableSleeping(const SleepConfig &config) {
+    sleepConfig = config;
+    if(config.steps <= 0) wakeAll();
+}
+
+void Universe::wake(const Vector2D &pos, double radius) {
+    if(sleepConfig.steps <= 0 || sleepingParticles == 0) return;
+    // Only the boxes overlapping the bounding square of the circle are visited
+    double size = state.sizePerBlock;
+    int minX = std::max(0, (int) std::floor((pos.x - radius) / size));
+    int maxX = std::min(state.cellsX - 1, (int) std::floor((pos.x + radius) / size));
+    int minY = std::max(0, (int) std::floor((pos.y - radius) / size));
+    int maxY = std::min(state.cellsY - 1, (int) std::floor((pos.y + radius) / size));
+    for(int y = minY; y <= maxY; ++y)
+        for(int x = minX; x <= maxX; ++x) {
+            // Distance from pos to the box
+            double dx = std::max(std::max(x * size - pos.x, pos.x - (x + 1) * size), 0.);
+            double dy = std::max(std::max(y * size - pos.y, pos.y - (y + 1) * size), 0.);
+            if(dx * dx + dy * dy < radius * radius) wakeBox(x, y);
+        }
+}
+
+void Universe::wakeBox(int x, int y) {
+    int idx = state.cellIndex(x, y);
+    if(idx < 0) return;
+    for(auto &pState: state.cells[idx].particles) {
+        if(! pState.asleep) continue;
+        pState.asleep = false;
+        pState.quietSteps = 0;
+        --sleepingParticles;
+    }
+}
+
+void Universe::wakeAll() {
+    for(auto &pState: state) {
+        pState.asleep = false;
+        pState.quietSteps = 0;
+    }
+    sleepingParticles = 0;
+}
+
+void Universe::updateSleep(double dT) {
+    ProfileSpan span("sleep", true);
+    const UniverseState &initial = workspace.xInitial; // Same layout as state, particles haven't been rebinned
+    const int steps = std::min(sleepConfig.steps, (int) std::numeric_limits<uint16_t>::max() - 1);
+    int reach = 0;
+    for(const auto &stencilCell: diff.stencil)
+        reach = std::max(reach, std::max(std::abs(stencilCell.x), std::abs(stencilCell.y)));
+
+    // Boxes with an awake particle above a threshold disturb all boxes within the interaction range
+    disturbed.assign(state.cells.size(), 0);
+    for(size_t c = 0; c < state.cells.size(); ++c) {
+        auto &particles = state.cells[c].particles;
+        bool active = false;
+        for(size_t i = 0; i < particles.size(); ++i) {
+            ParticleState &pState = particles[i];
+            if(pState.asleep) {
+                pState.quietSteps = std::min(pState.quietSteps + 1, steps);
+                continue;
+            }
+            double acceleration = (pState.v - initial.cells[c].particles[i].v).magnitude() / dT;
+            bool quiet = pState.v.magnitude() < sleepConfig.maxVelocity && acceleration < sleepConfig.maxAcceleration;
+            pState.quietSteps = quiet ? std::min(pState.quietSteps + 1, steps) : 0;
+            active |= ! quiet;
+        }
+        if(! active) continue;
+        for(int y = state.cells[c].y - reach; y <= state.cells[c].y + reach; ++y)
+            for(int x = state.cells[c].x - reach; x <= state.cells[c].x + reach; ++x) {
+                int idx = state.cellIndex(x, y);
+                if(idx >= 0) disturbed[idx] = 1;
+            }
+    }
+
+    sleepingParticles = 0;
+    for(size_t c = 0; c < state.cells.size(); ++c) {
+        auto &particles = state.cells[c].particles;
+        bool anyAsleep = false, checkDue = false, allQuiet = ! particles.empty();
+        for(const ParticleState &pState: particles) {
+            if(pState.asleep) {
+                anyAsleep = true;
+                checkDue |= pState.quietSteps >= steps;
+            } else {
+                allQuiet &= pState.quietSteps >= steps;
+            }
+        }
+
+        if(anyAsleep && (disturbed[c] || checkDue)) {
+            // A box woken for a check falls asleep again after one more quiet step
+            for(ParticleState &pState: particles) {
+                if(! pState.asleep) continue;
+                pState.asleep = false;
+                pState.quietSteps = disturbed[c] ? 0 : steps - 1;
+            }
+        } else if(! anyAsleep && allQuiet && ! disturbed[c]) {
+            for(ParticleState &pState: particles) {
+                pState.asleep = true;
+                pState.v = Vector2D(0, 0);
+                pState.quietSteps = 0;
+            }
+        }
+        for(const ParticleState &pState: particles)
+            sleepingParticles += pState.asleep;
+    }
+}
+
+void Universe::applyCommands() {
+    if(! commands->drain(drainedCommands)) return;
+    ProfileSpan span("commands", true);
+
+    for(size_t i = 0; i < drainedCommands.size();) {
+        const UniverseCommand &command = drainedCommands[i];
+        if(command.type == CommandType::add) {
+            addParticle(command.particleType, ParticleState(clampInto(command.pos), command.v));
+            ++i;
+            continue;
+        }
+        if(command.type == CommandType::setThermostats) {
+            thermostats = command.thermostats;
+            ++i;
+            continue;
+        }
+
+        // Consecutive region commands are applied in a single pass over the particles
+        size_t end = i;
+        while(end < drainedCommands.size() && drainedCommands[end].type != CommandType::add
+                && drainedCommands[end].type != CommandType::setThermostats)
+            ++end;
+        // Removing or pushing particles also changes the forces on their neighbours within the interaction range
+        for(size_t j = i; j < end; ++j)
+            wake(drainedCommands[j].pos, drainedCommands[j].radius + diff.maxRange);
+        for(auto it = state.begin(); it != state.end();) {
+            bool removed = false;
+            for(size_t j = i; j < end && ! removed; ++j) {
+                const UniverseCommand &region = drainedCommands[j];
+                if(! region.affects(it->pos)) continue;
+                if(region.type == CommandType::removeInRadius) removed = true;
+                if(region.type == CommandType::impulse) it->v += region.v;
+                if(region.type == CommandType::heat) it->v *= region.factor;
+            }
+            if(removed) it = state.erase(it);
+            else ++it;
+        }
+        i = end;
+    }
+    drainedCommands.clear();
+}
+
+void Universe::observe(double binSize, size_t maxSamples) {
+    observationBinSize = binSize;
+    maxObservations = std::max(maxSamples, (size_t) 1);
+    while(observations.size() > maxObservations) observations.pop_front();
+    if(binSize <= 0) observations.clear();
+}
+
+void Universe::beginObservation() {
+    // Samples are filled in by the first force computation of the step
+    if(measuringRadialDistribution)
+        diff.histogramNext = & radialDistribution.beginSample();
+    if(observationBinSize <= 0) return;
+    // Once the history is full, the oldest sample is rotated to the back and its grid reused
+    if(observations.size() < maxObservations) observations.emplace_back();
+    else std::rotate(observations.begin(), observations.begin() + 1, observations.end());
+    observations.back().time = time;
+    ObservableGrid &grid = observations.back().grid;
+    grid.reset(diff.config.sizeX, diff.config.sizeY, observationBinSize);
+    diff.observeNext = & grid;
+}
+
+void Universe::measureRadialDistribution(double binWidth, size_t window) {
+    measuringRadialDistribution = binWidth > 0;
+    if(! measuringRadialDistribution) return;
+    double maxRange = *std::max_element(diff.pairRanges.begin(), diff.pairRanges.end());
+    radialDistribution.reset(diff.types.size(), maxRange, binWidth, window,
+            (double) diff.config.sizeX * diff.config.sizeY);
+}
+
+void Universe::writeRadialDistribution(std::ostream &out) const {
+    double minRange = *std::min_element(diff.pairRanges.begin(), diff.pairRanges.end());
+    radialDistribution.write(out, minRange);
+}
+
+void Universe::analysePhases(const PhaseAnalysisConfig &config, size_t maxSamples) {
+    phaseConfig = config;
+    maxPhaseSamples = std::max(maxSamples, (size_t) 1);
+    stepsSinceAnalysis = 0;
+    if(config.interval <= 0) phaseSamples.clear();
+}
+
+void Universe::setThermostats(const std::vector<Thermostat> &_thermostats, uint32_t seed) {
+    thermostats = _thermostats;
+    thermostatSeed = seed;
+}
+
+void Universe::endStep(double dT) {
+    if(measuringRadialDistribution)
+        radialDistribution.endSample();
+    if(! thermostats.empty()) {
+        ProfileSpan span("thermostats", true);
+        applyThermostats(state, diff.config, thermostats, thermostatSeed, steps, dT, thermostatWorkspace);
+    }
+    ++steps;
+
+    if(phaseConfig.interval > 0 && ++stepsSinceAnalysis >= phaseConfig.interval) {
+        ProfileSpan span("phaseAnalysis", true);
+        stepsSinceAnalysis = 0;
+        state.prepareDifferentiation(); // Puts the particles that moved during the step into their boxes
+        if(phaseSamples.size() >= maxPhaseSamples) phaseSamples.pop_front();
+        phaseSamples.push_back(::analysePhases(state, diff, phaseConfig));
+        phaseSamples.back().time = time;
+    }
+
+    rewindBuffer.afterStep(state, time, steps);
+    if(snapshotWriter && steps % snapshotInterval == 0)
+        publishSnapshot();
+}
+
+void Universe::enableRewind(size_t maxPoints, uint64_t interval) {
+    rewindBuffer.reset(maxPoints, interval);
+}
+
+bool Universe::rewind(size_t pointsBack) {
+    bool rewound = false;
+    for(size_t i = 0; i < pointsBack; ++i) {
+        // Later points belong to a discarded future. The point of the current step is kept if the universe was
+        // edited after it was recorded, as restoring it undoes the edit.
+        while(rewindBuffer.size() > 0 && (rewindBuffer.newest().steps > steps
+                || (rewindBuffer.newest().steps == steps && rewindBuffer.newest().matches(state))))
+            rewindBuffer.dropNewest();
+        if(rewindBuffer.size() == 0) break;
+
+        const RewindPoint &point = rewindBuffer.newest();
+        point.restore(state);
+        time = point.time;
+        steps = point.steps;
+        rewound = true;
+    }
+
+    // Samples of the discarded future are dropped. Observations are taken before a step, so the one of the restored
+    // time is taken again by the next step.
+    while(rewound && ! observations.empty() && observations.back().time >= time)
+        observations.pop_back();
+    while(rewound && ! phaseSamples.empty() && phaseSamples.back().time > time)
+        phaseSamples.pop_back();
+    if(rewound) wakeAll(); // Sleep is tracked from the current trajectory
+    return rewound;
+}
+
+void Universe::publishSnapshots(std::shared_ptr<SnapshotWriter> writer, uint64_t interval) {
+    snapshotWriter = writer;
+    snapshotInterval = std::max(interval, (uint64_t) 1);
+}
+
+void Universe::publishSnapshot() {
+    ProfileSpan span("snapshot", true);
+    // Particles are written straight into the shared memory slot
+    SnapshotParticle *particles = snapshotWriter->begin(time, steps);
+    size_t count = 0, capacity = snapshotWriter->capacity();
+    for(const auto &cell: state.cells)
+        for(const auto &pState: cell.particles) {
+            if(count < capacity)
+                particles[count] = { pState.id, (uint8_t) (pState.type - diff.types.data()), (uint8_t) pState.phase, 0,
+                        pState.pos.x, pState.pos.y, pState.v.x, pState.v.y };
+            ++count;
+        }
+    snapshotWriter->commit(count, count);
+}
+
+uint64_t Universe::stateHash() const {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](double value) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(& value);
+        for(size_t i = 0; i < sizeof(value); ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    for(const auto &cell: state.cells)
+        for(const auto &pState: cell.particles) {
+            add(pState.pos.x);
+            add(pState.pos.y);
+            add(pState.v.x);
+            add(pState.v.y);
+        }
+    return hash;
+}
+
+double Universe::maxVelocity() const {
+    double maxVelocity2 = 0;
+    for(const auto &cell: state.cells)
+        for(const auto &pState: cell.particles)
+            maxVelocity2 = std::max(maxVelocity2, pState.v.magnitude2());
+    return std::sqrt(maxVelocity2);
+}
+
+void Universe::advanceAdaptive(double duration, AdaptiveStepControl &control) {
+    // Advances by exactly duration. If the last step has to be shortened to not overshoot, the step size
+    // planned before it is restored afterwards.
+    double t = 0;
+    while(duration - t > 1e-9 * duration) {
+        double planned = control.dT;
+        bool shortened = planned > duration - t;
+        if(shortened) control.dT = duration - t;
+
+        ProfileSpan span("step", true);
+        size_t rejectedBefore = control.rejected;
+        applyCommands();
+        beginObservation();
+        if(sleepingParticles) wakeAll();
+        double stepDT = advanceDormandPrince(state, diff, control, workspace);
+        t += stepDT;
+        time += stepDT;
+        endStep(stepDT);
+        if(shortened && control.rejected == rejectedBefore)
+            control.dT = std::max(control.dT, planned);
+    }
 }
 
 Vector2D Universe::clampInto(const Vector2D &pos) {
@@ -2,10 +2,23 @@
 #define __UNIVERSE_H__
 
 #include <array>
+#include <deque>
 #include <vector>
+#include <memory>
+#include <unordered_map>
 #include "Lib/Particle.h"
 #include "Lib/AtomicCounter.h"
 #include "Lib/ThreadPool.h"
+#include "Lib/Integrators.h"
+#include "Lib/Observables.h"
+#include "Lib/PhaseAnalysis.h"
+#include "Lib/RadialDistribution.h"
+#include "Lib/Thermostat.h"
+#include "Lib/CommandQueue.h"
+#include "Lib/SnapshotRing.h"
+#include "Lib/Rewind.h"
+#include "Lib/LongRange.h"
+#include "Lib/HugePages.h"
 
 /*
  * Universe handles the creation and destruction of particles and provides methods for iterating over them.
@@ -16,34 +29,112 @@
  * UniverseState. Internally, UniverseState and -Differentiator hold their particles as put into a grid of
  * boxes. This allows checking interactions only between particles at nearby boxes, thus speeding up computations.
  *
+ * The boxes (UniverseCell) are stored in a flat list. In dense mode the list contains every box of the grid in row
+ * major order. In sparse mode it contains only the occupied boxes sorted in the same order, and a hash table from
+ * box coordinates to list index (CellIndex) is used for finding neighbours. Sparse mode is selected automatically in
+ * prepareDifferentiation() when only a small fraction of boxes is occupied, so that the cost of a step is
+ * proportional to the number of occupied boxes instead of the size of the universe.
+ *
+ * Steps don't allocate memory once the buffers have grown to their working sizes: particle buffers grow
+ * geometrically, buffers of boxes that are removed are kept as spares for new boxes, workspaces of the integrators
+ * and thermostats persist between steps, and parallel loops start the workers without allocating (see Parallel.h).
+ *
  * Each box of the UniverseState is processed single-threadedly, and parallelization is achieved by
  * concurrently processing several boxes. Also, in order to save time, it is appropriate to compute
  * each interaction only once. These requirements however create a race condition, because thread 1 writing
  * to box 1 must also write to box 2, which thread 2 might be writing to at the same time. This problem
  * is eliminated by adding a few more accumulation buffers (UniverseBuffers), each of which can only be
- * written from a box at a pose relative to destination box. See UniverseDifferentiator::computeForcesOneThread
- * for details (Relative poses are set by std::array<OtherCell>).
+ * written from a box at a pose relative to destination box. See UniverseDifferentiator::computeCellForces
+ * for details (Relative poses are set by UniverseDifferentiator::stencil). As every accumulator is written from
+ * a single box in a fixed order, forces don't depend on the number of threads or on which thread gets which box.
+ * Observables are summed over many boxes, which is made independent of threads with UniverseConfig::deterministic.
+ *
+ * By default the size of a box equals the largest interaction range, so that the stencil consists of the box
+ * itself and 4 of its neighbours. With UniverseConfig::cellsPerRange > 1, boxes are smaller and the stencil
+ * grows to a half-shell of all boxes closer than the interaction range. This reduces the number of candidate
+ * pairs outside of the interaction range, but needs one buffer per stencil box.
+ *
+ * Observables (energies, virial) and pair distance histograms are optionally accumulated while forces are computed,
+ * see Universe::observe() and Universe::measureRadialDistribution().
+ *
+ * With UniverseConfig::longRangeCoupling, charged particle types additionally feel a long-range force, which is
+ * evaluated with a Barnes-Hut tree over the boxes after the short-range forces (see LongRange.h).
+ *
+ * Particles can be asleep (see Universe::enableSleeping()). Forces are computed only for awake particles and
+ * their pairs, sleeping particles still exert forces on awake ones, and their derivative is zero.
  */
 
-class UniverseState;
-typedef std::array<UniverseState, 4> UniverseBuffers;
+// Force accumulators for all but the first stencil box. Forces of a box's particles are stored contiguously,
+// starting from offsets[box index], so that buffers can be cleared and summed without per-box overhead.
+// Large accumulators are backed by huge pages (see HugePages.h).
+struct UniverseBuffers {
+    std::vector<size_t> offsets;
+    std::vector<std::vector<Vector2D, HugePageAllocator<Vector2D>>> forces;
+};
 
 struct UniverseConfig {
     int sizeX, sizeY;
     double forceFactor, gravity;
+    int maxTimestepLevel = 0; // If positive, advance() uses block timesteps of up to 2^maxTimestepLevel substeps
+    double timestepAccuracy = 0.05;
+    int cellsPerRange = 1; // Box size is the maximum interaction range divided by cellsPerRange
+    int threads = 0; // Threads computing forces, 0 means one per hardware thread. 1 doesn't use the thread pool.
+    bool deterministic = false; // Sums of observables and histograms don't depend on the number of threads
+    double longRangeCoupling = 0; // Of the long-range force between charges, 0 disables it (see LongRange.h)
+    double openingAngle = 0.5; // Barnes-Hut accuracy of the long-range force, 0 is direct summation
+    double longRangeSoftening = 4; // Distance below which the long-range force is softened
+};
+
+// Boxes fall asleep when all of their particles have stayed below both thresholds for steps steps, and nothing
+// within the interaction range moves faster or accelerates more. steps 0 disables sleeping.
+struct SleepConfig {
+    double maxVelocity = 0.01, maxAcceleration = 1e-3;
+    int steps = 0;
+};
+
+struct UniverseCell {
+    int x = 0, y = 0;
+    std::vector<ParticleState> particles;
+};
+
+// Maps keys of boxes to their indices in UniverseState::cells. Open addressing in a flat table, so that clearing,
+// refilling and copying it reuse its memory.
+class CellIndex {
+public:
+    void clear(size_t expectedSize); // Keeps at least twice as many slots as expectedSize
+    void insert(long long key, int idx);
+    int find(long long key) const; // -1 if there's no such key
+
+private:
+    void rehash(size_t nSlots);
+
+    std::vector<std::pair<long long, int>> slots; // Number of slots is a power of 2, key -1 marks a free slot
+    size_t size = 0;
 };
 
 struct UniverseState {
-    std::vector<std::vector<std::vector<ParticleState>>> state;
+    std::vector<UniverseCell> cells;
+    int cellsX = 0, cellsY = 0; // Dimensions of the grid
+    bool sparse = true;
+    bool appendedCells = false; // Boxes were appended in sparse mode since the cells were last sorted
+    CellIndex sparseIndex;
     size_t size_ = 0;
     double sizePerBlock = 1;
 
+    // Particle buffers of removed boxes, handed to new boxes, and particles changing boxes, so that the layout can
+    // change without allocating once the buffers have grown to their working sizes
+    std::vector<std::vector<ParticleState>> spareBuffers;
+    std::vector<ParticleState> leaving;
+
     void setInteractionDistance(const UniverseConfig &config, double dist);
     void prepareDifferentiation();
+    void copyLayout(const UniverseState &rhs); // Copies everything except the particles
     UniverseState & operator=(const UniverseState &rhs);
     UniverseState & operator+=(const UniverseState &rhs);
     UniverseState & operator*=(double rhs);
     size_t size() const { return size_; }
+    int cellIndex(int x, int y) const; // Index in cells, or -1 if there's no such cell
+    void resizeCells(size_t n); // Keeps the particle buffers of removed boxes as spares
 
     class iterator {
     public:
@@ -55,8 +146,7 @@ struct UniverseState {
         iterator & normalize();
     
         UniverseState *obj = nullptr;
-        std::vector<std::vector<std::vector<ParticleState>>>::iterator itY;
-        std::vector<std::vector<ParticleState>>::iterator itX;
+        std::vector<UniverseCell>::iterator itC;
         std::vector<ParticleState>::iterator itI;
     };
 
@@ -64,46 +154,218 @@ struct UniverseState {
     iterator end();
 
     void insert(const ParticleState &state);
+    void insert(const ParticleState &state, int x, int y); // Into the given cell regardless of position
+    // Counting sort by box on the given threads (0 means one per hardware thread), see Universe::addParticles()
+    void insert(const ParticleState *particles, size_t n, int threads = 1);
     iterator erase(iterator it);
+
+private:
+    int findOrAddCell(int x, int y); // New boxes are appended in sparse mode
+    void toDense();
+    void toSparse();
+    void rebuildSparseIndex();
+};
+
+double integrationError(const UniverseState &error); // Maximum absolute position/velocity component
+
+// ParticleMask selects particles of an UniverseState with the same layout. cellCounts holds selected particles per cell.
+struct ParticleMask {
+    std::vector<std::vector<char>> flags;
+    std::vector<int> cellCounts;
+
+    void resize(const UniverseState &state);
+};
+
+struct PairCounts {
+    size_t candidates = 0; // Pairs of particles in stencil boxes, whose distance is checked
+    size_t inRange = 0; // Pairs closer than their interaction range
 };
 
 struct UniverseDifferentiator {
+    // Relative pose of a box whose interactions are computed. minDist is a lower bound of distances between
+    // particles of the two boxes.
+    struct StencilCell { int x, y; double minDist; };
+
     UniverseConfig config;
     std::vector<ParticleType> types;
+    double cellSize;
+    double maxRange; // Largest interaction range of the types
+    std::vector<StencilCell> stencil; // Starts with the box itself, then half of its neighbours
+    std::vector<double> pairRanges; // Interaction ranges of type pairs, indexed by types.size() * type0 + type1
+    std::vector<double> pairPotentials; // potentialSamples + 1 potentials over the range of each type pair
+
+    // If set, the next force computation also accumulates observables into it and clears the pointer. All integrators
+    // start a step with a full force computation at the initial state, so this measures the state before the step.
+    mutable ObservableGrid *observeNext = nullptr;
+    mutable PairHistogram *histogramNext = nullptr; // Same for pair distances
+    mutable BarnesHutTree longRangeTree; // Rebuilt before each force computation with the long-range force
+    struct LongRangeObservation { double potentialEnergy, virial; };
+    mutable std::vector<LongRangeObservation> longRangeObservations; // Per particle in box order, while observing
+    mutable std::vector<size_t> longRangeOffsets; // Index of each box's first particle in longRangeObservations
+    // Accumulators of each thread or deterministic chunk while observing, kept across steps so they don't allocate
+    mutable std::vector<ObservableGrid> partialObservables;
+    mutable std::vector<PairHistogram> partialHistograms;
+    mutable ParticleMask awake; // Selects the awake particles while some are asleep
 
     UniverseDifferentiator(const UniverseConfig &config, std::vector<ParticleType> _types);
     void prepareDifferentiation(UniverseState &state) const; // Has to be called once before every iteration
     void derivative(UniverseState &der, UniverseBuffers &derBuffers, UniverseState &state) const;
+    PairCounts countPairs(const UniverseState &state) const;
+
+    // Computes accelerations (into acc[...].v) only for particles selected by active. Unselected particles still
+    // exert forces. acc and accBuffers have to be initialized with initAccelerations() after each layout change.
+    void initAccelerations(UniverseState &acc, UniverseBuffers &accBuffers, const UniverseState &state) const;
+    void activeAccelerations(UniverseState &acc, UniverseBuffers &accBuffers, const UniverseState &state,
+            const ParticleMask &active) const;
 
 private:
     void initForces(UniverseState &der, const UniverseState &state) const;
-    void computeForces(UniverseState &der, UniverseBuffers &derBuffers, const UniverseState &state) const;
+    void initBuffers(UniverseBuffers &derBuffers, const UniverseState &state) const;
+    void resetActiveForces(UniverseState &der, UniverseBuffers &derBuffers, const ParticleMask &active) const;
+    static const int potentialSamples = 256;
+    static const int deterministicChunks = 16;
+
+    void computeForces(UniverseState &der, UniverseBuffers &derBuffers, const UniverseState &state,
+            const ParticleMask *active) const;
     void computeForcesOneThread(UniverseState &der, UniverseBuffers &derBuffers, const UniverseState &state,
-            AtomicCounter &counter) const;
+            const ParticleMask *active, AtomicCounter &counter, ObservableGrid *observables,
+            PairHistogram *histogram) const;
+    void computeForcesDeterministic(UniverseState &der, UniverseBuffers &derBuffers, const UniverseState &state,
+            const ParticleMask *active, ObservableGrid *observables, PairHistogram *histogram) const;
+    void computeCellForces(UniverseState &der, UniverseBuffers &derBuffers, const UniverseState &state,
+            const ParticleMask *active, int c0, ObservableGrid *observables, PairHistogram *histogram) const;
     double boundForce(double overEdge) const;
+    double pairPotential(size_t pair, double d) const;
+    inline int typeIndex(const ParticleState &pState) const { return pState.type - types.data(); }
 
-    void forcesToAccel(UniverseState &der, const UniverseBuffers &derBuffers) const;
+    void forcesToAccel(UniverseState &der, const UniverseBuffers &derBuffers, const ParticleMask *active) const;
+    void addLongRangeForces(UniverseState &der, const UniverseState &state, const ParticleMask *active,
+            ObservableGrid *observables) const;
+    const ParticleMask * awakeMask(const UniverseState &state) const; // nullptr if no particle is asleep
 };
 
 
+struct BlockTimestepsWorkspace;
+
+/*
+ * Universe owns all of its buffers, including the integrator workspaces, so different universes can be advanced
+ * concurrently on different threads (see Ensemble.h).
+ */
+
 class Universe {
 public:
     Universe(const UniverseConfig &_config, const std::vector<ParticleType> &_types);
+    Universe(Universe &&);
+    ~Universe();
     void addParticle(int typeIndex, ParticleState pState);
+    // Adds many particles at once, whose types have to point into getParticleTypes(). Particles are binned by box
+    // with a counting sort over chunks of particles on the threads of the config, and each box buffer is grown once
+    // to its final size, with the same result as addParticle() for each of them in order. Assigns the ids of
+    // particles.
+    void addParticles(std::vector<ParticleState> &particles);
     void removeParticle(int index);
     void advance(double dT);
+    void advanceAdaptive(double duration, AdaptiveStepControl &control);
     Vector2D clampInto(const Vector2D &pos);
+    double maxVelocity() const;
+    inline PairCounts countPairs() const { return diff.countPairs(state); }
+    uint64_t stateHash() const; // FNV-1a of the bits of positions and velocities in iteration order
+
+    // Records an ObservableSample with bins of binSize before each following step, keeping the last maxSamples.
+    // binSize 0 stops recording.
+    void observe(double binSize, size_t maxSamples = 600);
+    inline const std::deque<ObservableSample> & getObservations() const { return observations; }
+    inline double getTime() const { return time; }
+    inline uint64_t getSteps() const { return steps; }
+
+    void setThermostats(const std::vector<Thermostat> &_thermostats, uint32_t seed = 0); // Applied after each step
+
+    // Records the state after every interval steps, keeping the last maxPoints states. maxPoints 0 stops recording.
+    void enableRewind(size_t maxPoints, uint64_t interval);
+    // Goes back by pointsBack recorded states older than the current one. False if there are none.
+    bool rewind(size_t pointsBack = 1);
+    inline const RewindBuffer & getRewindBuffer() const { return rewindBuffer; }
+
+    // Publishes the particles into writer after every interval steps, nullptr stops publishing
+    void publishSnapshots(std::shared_ptr<SnapshotWriter> writer, uint64_t interval = 1);
+
+    // Sleeping freezes quiet boxes: their particles get zero velocity and are skipped by the force computation and
+    // the thermostats until they are woken. A box is woken when a particle within the interaction range exceeds a
+    // threshold, when particles within the interaction range are added or edited (commands and UniverseModifier),
+    // by wake(), and for a check step after sleeping for config.steps steps, after which it falls asleep again if it
+    // is still quiet. So a particle is frozen for at most T = steps * dT at a time, and as long as its
+    // acceleration stays below maxAcceleration while asleep (verified only at the check steps), each sleep adds a
+    // position error of at most maxVelocity * T + maxAcceleration * T^2 / 2 and leaves a velocity error of at most
+    // maxVelocity + maxAcceleration * T. Sleeping applies to advance() with RK4, other integrators wake all particles.
+    void enableSleeping(const SleepConfig &config);
+    void wake(const Vector2D &pos, double radius); // Wakes the boxes within radius of pos
+    void wakeAll();
+    inline size_t getSleepingParticles() const { return sleepingParticles; }
+
+    // Commands pushed from any thread are applied at the beginning of the next step
+    inline CommandQueue & getCommandQueue() { return *commands; }
+
+    // Classifies the phases of particles after every config.interval steps, keeping the last maxSamples results
+    void analysePhases(const PhaseAnalysisConfig &config, size_t maxSamples = 600);
+    inline const std::deque<PhaseSample> & getPhaseSamples() const { return phaseSamples; }
+
+    // Histograms pair distances in bins of binWidth before each following step, averaged over the last window steps.
+    // binWidth 0 stops measuring.
+    void measureRadialDistribution(double binWidth, size_t window = 100);
+    inline const RadialDistribution & getRadialDistribution() const { return radialDistribution; }
+    void writeRadialDistribution(std::ostream &out) const; // Up to the smallest interaction range of type pairs
 
     inline size_t size() const { return state.size(); }
     inline const UniverseConfig & getConfig() const { return diff.config; }
     inline const std::vector<ParticleType> & getParticleTypes() const { return diff.types; }
+    inline double getInteractionRange() const { return diff.maxRange; } // Largest range of the particle types
 
     inline auto begin() { return state.begin(); }
     inline auto end() { return state.end(); }
     inline auto erase(const UniverseState::iterator &it) { return state.erase(it); }
 private:
+    void applyCommands();
+    void beginObservation();
+    void endStep(double dT);
+    void publishSnapshot();
+    void updateSleep(double dT); // After an RK4 step, whose initial state is in workspace.xInitial
+    void wakeBox(int x, int y); // Wakes the particles of the box, if it exists
+
     UniverseDifferentiator diff;
     UniverseState state;
+    IntegratorWorkspace<UniverseState, UniverseBuffers> workspace;
+    std::unique_ptr<BlockTimestepsWorkspace> blockTimestepsWorkspace;
+    double time = 0;
+    uint64_t steps = 0;
+    uint32_t nextParticleId = 0;
+
+    std::vector<Thermostat> thermostats;
+    uint32_t thermostatSeed = 0;
+    ThermostatWorkspace thermostatWorkspace;
+
+    std::unique_ptr<CommandQueue> commands;
+
+    SleepConfig sleepConfig;
+    size_t sleepingParticles = 0;
+    std::vector<char> disturbed; // Boxes near active particles, kept between steps to reuse its memory
+
+    RewindBuffer rewindBuffer;
+
+    std::shared_ptr<SnapshotWriter> snapshotWriter;
+    uint64_t snapshotInterval = 1;
+    std::vector<UniverseCommand> drainedCommands;
+
+    double observationBinSize = 0;
+    size_t maxObservations = 0;
+    std::deque<ObservableSample> observations;
+
+    PhaseAnalysisConfig phaseConfig;
+    int stepsSinceAnalysis = 0;
+    size_t maxPhaseSamples = 0;
+    std::deque<PhaseSample> phaseSamples;
+
+    bool measuringRadialDistribution = false;
+    RadialDistribution radialDistribution;
 };
 
 #endif
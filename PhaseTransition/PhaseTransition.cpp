@@ -1,5 +1,6 @@
 
 #include <iostream>
+#include <fstream>
 #include <random>
 #include <ctime>
 #include <cmath>
@@ -8,6 +9,9 @@
 #include "Lib/Display.h"
 #include "Lib/Universe.h"
 #include "Lib/Particle.h"
+#include "Lib/StepScheduler.h"
+#include "Lib/InputRecording.h"
+#include "Lib/Globals.h"
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
@@ -17,6 +21,8 @@
 std::unique_ptr<Setup> globalSetup = nullptr;
 std::unique_ptr<Universe> globalUniverse = nullptr;
 std::unique_ptr<Display> globalDisplay = nullptr;
+std::unique_ptr<StepScheduler> globalScheduler = nullptr;
+std::unique_ptr<InputRecorder> globalRecorder = nullptr;
 bool exitFlag = false;
 
 
@@ -33,12 +39,25 @@ int main(int argc, char **argv) {
 
 	std::string recordingPath;
 	if(! globalSetup->recordingPrefix.empty()) recordingPath = globalSetup->recordingPrefix + currentDateTime() + "/";
-	globalUniverse.reset(new Universe({ globalSetup->sizeX, globalSetup->sizeY, globalSetup->forceFactor, globalSetup->gravity },
-	        globalSetup->particleTypes));
+	globalUniverse.reset(new Universe(globalSetup->universeConfig(), globalSetup->particleTypes));
 	globalSetup->addParticlesToUniverse(*globalUniverse);
+	globalSetup->configureUniverse(*globalUniverse);
+	uint32_t seed = time(0);
+	randomGenerator.seed(seed);
+	globalUniverse->setThermostats(globalSetup->thermostats, seed);
+	if(! globalSetup->snapshotRingName.empty())
+	    globalUniverse->publishSnapshots(std::make_shared<SnapshotWriter>(globalSetup->snapshotRingName,
+	            globalSetup->snapshotSlots, globalSetup->snapshotCapacity), globalSetup->snapshotInterval);
+	if(! globalSetup->inputRecordingPath.empty())
+	    globalRecorder.reset(new InputRecorder(globalSetup->inputRecordingPath, seed));
 	globalDisplay.reset(new Display(*globalUniverse, "Phase Transition",
 	        globalSetup->displayedCaption, globalSetup->directoryPath, recordingPath));
 
+	StepSchedulerConfig schedulerConfig;
+	schedulerConfig.frameTime = globalSetup->frameTime;
+	schedulerConfig.maxSubstepDT = globalSetup->dT / 5;
+	globalScheduler.reset(new StepScheduler(schedulerConfig));
+
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop(oneStep, 60, 1);
 #else
@@ -47,10 +66,18 @@ int main(int argc, char **argv) {
     }
 #endif
 
+	if(! globalSetup->radialDistributionPath.empty()) {
+	    std::ofstream out(globalSetup->radialDistributionPath);
+	    globalUniverse->writeRadialDistribution(out);
+	}
+	if(! globalSetup->particleExport.path.empty())
+	    exportParticles(*globalUniverse, globalSetup->particleExport.path, globalSetup->particleExport.format);
+
 	return 0;
 }
 
 void oneStep() {
+    globalScheduler->beginFrame();
     const CallbackHandler &handler = globalDisplay->update();
     UniverseModifier::modify(*globalUniverse, handler, globalSetup->dT);
 
@@ -59,8 +86,9 @@ void oneStep() {
         return;
     }
 
-    for (int j = 0; j < 5; ++j)
-        globalUniverse->advance(globalSetup->dT / 5);
+    if(globalRecorder) globalRecorder->record(handler, globalScheduler->getSubsteps());
+    globalScheduler->advanceFrame(*globalUniverse);
+    globalDisplay->setSimulationSpeed(globalScheduler->getSimulationSpeed());
 }
 
 std::string currentDateTime() {
@@ -0,0 +1,202 @@
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+#include "Lib/Setup.h"
+#include "Lib/Universe.h"
+#include "Lib/Particle.h"
+#include "Lib/Conservation.h"
+
+/*
+ * Accuracy versus speed regression harness. Runs canonical scenarios built from the setup files in Setups/
+ * for a fixed number of steps with each integration mode, tracks the drift of total energy and momentum after
+ * every step, and compares the particles at checkpoints against golden trajectories recorded with the reference
+ * mode (RK4 with 4 substeps per step). Reports the speedup relative to the reference and the errors of each mode,
+ * and exits with 1 if any error exceeds the tolerance of its mode.
+ *
+ * Gravity is turned off and the particles start as a lattice block in the middle of the universe, which doesn't
+ * reach the walls, so energy and momentum should be conserved up to integration error.
+ *
+ * Usage: Regression [--update] [setupDirectory=../Setups/] [goldenDirectory=../Regression/Golden/]
+ * With --update, the golden trajectories are rewritten from the reference mode.
+ */
+
+static const int nParticles = 400, nSteps = 100, checkpointInterval = 50;
+static const char * const scenarios[] = { "default.txt", "web.txt" };
+
+struct Checkpoint {
+    int step;
+    std::map<uint32_t, ParticleState> particles; // By id
+};
+
+struct Mode {
+    std::string name;
+    std::function<void(UniverseConfig &)> configure;
+    std::function<void(Universe &, double dT)> step; // Advances the universe by dT
+    double maxPositionError, maxEnergyDrift, maxMomentumDrift; // Tolerances
+};
+
+struct RunResult {
+    double seconds = 0;
+    std::vector<Checkpoint> checkpoints;
+    ConservationTracker conservation;
+};
+
+static void fillBlock(Universe &universe) {
+    // Square lattice block in the middle, with deterministic pseudorandom velocities
+    const UniverseConfig &config = universe.getConfig();
+    int perRow = (int) std::ceil(std::sqrt(nParticles));
+    double spacing = 12;
+    Vector2D corner(config.sizeX / 2. - perRow * spacing / 2, config.sizeY / 2. - perRow * spacing / 2);
+    for(int i = 0; i < nParticles; ++i) {
+        Vector2D pos = corner + Vector2D((i % perRow + 0.5) * spacing, (i / perRow + 0.5) * spacing);
+        Vector2D v(0.1 * std::sin(i * 1.7), 0.1 * std::cos(i * 2.3));
+        universe.addParticle(i % universe.getParticleTypes().size(), ParticleState(pos, v));
+    }
+}
+
+static Checkpoint checkpoint(Universe &universe, int step) {
+    Checkpoint result{ step, {} };
+    for(const ParticleState &p: universe)
+        result.particles[p.id] = p;
+    return result;
+}
+
+static RunResult run(const Setup &setup, const Mode &mode) {
+    UniverseConfig config{ setup.sizeX, setup.sizeY, setup.forceFactor, 0 };
+    mode.configure(config);
+    Universe universe(config, setup.particleTypes);
+    fillBlock(universe);
+    universe.observe(std::max(setup.sizeX, setup.sizeY), 1);
+
+    RunResult result;
+    double dT = setup.dT / 5; // The largest substep of the interactive program
+    result.checkpoints.push_back(checkpoint(universe, 0));
+    for(int step = 1; step <= nSteps; ++step) {
+        auto begin = std::chrono::steady_clock::now();
+        mode.step(universe, dT);
+        result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        result.conservation.add(universe.getObservations().back());
+        if(step % checkpointInterval == 0)
+            result.checkpoints.push_back(checkpoint(universe, step));
+    }
+    return result;
+}
+
+static void writeGolden(const std::string &path, const std::vector<Checkpoint> &checkpoints) {
+    std::ofstream out(path);
+    out << std::setprecision(17);
+    for(const Checkpoint &c: checkpoints) {
+        out << "checkpoint " << c.step << " " << c.particles.size() << "\n";
+        for(const auto &idParticle: c.particles) {
+            const ParticleState &p = idParticle.second;
+            out << p.id << " " << p.pos.x << " " << p.pos.y << " " << p.v.x << " " << p.v.y << "\n";
+        }
+    }
+}
+
+static std::vector<Checkpoint> readGolden(const std::string &path) {
+    std::vector<Checkpoint> checkpoints;
+    std::ifstream in(path);
+    std::string key;
+    size_t n;
+    Checkpoint c;
+    while(in >> key >> c.step >> n) {
+        c.particles.clear();
+        for(size_t i = 0; i < n; ++i) {
+            ParticleState p;
+            in >> p.id >> p.pos.x >> p.pos.y >> p.v.x >> p.v.y;
+            c.particles[p.id] = p;
+        }
+        checkpoints.push_back(c);
+    }
+    return checkpoints;
+}
+
+static double positionError(const std::vector<Checkpoint> &checkpoints, const std::vector<Checkpoint> &golden) {
+    // Largest distance of a particle from its golden position over all checkpoints. Missing data is infinite error.
+    if(checkpoints.size() != golden.size()) return INFINITY;
+    double error = 0;
+    for(size_t i = 0; i < golden.size(); ++i) {
+        if(checkpoints[i].step != golden[i].step || checkpoints[i].particles.size() != golden[i].particles.size())
+            return INFINITY;
+        for(const auto &idParticle: golden[i].particles) {
+            auto it = checkpoints[i].particles.find(idParticle.first);
+            if(it == checkpoints[i].particles.end()) return INFINITY;
+            error = std::max(error, (it->second.pos - idParticle.second.pos).magnitude());
+        }
+    }
+    return error;
+}
+
+int main(int argc, char **argv) {
+    bool update = false;
+    std::vector<std::string> paths;
+    for(int i = 1; i < argc; ++i) {
+        if(std::string(argv[i]) == "--update") update = true;
+        else paths.push_back(argv[i]);
+    }
+    std::string setupDirectory = paths.size() > 0 ? paths[0] + "/" : "../Setups/";
+    std::string goldenDirectory = paths.size() > 1 ? paths[1] + "/" : "../Regression/Golden/";
+
+    // The first mode is the reference that golden trajectories are recorded with. Energy drifts of about 2e-3 are
+    // inherent to the tabulated pair potentials. Block timesteps don't conserve momentum, because the impulses of
+    // pairs with different timestep levels aren't symmetric.
+    AdaptiveStepControl adaptiveControl;
+    std::vector<Mode> modes = {
+            { "reference", [](UniverseConfig &) {},
+                    [](Universe &u, double dT) { for(int i = 0; i < 4; ++i) u.advance(dT / 4); }, 1e-6, 3e-3, 1e-9 },
+            { "rk4", [](UniverseConfig &) {},
+                    [](Universe &u, double dT) { u.advance(dT); }, 0.5, 4e-3, 1e-9 },
+            { "cellsPerRange2", [](UniverseConfig &config) { config.cellsPerRange = 2; },
+                    [](Universe &u, double dT) { u.advance(dT); }, 0.5, 4e-3, 1e-9 },
+            { "blockTimesteps3", [](UniverseConfig &config) { config.maxTimestepLevel = 3; },
+                    [](Universe &u, double dT) { u.advance(dT); }, 2.5, 5e-3, 1 },
+            { "adaptive", [](UniverseConfig &) {},
+                    [&adaptiveControl](Universe &u, double dT) { u.advanceAdaptive(dT, adaptiveControl); },
+                    0.5, 4e-3, 1e-9 }
+    };
+
+    bool failed = false;
+    std::cout << "scenario     mode             seconds  speedup  positionError  energyDrift  momentumDrift" << std::endl;
+    for(const char *scenario: scenarios) {
+        Setup setup(setupDirectory + scenario);
+        if(setup.particleTypes.empty()) {
+            std::cout << "Can't read " << setupDirectory + scenario << std::endl;
+            return 1;
+        }
+        std::string goldenPath = goldenDirectory + scenario;
+
+        double referenceSeconds = 0;
+        std::vector<Checkpoint> golden;
+        for(const Mode &mode: modes) {
+            adaptiveControl = AdaptiveStepControl();
+            adaptiveControl.tolerance = 1e-4;
+            RunResult result = run(setup, mode);
+            if(&mode == &modes.front()) {
+                referenceSeconds = result.seconds;
+                if(update) writeGolden(goldenPath, result.checkpoints);
+                golden = readGolden(goldenPath);
+            }
+
+            double error = positionError(result.checkpoints, golden);
+            bool ok = error <= mode.maxPositionError && result.conservation.energyDrift() <= mode.maxEnergyDrift
+                    && result.conservation.momentumDrift() <= mode.maxMomentumDrift;
+            failed |= ! ok;
+            std::cout << std::left << std::setw(13) << scenario << std::setw(15) << mode.name << std::right
+                      << std::setprecision(3) << std::setw(9) << result.seconds
+                      << std::setw(9) << referenceSeconds / result.seconds
+                      << std::setw(15) << error << std::setw(13) << result.conservation.energyDrift()
+                      << std::setw(15) << result.conservation.momentumDrift() << (ok ? "" : "  FAIL") << std::endl;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
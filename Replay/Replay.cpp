@@ -0,0 +1,68 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include "Lib/Setup.h"
+#include "Lib/Universe.h"
+#include "Lib/StepScheduler.h"
+#include "Lib/InputRecording.h"
+#include "Lib/Globals.h"
+
+/*
+ * Headless replay of an interactive session recorded with the inputRecording key of a setup file. The universe
+ * is set up as in PhaseTransition, then each recorded frame is run without drawing. Reports the wall-clock time
+ * per frame and the final state, whose hash is the same for every replay of a recording.
+ *
+ * Usage: Replay setupFile recordingFile
+ */
+
+int main(int argc, char **argv) {
+    if(argc != 3) {
+        std::cout << "Usage: Replay setupFile recordingFile" << std::endl;
+        return 1;
+    }
+    Setup setup(argv[1]);
+    InputReplay replay(argv[2]);
+    if(! replay.good()) {
+        std::cout << "Can't read recording " << argv[2] << std::endl;
+        return 1;
+    }
+
+    Universe universe(setup.universeConfig(), setup.particleTypes);
+    setup.addParticlesToUniverse(universe);
+    setup.configureUniverse(universe);
+    randomGenerator.seed(replay.getSeed());
+    universe.setThermostats(setup.thermostats, replay.getSeed());
+
+    StepSchedulerConfig schedulerConfig;
+    schedulerConfig.maxSubstepDT = setup.dT / 5;
+    StepScheduler scheduler(schedulerConfig);
+
+    std::vector<double> frameSeconds;
+    size_t maxParticles = universe.size();
+    InputFrame frame;
+    while(replay.next(frame)) {
+        auto begin = std::chrono::steady_clock::now();
+        replayFrame(universe, scheduler, frame, setup.dT);
+        frameSeconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+        maxParticles = std::max(maxParticles, universe.size());
+    }
+
+    double total = 0;
+    for(double seconds: frameSeconds)
+        total += seconds;
+    std::sort(frameSeconds.begin(), frameSeconds.end());
+    auto percentile = [&](double p) {
+        return frameSeconds.empty() ? 0 : 1e3 * frameSeconds[(size_t) (p * (frameSeconds.size() - 1))];
+    };
+
+    std::cout << "frames = " << frameSeconds.size() << ", steps = " << universe.getSteps()
+              << ", simulated time = " << universe.getTime() << std::endl;
+    std::cout << "particles = " << universe.size() << " (max " << maxParticles << ")" << std::endl;
+    std::cout << std::setprecision(3) << "seconds = " << total << ", ms per frame: median " << percentile(0.5)
+              << ", 95% " << percentile(0.95) << ", max " << percentile(1) << std::endl;
+    std::cout << "state hash = " << std::hex << universe.stateHash() << std::endl;
+    return 0;
+}
@@ -0,0 +1,65 @@
+
+#include <iostream>
+#include <iomanip>
+#include <ctime>
+#include "Lib/Setup.h"
+#include "Lib/Universe.h"
+#include "Lib/StepScheduler.h"
+#include "Lib/Streaming.h"
+#include "Lib/Globals.h"
+
+/*
+ * Headless simulation server. Waits for a Viewer to connect, then streams the universe to it frame by frame and
+ * applies the input the viewer sends back, until the viewer disconnects. Reports the frame rate, bytes per frame
+ * and end-to-end latency (from sending a frame to receiving the input sent after it) once per second.
+ *
+ * Usage: Server setupFile address
+ * address is host:port (e.g. 127.0.0.1:7000) or unix:path
+ */
+
+int main(int argc, char **argv) {
+    if(argc != 3) {
+        std::cout << "Usage: Server setupFile address" << std::endl;
+        return 1;
+    }
+    Setup setup(argv[1]);
+    Universe universe(setup.universeConfig(), setup.particleTypes);
+    setup.addParticlesToUniverse(universe);
+    setup.configureUniverse(universe);
+    uint32_t seed = time(0);
+    randomGenerator.seed(seed);
+    universe.setThermostats(setup.thermostats, seed);
+
+    StepSchedulerConfig schedulerConfig;
+    schedulerConfig.frameTime = setup.frameTime;
+    schedulerConfig.maxSubstepDT = setup.dT / 5;
+    StepScheduler scheduler(schedulerConfig);
+
+    StreamListener listener(argv[2]);
+    std::cout << "Waiting for a viewer on " << argv[2] << std::endl;
+    StreamServer server(universe, listener.accept());
+    CallbackHandler handler(setup.particleTypes.size());
+
+    uint64_t reportedBytes = server.getBytes();
+    uint32_t reportedFrames = 0;
+    uint64_t reportTime = streamTimestamp();
+    while(server.isConnected()) {
+        scheduler.beginFrame();
+        server.receiveInput(handler);
+        UniverseModifier::modify(universe, handler, setup.dT);
+        scheduler.advanceFrame(universe);
+        server.sendFrame();
+
+        uint64_t now = streamTimestamp();
+        if(now - reportTime < 1000000000) continue;
+        uint32_t frames = server.getFrames() - reportedFrames;
+        std::cout << std::setprecision(3) << "frames/s = " << frames * 1e9 / (now - reportTime)
+                  << ", bytes/frame = " << (double) (server.getBytes() - reportedBytes) / frames
+                  << ", latency = " << server.getLatency() * 1e3 << " ms (mean " << server.getMeanLatency() * 1e3
+                  << " ms), particles = " << universe.size() << std::endl;
+        reportTime = now;
+        reportedFrames = server.getFrames();
+        reportedBytes = server.getBytes();
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "Lib/Universe.h"
+#include "Lib/HugePages.h"
+#include "Lib/Streaming.h"
+#include "Tests/Fixtures.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <gtest/gtest.h>
+
+// Replaces the global allocation functions of the test binary, counting allocations while enabled
+#if defined(__GNUC__) && ! defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static std::atomic<bool> countingAllocations(false);
+static std::atomic<size_t> allocations(0);
+
+void * operator new(std::size_t size) {
+    if(countingAllocations) ++allocations;
+    if(void *ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+static size_t allocationsPerStep(Universe &universe, double dT, int steps) {
+    allocations = 0;
+    countingAllocations = true;
+    for(int i = 0; i < steps; ++i)
+        universe.advance(dT);
+    countingAllocations = false;
+    return allocations;
+}
+
+TEST(AllocationTest, SteadyStateSteps) {
+    for(int threads: { 1, 3 }) {
+        UniverseConfig config{ 200, 200, 1e-2, 1e-2 };
+        config.threads = threads;
+        Universe universe(config, testTypes);
+        addLattice(universe, 400, 20, 8, 20, 1);
+        universe.setThermostats({ Thermostat() });
+        allocationsPerStep(universe, 0.05, 20); // Warm-up grows the buffers to their working sizes
+        EXPECT_EQ(0, allocationsPerStep(universe, 0.05, 20)) << threads << " threads";
+    }
+}
+
+TEST(AllocationTest, ObservingSteps) {
+    // Observables, pair histograms and their per-thread copies are kept across steps once the histories are full
+    for(bool deterministic: { false, true }) {
+        UniverseConfig config{ 200, 200, 1e-2, 1e-2 };
+        config.threads = 3;
+        config.deterministic = deterministic;
+        Universe universe(config, testTypes);
+        addLattice(universe, 400, 20, 8, 20, 1);
+        universe.observe(50, 5);
+        universe.measureRadialDistribution(0.5, 5);
+        allocationsPerStep(universe, 0.05, 20);
+        EXPECT_EQ(0, allocationsPerStep(universe, 0.05, 20)) << "deterministic " << deterministic;
+    }
+}
+
+TEST(AllocationTest, SparseLongRangeAndSleeping) {
+    UniverseConfig config{ 2000, 2000, 1e-2, 0 };
+    config.threads = 2;
+    config.longRangeCoupling = 1;
+    std::vector<ParticleType> charged = testTypes;
+    charged[0].setCharge(1);
+    Universe universe(config, charged);
+    addLattice(universe, 200, 20, 6, 20, 1);
+    SleepConfig sleep;
+    sleep.steps = 5;
+    universe.enableSleeping(sleep);
+    universe.observe(100, 5);
+    allocationsPerStep(universe, 0.05, 20);
+    EXPECT_EQ(0, allocationsPerStep(universe, 0.05, 20));
+}
+
+TEST(AllocationTest, DeltaEncoding) {
+    // Once the buffers have grown, encoding the frames of the same particles doesn't allocate
+    Universe universe(testUniverseConfig(200, 200, 1), testTypes);
+    addLattice(universe, 400, 20, 8, 20, 1);
+    DeltaEncoder encoder;
+    std::vector<char> msg;
+    for(int i = 0; i < 20; ++i) {
+        universe.advance(0.05);
+        encoder.encode(universe, i, msg);
+    }
+    allocations = 0;
+    for(int i = 0; i < 20; ++i) {
+        universe.advance(0.05);
+        countingAllocations = true;
+        encoder.encode(universe, 20 + i, msg);
+        countingAllocations = false;
+    }
+    EXPECT_EQ(0, allocations);
+}
+
+TEST(AllocationTest, HugePageBuffers) {
+    std::vector<Vector2D, HugePageAllocator<Vector2D>> large(hugePageSize / sizeof(Vector2D) + 1), small(10);
+#ifdef HUGE_PAGES_ENABLED
+    EXPECT_EQ(0, (uintptr_t) large.data() % hugePageSize);
+#endif
+    large.back() = Vector2D(1, 2);
+    small = { Vector2D(3, 4) };
+    EXPECT_EQ(2, large.back().y);
+    EXPECT_EQ(1, small.size());
+}
@@ -0,0 +1,59 @@
+#include "Lib/Universe.h"
+#include <thread>
+#include <gtest/gtest.h>
+
+TEST(CommandQueueTest, AppliesCommandsInOrder) {
+    std::vector<ParticleType> types = { ParticleType(1, 1, 1, 1, 10), ParticleType(2, 1, 1, 1, 10) };
+    Universe universe(UniverseConfig{ 200, 200, 1e-2, 0 }, types);
+    CommandQueue &queue = universe.getCommandQueue();
+    queue.push(UniverseCommand::add(0, Vector2D(50, 50)));
+    queue.push(UniverseCommand::add(1, Vector2D(150, 150)));
+    queue.push(UniverseCommand::add(0, Vector2D(150, 50)));
+    queue.push(UniverseCommand::impulse(Vector2D(50, 50), 10, Vector2D(1, 0)));
+    queue.push(UniverseCommand::heat(Vector2D(50, 50), 10, 2));
+    queue.push(UniverseCommand::removeInRadius(Vector2D(150, 150), 10));
+    queue.push(UniverseCommand::add(1, Vector2D(150, 152))); // Not removed, as it's added after the removal
+    Thermostat thermostat;
+    thermostat.coupling = 0;
+    queue.push(UniverseCommand::setThermostats({ thermostat }));
+    EXPECT_EQ(0, universe.size());
+
+    universe.advance(1e-6);
+    ASSERT_EQ(3, universe.size());
+    for(const ParticleState &p: universe) {
+        EXPECT_NEAR(p.pos.x < 100 ? 2 : 0, p.v.x, 1e-3);
+        EXPECT_EQ(& universe.getParticleTypes()[p.pos.y > 100 ? 1 : 0], p.type);
+    }
+
+    std::vector<UniverseCommand> left;
+    EXPECT_EQ(0, queue.drain(left));
+}
+
+TEST(CommandQueueTest, ConcurrentProducers) {
+    // Particles are added from several threads while the universe is advanced
+    std::vector<ParticleType> types = { ParticleType(1, 1, 1, 1, 10) };
+    UniverseConfig config{ 200, 200, 1e-2, 0 };
+    config.threads = 1;
+    Universe universe(config, types);
+    const int nProducers = 4, perProducer = 500;
+
+    std::atomic<int> finished(0);
+    std::vector<std::thread> producers;
+    for(int t = 0; t < nProducers; ++t)
+        producers.emplace_back([&universe, &finished, t]() {
+            for(int i = 0; i < perProducer; ++i)
+                universe.getCommandQueue().push(UniverseCommand::add(0, Vector2D(10 + 0.35 * i, 20 + 40 * t)));
+            ++finished;
+        });
+    while(finished < nProducers)
+        universe.advance(1e-3);
+    for(auto &producer: producers)
+        producer.join();
+    universe.advance(1e-3);
+
+    EXPECT_EQ(nProducers * perProducer, universe.size());
+    std::vector<bool> seen(nProducers * perProducer);
+    for(const ParticleState &p: universe)
+        seen.at(p.id) = true;
+    EXPECT_EQ(std::vector<bool>(nProducers * perProducer, true), seen);
+}
@@ -0,0 +1,45 @@
+
+#include "Lib/Universe.h"
+#include "Tests/Fixtures.h"
+#include <gtest/gtest.h>
+
+struct RunResult {
+    uint64_t hash;
+    double potentialEnergy, virial, g;
+};
+
+static RunResult run(int threads, int maxTimestepLevel) {
+    UniverseConfig config{ 100, 100, 1, 1e-2 };
+    config.threads = threads;
+    config.deterministic = true;
+    config.maxTimestepLevel = maxTimestepLevel;
+    Universe universe(config, testTypes);
+    addLattice(universe, 400, 20, 4, 10, 1);
+
+    Thermostat thermostat;
+    thermostat.minX = 50;
+    universe.setThermostats({ thermostat }, 7);
+    universe.observe(10);
+    universe.measureRadialDistribution(0.5, 5);
+    PhaseAnalysisConfig phaseConfig;
+    phaseConfig.interval = 5;
+    universe.analysePhases(phaseConfig);
+    for(int i = 0; i < 20; ++i)
+        universe.advance(0.05);
+
+    ObservableBin total = universe.getObservations().back().grid.total();
+    return { universe.stateHash(), total.potentialEnergy, total.virial, universe.getRadialDistribution().g(5) };
+}
+
+TEST(DeterminismTest, TrajectoryHash) {
+    for(int maxTimestepLevel: { 0, 2 }) {
+        RunResult reference = run(1, maxTimestepLevel);
+        for(int threads: { 2, 8, 32 }) {
+            RunResult result = run(threads, maxTimestepLevel);
+            EXPECT_EQ(reference.hash, result.hash) << threads << " threads";
+            EXPECT_EQ(reference.potentialEnergy, result.potentialEnergy) << threads << " threads";
+            EXPECT_EQ(reference.virial, result.virial) << threads << " threads";
+            EXPECT_EQ(reference.g, result.g) << threads << " threads";
+        }
+    }
+}
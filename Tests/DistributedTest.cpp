@@ -0,0 +1,106 @@
+
+#include "Lib/DistributedUniverse.h"
+#include "Tests/Fixtures.h"
+#include <gtest/gtest.h>
+#include <functional>
+#include <memory>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Ranks 1... are forked processes, rank 0 is the test itself. Threads aren't used, because they don't survive fork().
+static const UniverseConfig config{ 200, 200, 1e-2, 1e-2, 0, 0.05, 1, 1 };
+static const double dT = 0.1;
+static const int nSteps = 30;
+
+// Particles added to every rank, and the time step of each step
+struct Scenario {
+    std::vector<std::pair<int, ParticleState>> particles;
+    std::vector<double> steps;
+};
+
+static Scenario gas() {
+    Scenario scenario;
+    for(int i = 0; i < 100; ++i) {
+        Vector2D pos(10 + 18 * (i % 10) + (i / 10) % 2 * 9, 10 + 18 * (i / 10));
+        Vector2D v(3 * std::sin(i * 1.7), 3 * std::cos(i * 2.3)); // Fast enough to cross the strips
+        scenario.particles.emplace_back(i % 2, ParticleState(pos, v));
+    }
+    scenario.steps.assign(nSteps, dT);
+    return scenario;
+}
+
+template<typename T>
+static void run(T &universe, const Scenario &scenario) {
+    for(const auto &particle: scenario.particles)
+        universe.addParticle(particle.first, particle.second);
+    for(double stepDT: scenario.steps) universe.advance(stepDT);
+}
+
+static void expectMatchesSingleProcess(const Scenario &scenario, const std::vector<ParticleState> &particles) {
+    Universe reference(config, largeTestTypes);
+    run(reference, scenario);
+
+    ASSERT_EQ(reference.size(), particles.size());
+    for(auto it = reference.begin(); it != reference.end(); ++it) {
+        double minDist = 1e9;
+        for(const auto &pState: particles)
+            if(pState.type->getMass() == it->type->getMass())
+                minDist = std::min(minDist, (pState.pos - it->pos).magnitude() + (pState.v - it->v).magnitude());
+        EXPECT_LT(minDist, 1e-6);
+    }
+}
+
+static void expectDistributedMatches(const Scenario &scenario, int size,
+        std::function<std::unique_ptr<Transport>(int)> connect) {
+    std::vector<pid_t> children;
+    for(int rank = 1; rank < size; ++rank) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            std::unique_ptr<Transport> transport = connect(rank);
+            DistributedUniverse universe(config, largeTestTypes, *transport);
+            run(universe, scenario);
+            universe.gather();
+            transport.reset();
+            _exit(0); // Skips destructors of the parent's globals
+        }
+        children.push_back(pid);
+    }
+
+    std::unique_ptr<Transport> transport = connect(0);
+    DistributedUniverse universe(config, largeTestTypes, *transport);
+    run(universe, scenario);
+    expectMatchesSingleProcess(scenario, universe.gather()); // Particles point to the types of universe
+    transport.reset();
+
+    for(pid_t pid: children) {
+        int status;
+        waitpid(pid, & status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+}
+
+TEST(DistributedTest, SharedMemory) {
+    std::string name = "PhaseTransitionTest-" + std::to_string(getpid());
+    expectDistributedMatches(gas(), 3, [&name](int rank) {
+        return std::unique_ptr<Transport>(new ShmTransport(name, rank, 3));
+    });
+}
+
+TEST(DistributedTest, LocalSocket) {
+    int basePort = 20000 + getpid() % 20000;
+    expectDistributedMatches(gas(), 2, [basePort](int rank) {
+        return std::unique_ptr<Transport>(new TcpTransport("127.0.0.1", basePort, rank, 2));
+    });
+}
+
+TEST(DistributedTest, ParticlesPassingStrips) {
+    // Within the first step, the two particles move past the middle strip. They are handed over at the next step.
+    Scenario scenario;
+    scenario.particles.emplace_back(0, ParticleState(Vector2D(50, 20), Vector2D(0, 1400)));
+    scenario.particles.emplace_back(1, ParticleState(Vector2D(150, 180), Vector2D(0, -1400)));
+    scenario.steps = { 0.1, 1e-3 };
+    std::string name = "PhaseTransitionTest-" + std::to_string(getpid());
+    expectDistributedMatches(scenario, 3, [&name](int rank) {
+        return std::unique_ptr<Transport>(new ShmTransport(name, rank, 3));
+    });
+}
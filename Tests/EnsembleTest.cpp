@@ -0,0 +1,102 @@
+#include "Lib/Ensemble.h"
+#include "Tests/Fixtures.h"
+#include <set>
+#include <sstream>
+#include <gtest/gtest.h>
+
+static EnsembleSpec smallSpec() {
+    EnsembleSpec spec;
+    spec.setup.particleTypes = testTypes;
+    spec.setup.sizeX = spec.setup.sizeY = 50;
+    spec.setup.dT = 0.05;
+    spec.gravities = { 0, 1e-2 };
+    spec.dipoleScales = { 0.5, 1 };
+    spec.temperatures = { 0.5 };
+    spec.particles = { 60, 120 };
+    spec.steps = 12;
+    spec.sampleSteps = 4;
+    return spec;
+}
+
+TEST(EnsembleTest, Runs) {
+    EnsembleSpec spec = smallSpec();
+    spec.seeds = 2;
+    std::vector<EnsembleRun> runs = ensembleRuns(spec);
+    ASSERT_EQ(16, runs.size());
+    for(size_t i = 0; i < runs.size(); ++i)
+        EXPECT_EQ(i, runs[i].index);
+    EXPECT_EQ(1e-2, runs.back().gravity);
+    EXPECT_EQ(120, runs.back().particles);
+    EXPECT_EQ(2, runs.back().seed);
+
+    spec.temperatures.clear();
+    EXPECT_TRUE(std::isnan(ensembleRuns(spec).front().temperature));
+}
+
+TEST(EnsembleTest, SchedulingDoesntChangeResults) {
+    // Concurrent single-threaded universes and universes with a thread team give the results of sequential runs
+    EnsembleSpec spec = smallSpec();
+    std::vector<EnsembleRun> runs = ensembleRuns(spec);
+    std::vector<EnsembleResult> sequential;
+    for(const EnsembleRun &run: runs)
+        sequential.push_back(runEnsembleMember(spec, run, 1));
+
+    for(size_t teamParticles: { (size_t) 100, (size_t) 1000 }) {
+        spec.threads = 3;
+        spec.teamParticles = teamParticles;
+        std::set<size_t> finished;
+        std::vector<EnsembleResult> results = runEnsemble(spec, [&](const EnsembleResult &result) {
+            finished.insert(result.run.index);
+        });
+        ASSERT_EQ(runs.size(), results.size());
+        EXPECT_EQ(runs.size(), finished.size());
+        for(size_t i = 0; i < runs.size(); ++i) {
+            EXPECT_EQ(i, results[i].run.index);
+            EXPECT_EQ(sequential[i].stateHash, results[i].stateHash) << "run " << i;
+            EXPECT_EQ(sequential[i].pressure, results[i].pressure) << "run " << i;
+            EXPECT_EQ(sequential[i].potentialEnergy, results[i].potentialEnergy) << "run " << i;
+        }
+    }
+
+    // Different parameters give different trajectories
+    EXPECT_NE(sequential[0].stateHash, sequential[2].stateHash);
+    EXPECT_NE(sequential[0].stateHash, sequential[4].stateHash);
+    for(const EnsembleResult &result: sequential) {
+        EXPECT_GT(result.temperature, 0);
+        double phases = result.phaseFractions[(int) Phase::gas] + result.phaseFractions[(int) Phase::liquid]
+                + result.phaseFractions[(int) Phase::solid];
+        EXPECT_NEAR(1, phases, 1e-12);
+    }
+}
+
+TEST(EnsembleTest, ResultsFile) {
+    EnsembleSpec spec = smallSpec();
+    spec.particles = { 30 };
+    spec.steps = 3;
+    std::vector<EnsembleResult> results = runEnsemble(spec);
+
+    std::ostringstream out;
+    writeEnsembleHeader(out);
+    for(const EnsembleResult &result: results)
+        writeEnsembleResult(out, result);
+
+    std::istringstream in(out.str());
+    std::string line;
+    std::getline(in, line);
+    EXPECT_EQ('#', line[0]);
+    size_t columns = 0;
+    std::istringstream header(line.substr(1));
+    for(std::string column; header >> column; ++columns);
+
+    size_t lines = 0;
+    while(std::getline(in, line)) {
+        std::istringstream fields(line);
+        size_t index, fieldCount = 1;
+        fields >> index;
+        EXPECT_EQ(lines, index);
+        for(std::string field; fields >> field; ++fieldCount);
+        EXPECT_EQ(columns, fieldCount);
+        ++lines;
+    }
+    EXPECT_EQ(results.size(), lines);
+}
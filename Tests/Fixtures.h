@@ -0,0 +1,31 @@
+#ifndef __TEST_FIXTURES_H__
+#define __TEST_FIXTURES_H__
+
+#include <cmath>
+#include <vector>
+#include "Lib/Universe.h"
+
+/*
+ * Particle types, configs and fillers shared by the tests.
+ */
+
+// Two small types with short ranges, and two larger ones whose ranges span a few boxes of the lattices below
+static const std::vector<ParticleType> testTypes = { ParticleType(1, 1, 1, 1, 10), ParticleType(2, 1.5, 1, 0.5, 8) };
+static const std::vector<ParticleType> largeTestTypes = {
+        ParticleType(1, 4, 2, 0.8, 20), ParticleType(2, 5.6, 2.8, 1.12, 28) };
+
+inline UniverseConfig testUniverseConfig(int sizeX, int sizeY, int threads, double gravity = 0) {
+    UniverseConfig config{ sizeX, sizeY, 1e-2, gravity };
+    config.threads = threads;
+    return config;
+}
+
+// Adds n particles of alternating types, in rows of columns particles spacing apart starting at (offset, offset),
+// with velocities speed * (sin i, cos i)
+inline void addLattice(Universe &universe, int n, int columns, double spacing, double offset, double speed) {
+    for(int i = 0; i < n; ++i)
+        universe.addParticle(i % 2, ParticleState(Vector2D(offset + spacing * (i % columns),
+                offset + spacing * (i / columns)), Vector2D(speed * std::sin(i), speed * std::cos(i))));
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "Lib/Generators.h"
+#include "Lib/Setup.h"
+#include "Tests/Fixtures.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+static double minDistance(const std::vector<ParticleState> &particles) {
+    double minDist2 = INFINITY;
+    for(size_t i = 0; i < particles.size(); ++i)
+        for(size_t j = i + 1; j < particles.size(); ++j)
+            minDist2 = std::min(minDist2, (particles[i].pos - particles[j].pos).magnitude2());
+    return std::sqrt(minDist2);
+}
+
+TEST(GeneratorTest, Lattice) {
+    GeneratorSetup rectangle;
+    rectangle.minX = 0;
+    rectangle.minY = 0;
+    rectangle.maxX = 100;
+    rectangle.maxY = 50;
+    rectangle.spacing = 10;
+    std::vector<ParticleState> particles;
+    generateParticles(rectangle, testUniverseConfig(400, 300, 1), 1, 0, 0, particles);
+    ASSERT_EQ(10 + 9 + 10 + 9 + 10, particles.size()); // Rows of the triangular lattice alternate
+    EXPECT_NEAR(10, minDistance(particles), 1e-9);
+    for(const ParticleState &p: particles) {
+        EXPECT_TRUE(rectangle.contains(p.pos));
+        EXPECT_EQ(0, p.v.x);
+    }
+
+    // Droplets are centred on a lattice site and hold about one particle per lattice cell
+    GeneratorSetup droplet;
+    droplet.center = Vector2D(200, 150);
+    droplet.radius = 100;
+    droplet.spacing = 5;
+    particles.clear();
+    generateParticles(droplet, testUniverseConfig(400, 300, 3), 1, 0, 0, particles);
+    double cellArea = droplet.spacing * droplet.spacing * std::sqrt(3.) / 2;
+    EXPECT_NEAR(M_PI * 97.5 * 97.5 / cellArea, particles.size(), 0.02 * particles.size());
+    for(const ParticleState &p: particles)
+        EXPECT_LE((p.pos - droplet.center).magnitude(), droplet.radius - droplet.spacing / 2 + 1e-9);
+    EXPECT_EQ(1, std::count_if(particles.begin(), particles.end(),
+            [&](const ParticleState &p) { return p.pos.x == droplet.center.x && p.pos.y == droplet.center.y; }));
+}
+
+TEST(GeneratorTest, RandomFill) {
+    GeneratorSetup generator;
+    generator.kind = GeneratorKind::random;
+    generator.minX = 20;
+    generator.minY = 10;
+    generator.maxX = 380;
+    generator.maxY = 130;
+    generator.spacing = 4;
+    generator.density = 0.3 / (4 * 4);
+    generator.temperature = 2;
+
+    std::vector<ParticleState> particles, threaded;
+    generateParticles(generator, testUniverseConfig(400, 300, 1), 1.5, 7, 2, particles);
+    generateParticles(generator, testUniverseConfig(400, 300, 3), 1.5, 7, 2, threaded);
+    EXPECT_NEAR(generator.density * 360 * 120, particles.size(), 0.03 * particles.size());
+    EXPECT_GE(minDistance(particles), generator.spacing);
+    ASSERT_EQ(particles.size(), threaded.size());
+    for(size_t i = 0; i < particles.size(); ++i) {
+        EXPECT_EQ(particles[i].pos.x, threaded[i].pos.x);
+        EXPECT_EQ(particles[i].v.y, threaded[i].v.y);
+        EXPECT_TRUE(generator.contains(particles[i].pos));
+    }
+
+    // Maxwell-Boltzmann velocities: kinetic energy per particle equals the temperature in 2D, no net momentum
+    Vector2D momentum;
+    double kineticEnergy = 0;
+    for(const ParticleState &p: particles) {
+        momentum += p.v * 1.5;
+        kineticEnergy += 1.5 * p.v.magnitude2() / 2;
+    }
+    EXPECT_NEAR(0, momentum.magnitude(), 1e-9);
+    EXPECT_NEAR(generator.temperature, kineticEnergy / particles.size(), 0.1);
+
+    // Beyond the jamming density, as many particles are placed as fit
+    generator.density = 2 / (4. * 4);
+    particles.clear();
+    generateParticles(generator, testUniverseConfig(400, 300, 1), 1, 0, 0, particles);
+    EXPECT_GE(minDistance(particles), generator.spacing);
+    EXPECT_GT(particles.size(), 0.45 * 360 * 120 / (4 * 4));
+}
+
+TEST(GeneratorTest, SetupDirectives) {
+    std::string path = std::string(P_tmpdir) + "/PhaseTransitionGenerators-" + std::to_string(getpid()) + ".txt";
+    {
+        std::ofstream out(path);
+        out << "sizeX 400\nsizeY 300\n"
+            << "particleType 1 1 1 1 10 small Small.bmp\n"
+            << "particleType 2 1.5 1 0.5 8 large Large.bmp\n"
+            << "particle 10 10 0 0 1\n"
+            << "slab 0 0 40 5 0.5\n"
+            << "droplet 1 200 200 30 4 0\n"
+            << "randomFill 0 0 100 100 150 0.05 2 1\n"
+            << "latticeFill 1 300 100 400 150 5 0\n"
+            << "generatorSeed 3\n";
+    }
+    ::Setup setup(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(4, setup.generators.size());
+    EXPECT_EQ(3, setup.generatorSeed);
+    EXPECT_EQ(GeneratorKind::random, setup.generators[2].kind);
+    EXPECT_EQ(0.05, setup.generators[2].density);
+    EXPECT_EQ(2, setup.generators[2].spacing);
+    EXPECT_EQ(30, setup.generators[1].radius);
+
+    UniverseConfig config{ setup.sizeX, setup.sizeY, 1e-2, 0 };
+    Universe universe(config, setup.particleTypes);
+    setup.addParticlesToUniverse(universe);
+    size_t slab = 0, large = 0;
+    for(const ParticleState &p: universe) {
+        EXPECT_GE(p.pos.x, 0);
+        EXPECT_LE(p.pos.x, 400);
+        bool isSmall = p.type == & universe.getParticleTypes()[0];
+        slab += isSmall && p.pos.y < 40;
+        large += ! isSmall;
+    }
+    EXPECT_EQ(5 * 80 + 4 * 79, slab); // Rows across the whole width
+    EXPECT_GT(large, 1 + 150); // The explicit particle, the droplet and the lattice fill
+}
@@ -0,0 +1,75 @@
+#include "Lib/InputRecording.h"
+#include "Lib/Globals.h"
+#include <cstdio>
+#include <gtest/gtest.h>
+
+static std::string recordSession(uint32_t seed) {
+    // Creating particles, heating them and removing some, with idle frames in between
+    std::string path = std::string(P_tmpdir) + "/PhaseTransitionInput-" + std::to_string(seed) + ".bin";
+    InputRecorder recorder(path, seed);
+    CallbackHandler handler(2);
+    handler.pos = Vector2D(100, 80);
+    for(int frame = 0; frame < 40; ++frame) {
+        handler.sign = frame < 10 || (20 <= frame && frame < 30) ? 1 : frame >= 35 ? -1 : 0;
+        handler.action = 20 <= frame && frame < 30 ? MouseAction::heat : MouseAction::create;
+        handler.particleTypeIdx = frame % 2;
+        handler.radius = 100 + frame * 0.1;
+        recorder.record(handler, 1 + frame % 3);
+    }
+    return path;
+}
+
+static uint64_t replaySession(const std::string &path, size_t &frames, size_t &maxParticles) {
+    std::vector<ParticleType> types = { ParticleType(1, 4, 2, 0.8, 20), ParticleType(1, 5.6, 2.8, 1.12, 28) };
+    UniverseConfig config{ 200, 160, 1e-2, 1e-2 };
+    config.threads = 1;
+    Universe universe(config, types);
+    StepScheduler scheduler(StepSchedulerConfig{});
+
+    InputReplay replay(path);
+    EXPECT_TRUE(replay.good());
+    randomGenerator.seed(replay.getSeed());
+    InputFrame frame;
+    frames = maxParticles = 0;
+    while(replay.next(frame)) {
+        replayFrame(universe, scheduler, frame, 0.5);
+        ++frames;
+        maxParticles = std::max(maxParticles, universe.size());
+    }
+    EXPECT_LT(universe.size(), maxParticles);
+    return universe.stateHash();
+}
+
+TEST(InputRecordingTest, RecordsFrames) {
+    std::string path = recordSession(1);
+    InputReplay replay(path);
+    ASSERT_TRUE(replay.good());
+    EXPECT_EQ(1, replay.getSeed());
+
+    InputFrame frame;
+    for(int i = 0; i < 21; ++i)
+        ASSERT_TRUE(replay.next(frame));
+    EXPECT_EQ(100, frame.pos.x);
+    EXPECT_EQ(80, frame.pos.y);
+    EXPECT_DOUBLE_EQ(102, frame.radius);
+    EXPECT_EQ(1, frame.sign);
+    EXPECT_EQ(MouseAction::heat, frame.action);
+    EXPECT_EQ(0, frame.particleTypeIdx);
+    EXPECT_EQ(3, frame.substeps);
+    std::remove(path.c_str());
+
+    EXPECT_FALSE(InputReplay(path).good());
+}
+
+TEST(InputRecordingTest, ReplayIsReproducible) {
+    std::string path = recordSession(2);
+    size_t frames, maxParticles, frames2, maxParticles2;
+    uint64_t hash = replaySession(path, frames, maxParticles);
+    uint64_t hash2 = replaySession(path, frames2, maxParticles2);
+    std::remove(path.c_str());
+
+    EXPECT_EQ(40, frames);
+    EXPECT_GT(maxParticles, 20);
+    EXPECT_EQ(maxParticles, maxParticles2);
+    EXPECT_EQ(hash, hash2);
+}
@@ -30,3 +30,20 @@ TEST(IntegratorTest, Exponent) {
     EXPECT_NEAR(xEuler, M_E, 1e-2);
     EXPECT_NEAR(xRK4, M_E, 1e-8);
 }
+
+TEST(IntegratorTest, ExponentAdaptive) {
+    double x = 1, t = 0;
+    AdaptiveStepControl control;
+    control.dT = 0.5; // Much too large, should be rejected
+    control.tolerance = 1e-10;
+
+    Linear diff;
+    while(t < 1) {
+        control.dT = std::min(control.dT, 1 - t);
+        t += advanceDormandPrince<double, Linear, double>(x, diff, control);
+    }
+
+    EXPECT_NEAR(x, M_E, 1e-8);
+    EXPECT_GT(control.rejected, 0);
+    EXPECT_LT(control.accepted, 100);
+}
@@ -0,0 +1,124 @@
+#include "Lib/Universe.h"
+#include "Lib/LongRange.h"
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+
+static std::vector<ParticleType> chargedTypes() {
+    std::vector<ParticleType> types = { ParticleType(1, 1, 1, 0, 10), ParticleType(2, 1.5, 1, 0, 8),
+                                        ParticleType(1, 1, 1, 0, 10) };
+    types[0].setCharge(1);
+    types[1].setCharge(-0.5);
+    return types; // The third type is neutral
+}
+
+static UniverseState pseudorandomState(const UniverseConfig &config, const std::vector<ParticleType> &types, int n) {
+    UniverseState state;
+    state.setInteractionDistance(config, 10);
+    for(int i = 0; i < n; ++i) {
+        ParticleState p(Vector2D(config.sizeX * (0.5 + 0.5 * std::sin(i * 1.3)),
+                config.sizeY * (0.5 + 0.5 * std::sin(i * 2.9 + 1))));
+        p.type = & types[i % types.size()];
+        state.insert(p);
+    }
+    state.prepareDifferentiation();
+    return state;
+}
+
+TEST(LongRangeTest, TreeAgainstDirectSummation) {
+    std::vector<ParticleType> types = chargedTypes();
+    UniverseConfig config{ 500, 300, 1, 0 };
+    UniverseState state = pseudorandomState(config, types, 600);
+    BarnesHutTree tree;
+    tree.build(state);
+    EXPECT_NEAR(200 * 1 + 200 * -0.5, tree.getNodes()[0].charge, 1e-9);
+    EXPECT_NEAR(200 * 1 + 200 * 0.5, tree.getNodes()[0].absCharge, 1e-9);
+
+    double softening = 2, sum2 = 0, errorSum2 = 0;
+    for(const ParticleState &p: state) {
+        Vector2D expectedField;
+        double expectedPotential = 0;
+        for(const ParticleState &other: state) {
+            if(&other == &p) continue;
+            Vector2D d = p.pos - other.pos;
+            double r = std::sqrt(d.x * d.x + d.y * d.y + softening * softening);
+            expectedField += d * (other.type->getCharge() / (r * r * r));
+            expectedPotential += other.type->getCharge() / r;
+        }
+
+        Vector2D field;
+        double potential;
+        tree.field(state, p, 0, softening, field, potential); // Direct summation through the tree
+        EXPECT_NEAR(expectedField.x, field.x, 1e-12);
+        EXPECT_NEAR(expectedField.y, field.y, 1e-12);
+        EXPECT_NEAR(expectedPotential, potential, 1e-10);
+
+        tree.field(state, p, 0.5, softening, field, potential);
+        sum2 += expectedField.x * expectedField.x + expectedField.y * expectedField.y;
+        errorSum2 += std::pow((field - expectedField).magnitude(), 2);
+    }
+    EXPECT_LT(std::sqrt(errorSum2 / sum2), 0.05);
+}
+
+TEST(LongRangeTest, UniverseForces) {
+    // Particles far beyond their short range interact only through the long-range force
+    std::vector<ParticleType> types = chargedTypes();
+    UniverseConfig config{ 300, 300, 1, 0 };
+    config.longRangeCoupling = 10;
+    config.openingAngle = 0;
+    config.threads = 1;
+    Universe universe(config, types);
+    universe.addParticle(0, ParticleState(Vector2D(100, 150))); // +1
+    universe.addParticle(1, ParticleState(Vector2D(200, 150))); // -0.5, attracted
+    universe.addParticle(0, ParticleState(Vector2D(150, 50))); // +1, repelled by the first
+    universe.addParticle(2, ParticleState(Vector2D(150, 250))); // Neutral
+    universe.observe(300);
+    universe.advance(0.1);
+
+    // Potential energy of the pairs, measured before the step
+    auto pairPotential = [&](double q0, double q1, double d) {
+        return config.longRangeCoupling * q0 * q1 / std::sqrt(d * d + config.longRangeSoftening * config.longRangeSoftening);
+    };
+    double expected = pairPotential(1, -0.5, 100) + pairPotential(1, 1, std::sqrt(50 * 50 + 100 * 100))
+            + pairPotential(-0.5, 1, std::sqrt(50 * 50 + 100 * 100));
+    EXPECT_NEAR(expected, universe.getObservations().back().grid.total().potentialEnergy, 1e-9);
+
+    for(int i = 0; i < 20; ++i)
+        universe.advance(0.1);
+    std::vector<ParticleState> particles;
+    for(const ParticleState &p: universe)
+        particles.push_back(p);
+    std::sort(particles.begin(), particles.end(),
+            [](const ParticleState &lhs, const ParticleState &rhs) { return lhs.id < rhs.id; });
+    EXPECT_GT(particles[0].v.x, 0);
+    EXPECT_LT(particles[1].v.x, 0);
+    EXPECT_LT(particles[2].v.y, 0);
+    EXPECT_EQ(0, particles[3].v.x);
+    EXPECT_EQ(0, particles[3].v.y);
+
+    // Pairwise forces conserve momentum with direct summation
+    Vector2D momentum;
+    for(const ParticleState &p: particles)
+        momentum += p.v * p.type->getMass();
+    EXPECT_NEAR(0, momentum.x, 1e-12);
+    EXPECT_NEAR(0, momentum.y, 1e-12);
+}
+
+TEST(LongRangeTest, ThreadIndependent) {
+    std::vector<ParticleType> types = chargedTypes();
+    uint64_t hashes[2];
+    for(int threads: { 1, 3 }) {
+        UniverseConfig config{ 200, 200, 1, 0 };
+        config.longRangeCoupling = -1;
+        config.threads = threads;
+        Universe universe(config, types);
+        for(int i = 0; i < 300; ++i) {
+            Vector2D pos(100 + 90 * std::sin(i * 1.3), 100 + 90 * std::sin(i * 2.9));
+            universe.addParticle(i % 3, ParticleState(pos, Vector2D(std::sin(i), std::cos(i))));
+        }
+        for(int i = 0; i < 5; ++i)
+            universe.advance(0.05);
+        hashes[threads == 1 ? 0 : 1] = universe.stateHash();
+    }
+    EXPECT_EQ(hashes[0], hashes[1]);
+}
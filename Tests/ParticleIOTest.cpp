@@ -0,0 +1,179 @@
+#include "Lib/ParticleIO.h"
+#include "Lib/Setup.h"
+#include "Tests/Fixtures.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+static std::string tempPath(const std::string &name) {
+    return std::string(P_tmpdir) + "/PhaseTransition" + name + "-" + std::to_string(getpid());
+}
+
+static void writeFile(const std::string &path, const std::string &contents) {
+    std::ofstream out(path, std::ios::binary);
+    out << contents;
+}
+
+static ParticleState particle(int i) {
+    return ParticleState(Vector2D(5 + std::fmod(37.3 * i, 390), 5 + std::fmod(11.9 * i, 290)),
+            Vector2D(std::sin(i) / 3, std::cos(i) / 7));
+}
+
+TEST(ParticleIOTest, BulkInsertMatchesAddParticle) {
+    // With several threads, 50000 particles are binned in three chunks
+    for(int threads: { 1, 3 }) {
+        const int n = threads == 1 ? 500 : 50000;
+        Universe single(testUniverseConfig(400, 300, 1), testTypes);
+        Universe bulk(testUniverseConfig(400, 300, threads), testTypes);
+        std::vector<ParticleState> particles;
+        for(int i = 0; i < n; ++i) {
+            single.addParticle(i % 2, particle(i));
+            particles.push_back(particle(i));
+            particles.back().type = & bulk.getParticleTypes()[i % 2];
+        }
+        bulk.addParticles(particles);
+        ASSERT_EQ(single.size(), bulk.size());
+        EXPECT_EQ(single.stateHash(), bulk.stateHash());
+        auto it = bulk.begin();
+        for(const ParticleState &p: single) {
+            EXPECT_EQ(p.id, it->id);
+            EXPECT_EQ(p.type - single.getParticleTypes().data(), it->type - bulk.getParticleTypes().data());
+            ++it;
+        }
+        if(threads > 1) continue;
+        single.advance(0.1);
+        bulk.advance(0.1);
+        EXPECT_EQ(single.stateHash(), bulk.stateHash());
+    }
+}
+
+TEST(ParticleIOTest, RoundTrip) {
+    Universe universe(testUniverseConfig(400, 300, 1), testTypes);
+    for(int i = 0; i < 300; ++i)
+        universe.addParticle(i % 2, particle(i));
+    universe.advance(0.1); // Coordinates with all digits
+
+    std::string path = tempPath("Particles");
+    for(ParticleFormat format: { ParticleFormat::csv, ParticleFormat::binary }) {
+        exportParticles(universe, path, format);
+        Universe imported(testUniverseConfig(400, 300, 3), testTypes);
+        importParticles(imported, path, format);
+        std::remove(path.c_str());
+
+        // Particles are exported in iteration order and inserted in file order, so they come back in the same order
+        ASSERT_EQ(universe.size(), imported.size());
+        EXPECT_EQ(universe.stateHash(), imported.stateHash());
+        auto it = imported.begin();
+        for(const ParticleState &p: universe) {
+            EXPECT_EQ(p.type - universe.getParticleTypes().data(), it->type - imported.getParticleTypes().data());
+            ++it;
+        }
+    }
+}
+
+TEST(ParticleIOTest, CsvParsing) {
+    std::string path = tempPath("Particles.csv");
+    writeFile(path, "type, x, y, vx, vy\r\n"
+            "0,10,20,0.5,-1\r\n"
+            "\n"
+            "1 , 1.25e2 ,+3E1, -.125 , 0\n"
+            "1,0.1,123456789.123456789,1e-30,5"); // No final newline
+    Universe universe(testUniverseConfig(400, 300, 1), testTypes);
+    importParticles(universe, path, ParticleFormat::csv);
+    std::remove(path.c_str());
+    ASSERT_EQ(3, universe.size());
+
+    std::vector<ParticleState> particles;
+    for(const ParticleState &p: universe)
+        particles.push_back(p);
+    std::sort(particles.begin(), particles.end(),
+            [](const ParticleState &lhs, const ParticleState &rhs) { return lhs.id < rhs.id; });
+    EXPECT_EQ(& universe.getParticleTypes()[0], particles[0].type);
+    EXPECT_EQ(20, particles[0].pos.y);
+    EXPECT_EQ(-1, particles[0].v.y);
+    EXPECT_EQ(& universe.getParticleTypes()[1], particles[1].type);
+    EXPECT_EQ(125, particles[1].pos.x);
+    EXPECT_EQ(30, particles[1].pos.y);
+    EXPECT_EQ(-0.125, particles[1].v.x);
+    EXPECT_EQ(0.1, particles[2].pos.x);
+    EXPECT_EQ(123456789.123456789, particles[2].pos.y); // Long mantissa, parsed by the fallback
+    EXPECT_EQ(1e-30, particles[2].v.x);
+}
+
+TEST(ParticleIOTest, LargeCsvInChunks) {
+    // Several chunks of lines, parsed by several threads
+    std::string path = tempPath("Large.csv");
+    std::string contents;
+    const int n = 60000;
+    for(int i = 0; i < n; ++i)
+        contents += std::to_string(i % 2) + "," + std::to_string(i % 400) + ".5," + std::to_string(i % 300)
+                + ".25,0.001," + std::to_string(i) + "\n";
+    writeFile(path, contents);
+    Universe universe(testUniverseConfig(400, 300, 3), testTypes);
+    importParticles(universe, path, ParticleFormat::csv);
+    std::remove(path.c_str());
+    ASSERT_EQ(n, universe.size());
+    for(const ParticleState &p: universe) {
+        EXPECT_EQ(p.id, p.v.y); // File order is kept across chunks
+        EXPECT_EQ(p.id % 2, p.type - universe.getParticleTypes().data());
+        EXPECT_EQ(p.id % 400 + 0.5, p.pos.x);
+    }
+}
+
+TEST(ParticleIOTest, MalformedFiles) {
+    std::string path = tempPath("Malformed");
+    Universe universe(testUniverseConfig(400, 300, 1), testTypes);
+    for(const char *contents: { "0,1,2,3,4\n0,1,2,3\n", "0,1,2,3,4,5\n", "0,1,x,3,4\n", "2,1,2,3,4\n",
+            "0.5,1,2,3,4\n", "0,1,2,3,inf\n", "0,1,2,3,\n" }) {
+        writeFile(path, contents);
+        EXPECT_THROW(importParticles(universe, path, ParticleFormat::csv), std::runtime_error) << contents;
+        EXPECT_THROW(importParticles(universe, path, ParticleFormat::binary), std::runtime_error) << contents;
+    }
+    writeFile(path, "type,x,y,vx,vy\n0,1,2,3,4\n0,1,2,3\n");
+    try {
+        importParticles(universe, path, ParticleFormat::csv);
+        FAIL();
+    } catch(const std::runtime_error &error) {
+        EXPECT_NE(std::string::npos, std::string(error.what()).find(":3:")); // Line of the error
+    }
+    std::remove(path.c_str());
+    EXPECT_EQ(0, universe.size()); // Nothing is added from a malformed file
+    EXPECT_THROW(importParticles(universe, path, ParticleFormat::csv), std::runtime_error); // Doesn't exist
+    EXPECT_THROW(parseParticleFormat("json"), std::runtime_error);
+}
+
+TEST(ParticleIOTest, SetupDirectives) {
+    std::string particlesPath = tempPath("SetupParticles.bin");
+    {
+        Universe universe(testUniverseConfig(400, 300, 1), testTypes);
+        for(int i = 0; i < 50; ++i)
+            universe.addParticle(1, particle(i));
+        exportParticles(universe, particlesPath, ParticleFormat::binary);
+    }
+
+    std::string path = tempPath("SetupParticles.txt");
+    writeFile(path, "sizeX 400\nsizeY 300\n"
+            "particleType 1 1 1 1 10 small Small.bmp\n"
+            "particleType 2 1.5 1 0.5 8 large Large.bmp\n"
+            "importParticles " + particlesPath.substr(particlesPath.rfind('/') + 1) + " binary\n"
+            "exportParticles out.csv csv\n");
+    ::Setup setup(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(1, setup.particleImports.size());
+    EXPECT_EQ(particlesPath, setup.particleImports[0].path); // Relative to the setup file
+    EXPECT_EQ(ParticleFormat::binary, setup.particleImports[0].format);
+    EXPECT_EQ(setup.directoryPath + "out.csv", setup.particleExport.path);
+    EXPECT_EQ(ParticleFormat::csv, setup.particleExport.format);
+
+    UniverseConfig config{ setup.sizeX, setup.sizeY, 1e-2, 0 };
+    Universe universe(config, setup.particleTypes);
+    setup.addParticlesToUniverse(universe);
+    std::remove(particlesPath.c_str());
+    EXPECT_EQ(50, universe.size());
+    for(const ParticleState &p: universe)
+        EXPECT_EQ(& universe.getParticleTypes()[1], p.type);
+}
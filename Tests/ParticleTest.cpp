@@ -48,3 +48,15 @@ TEST(ParticleTest, ForceRange) {
 
     EXPECT_DOUBLE_EQ(type0.computeForce(type1, state0, state2).x, 0);
 }
+
+TEST(ParticleTest, PotentialMatchesForce) {
+    ParticleType type0(1, 1, 1, 1, 10);
+    ParticleType type1(2, 2, 2, 2, 20);
+    const double diff = 1e-4;
+
+    EXPECT_DOUBLE_EQ(type0.computePotential(type1, type0.getRange()), 0);
+    for(double d = 0.5; d < type0.getRange(); d += 0.5) {
+        double force = -(type0.computePotential(type1, d + diff) - type0.computePotential(type1, d - diff)) / (2 * diff);
+        EXPECT_NEAR(force, type0.computeForceMagnitude(type1, d), 1e-5);
+    }
+}
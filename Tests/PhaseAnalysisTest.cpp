@@ -0,0 +1,45 @@
+
+#include "Lib/Universe.h"
+#include <gtest/gtest.h>
+#include <cmath>
+
+TEST(PhaseAnalysisTest, LatticesAndGas) {
+    std::vector<ParticleType> types = { ParticleType(1, 1, 1, 1, 10) };
+    const double spacing = 2.1;
+    for(int threads = 1; threads <= 3; ++threads) {
+        UniverseConfig config{ 200, 200, 1, 0 };
+        config.threads = threads;
+        Universe universe(config, types);
+        // Triangular lattice is ordered (solid), square lattice has psi6 == 0 (liquid), lone particles are gas
+        for(int i = 0; i < 10; ++i)
+            for(int j = 0; j < 10; ++j) {
+                Vector2D triangular(20 + spacing * (i + 0.5 * (j % 2)), 20 + spacing * std::sqrt(3) / 2 * j);
+                universe.addParticle(0, ParticleState(triangular));
+                universe.addParticle(0, ParticleState(Vector2D(120 + spacing * i, 20 + spacing * j)));
+            }
+        universe.addParticle(0, ParticleState(Vector2D(100, 180)));
+        universe.addParticle(0, ParticleState(Vector2D(150, 180)));
+
+        PhaseAnalysisConfig phaseConfig;
+        phaseConfig.interval = 1;
+        universe.analysePhases(phaseConfig);
+        universe.advance(1e-9); // Phases are analysed after the step
+        ASSERT_EQ(1, universe.getPhaseSamples().size());
+        const PhaseSample &sample = universe.getPhaseSamples().back();
+
+        EXPECT_EQ(2, sample.phaseCounts[(int) Phase::gas]);
+        EXPECT_EQ(100, sample.largestCluster);
+        ASSERT_EQ(7, sample.clusterSizes.size());
+        EXPECT_EQ(2, sample.clusterSizes[0]); // Clusters of size 1
+        EXPECT_EQ(2, sample.clusterSizes[6]); // Clusters of size 64...127
+
+        int solidInTriangular = 0, liquidInSquare = 0;
+        for(auto it = universe.begin(); it != universe.end(); ++it) {
+            if(it->pos.y > 100) continue;
+            if(it->pos.x < 100) solidInTriangular += it->phase == Phase::solid;
+            else liquidInSquare += it->phase == Phase::liquid;
+        }
+        EXPECT_GT(solidInTriangular, 50); // Particles at the edges have too few neighbours
+        EXPECT_EQ(100, liquidInSquare);
+    }
+}
@@ -0,0 +1,81 @@
+#include "Lib/Universe.h"
+#include "Lib/Profiler.h"
+#include "Tests/Fixtures.h"
+#include <cmath>
+#include <sstream>
+#include <gtest/gtest.h>
+
+static size_t countOccurrences(const std::string &text, const std::string &pattern) {
+    size_t count = 0;
+    for(size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+        ++count;
+    return count;
+}
+
+static void advance(int threads, int steps) {
+    UniverseConfig config{ 100, 100, 1, 1e-2 };
+    config.threads = threads;
+    Universe universe(config, testTypes);
+    addLattice(universe, 200, 20, 4, 10, 1);
+    universe.setThermostats({ Thermostat() });
+    for(int i = 0; i < steps; ++i)
+        universe.advance(0.05);
+}
+
+TEST(ProfilerTest, PhasesAndTrace) {
+    Profiler profiler;
+    Profiler::activate(&profiler);
+    advance(1, 3);
+    Profiler::activate(nullptr);
+    advance(1, 3); // Not recorded
+
+    // RK4 computes forces 4 times per step
+    std::map<std::string, PhaseStats> phases = profiler.phaseTotals();
+    EXPECT_EQ(3, phases["step"].count);
+    EXPECT_EQ(12, phases["forces"].count);
+    EXPECT_EQ(3, phases["thermostats"].count);
+    EXPECT_EQ(0, phases.count("phaseAnalysis"));
+    EXPECT_GT(phases["step"].seconds, 0);
+    EXPECT_GE(phases["step"].seconds, phases["forces"].seconds);
+    if(profiler.countersAvailable()) {
+        EXPECT_GT(phases["forces"].counts.values[1], 0); // Instructions
+        EXPECT_GE(phases["step"].counts.values[1], phases["forces"].counts.values[1]);
+    }
+
+    std::ostringstream trace;
+    profiler.writeTrace(trace);
+    std::string json = trace.str();
+    EXPECT_EQ(0, json.find("{\"traceEvents\":["));
+    EXPECT_EQ(countOccurrences(json, "{"), countOccurrences(json, "}"));
+    EXPECT_EQ(3, countOccurrences(json, "\"name\":\"step\""));
+    EXPECT_EQ(12, countOccurrences(json, "\"name\":\"forces\""));
+    size_t boxes = countOccurrences(json, "\"name\":\"box\"");
+    EXPECT_GT(boxes, 0);
+    EXPECT_EQ(0, boxes % 12); // Every box once per force computation
+    EXPECT_EQ(boxes, countOccurrences(json, "\"particles\":"));
+}
+
+TEST(ProfilerTest, Threads) {
+    Profiler profiler(false);
+    Profiler::activate(&profiler);
+    advance(3, 2);
+    Profiler::activate(nullptr);
+    EXPECT_FALSE(profiler.countersAvailable());
+
+    // Each worker records its own forces span, all boxes are recorded once per force computation
+    Profiler single(false);
+    Profiler::activate(&single);
+    advance(1, 2);
+    Profiler::activate(nullptr);
+
+    EXPECT_EQ(24, profiler.phaseTotals()["forces"].count);
+    std::ostringstream trace, singleTrace;
+    profiler.writeTrace(trace);
+    single.writeTrace(singleTrace);
+    EXPECT_EQ(countOccurrences(singleTrace.str(), "\"name\":\"box\""), countOccurrences(trace.str(), "\"name\":\"box\""));
+    EXPECT_GE(countOccurrences(trace.str(), "\"name\":\"thread_name\""), 2);
+
+    std::ostringstream summary;
+    profiler.writeSummary(summary);
+    EXPECT_NE(std::string::npos, summary.str().find("forces"));
+}
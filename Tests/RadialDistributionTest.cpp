@@ -0,0 +1,52 @@
+
+#include "Lib/Universe.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+
+TEST(RadialDistributionTest, PairDistance) {
+    Universe universe({ 20, 20, 1, 0 }, { ParticleType(1, 1, 1, 1, 10), ParticleType(1, 1, 1, 1, 10) });
+    universe.addParticle(0, ParticleState(Vector2D(5, 10)));
+    universe.addParticle(1, ParticleState(Vector2D(8.5, 10)));
+    universe.measureRadialDistribution(1, 10);
+    universe.advance(1e-6);
+
+    const RadialDistribution &distribution = universe.getRadialDistribution();
+    EXPECT_EQ(10, distribution.bins());
+    double expected = 1 * 1 * M_PI * (4 * 4 - 3 * 3) / (20 * 20); // Ideal gas pairs in the bin
+    EXPECT_NEAR(1 / expected, distribution.g(1, 0, 3), 1e-9);
+    EXPECT_EQ(0, distribution.g(0, 1, 2));
+    EXPECT_EQ(0, distribution.g(0, 0, 3));
+}
+
+TEST(RadialDistributionTest, IdealGas) {
+    // Non-interacting particles at random positions have g(r) == 1, except for fewer neighbours near the walls
+    std::vector<ParticleType> types = { ParticleType(1, 1, 0, 0, 10) };
+    std::vector<Universe> universes;
+    universes.reserve(2);
+    for(int threads = 1; threads <= 2; ++threads) {
+        UniverseConfig config{ 400, 400, 1, 0 };
+        config.threads = threads;
+        universes.emplace_back(config, types);
+        std::mt19937 generator(1);
+        std::uniform_real_distribution<> coordinate(0, 400);
+        for(int i = 0; i < 16000; ++i)
+            universes.back().addParticle(0, ParticleState(Vector2D(coordinate(generator), coordinate(generator))));
+        universes.back().measureRadialDistribution(1, 3);
+        for(int i = 0; i < 2; ++i)
+            universes.back().advance(1);
+    }
+
+    const RadialDistribution &distribution = universes[0].getRadialDistribution();
+    for(int bin = 2; bin < distribution.bins(); ++bin) {
+        EXPECT_NEAR(1, distribution.g(bin), 0.08);
+        EXPECT_DOUBLE_EQ(distribution.g(bin), universes[1].getRadialDistribution().g(bin));
+    }
+    EXPECT_NEAR(1, distribution.structureFactor(2, 10), 0.2);
+
+    std::stringstream out;
+    universes[0].writeRadialDistribution(out);
+    std::string header;
+    std::getline(out, header);
+    EXPECT_EQ("# r g g_0_0", header);
+}
@@ -0,0 +1,94 @@
+#include "Lib/Universe.h"
+#include "Tests/Fixtures.h"
+#include <cmath>
+#include <map>
+#include <gtest/gtest.h>
+
+TEST(RewindTest, RestoresRecordedStates) {
+    UniverseConfig config{ 200, 200, 1e-2, 1e-2 };
+    config.threads = 1;
+    Universe universe(config, testTypes);
+    addLattice(universe, 100, 10, 8, 10, 1);
+    universe.enableRewind(3, 5);
+    EXPECT_FALSE(universe.rewind());
+
+    std::map<uint64_t, uint64_t> hashes;
+    for(int i = 0; i < 22; ++i) {
+        universe.advance(0.1);
+        hashes[universe.getSteps()] = universe.stateHash();
+    }
+    EXPECT_EQ(3, universe.getRewindBuffer().size());
+
+    // A mis-click removes particles
+    auto it = universe.begin();
+    for(int i = 0; i < 30; ++i)
+        it = universe.erase(it);
+    EXPECT_EQ(70, universe.size());
+
+    ASSERT_TRUE(universe.rewind());
+    EXPECT_EQ(20, universe.getSteps());
+    EXPECT_NEAR(2, universe.getTime(), 1e-12);
+    EXPECT_EQ(100, universe.size());
+    EXPECT_EQ(hashes[20], universe.stateHash());
+
+    ASSERT_TRUE(universe.rewind()); // Steps back from the state just restored
+    EXPECT_EQ(15, universe.getSteps());
+    EXPECT_EQ(hashes[15], universe.stateHash());
+
+    // The trajectory continues as it did before
+    for(int i = 0; i < 5; ++i)
+        universe.advance(0.1);
+    EXPECT_EQ(hashes[20], universe.stateHash());
+
+    ASSERT_TRUE(universe.rewind(100)); // As far back as possible
+    EXPECT_EQ(10, universe.getSteps());
+    EXPECT_EQ(hashes[10], universe.stateHash());
+    EXPECT_FALSE(universe.rewind());
+}
+
+TEST(RewindTest, SharesUnchangedBoxes) {
+    // Particles at rest far from each other don't move, so their boxes are shared between the points
+    Universe universe(UniverseConfig{ 400, 400, 1e-2, 0 }, testTypes);
+    for(int i = 0; i < 16; ++i)
+        universe.addParticle(0, ParticleState(Vector2D(20 + 100 * (i % 4), 20 + 100 * (i / 4))));
+    universe.addParticle(1, ParticleState(Vector2D(200, 200), Vector2D(1, 0)));
+    universe.enableRewind(4, 1);
+    for(int i = 0; i < 4; ++i)
+        universe.advance(0.1);
+
+    EXPECT_EQ(4, universe.getRewindBuffer().size());
+    EXPECT_EQ(16 * 4, universe.getRewindBuffer().sharedBoxes());
+    EXPECT_GT(universe.getRewindBuffer().sharedLayouts(), 0); // The moving particle stays in its box
+}
+
+TEST(RewindTest, UndoesEditAtRecordedStep) {
+    UniverseConfig config{ 200, 200, 1e-2, 1e-2 };
+    config.threads = 1;
+    Universe universe(config, testTypes);
+    addLattice(universe, 50, 10, 8, 10, 1);
+    universe.enableRewind(3, 5);
+    universe.observe(50);
+    PhaseAnalysisConfig phaseConfig;
+    phaseConfig.interval = 2;
+    universe.analysePhases(phaseConfig);
+    for(int i = 0; i < 10; ++i)
+        universe.advance(0.1);
+    uint64_t recorded = universe.stateHash();
+
+    // An edit right after the point of step 10 is undone by going back to that point, not to step 5
+    universe.erase(universe.begin());
+    ASSERT_TRUE(universe.rewind());
+    EXPECT_EQ(10, universe.getSteps());
+    EXPECT_EQ(50, universe.size());
+    EXPECT_EQ(recorded, universe.stateHash());
+
+    ASSERT_TRUE(universe.rewind());
+    EXPECT_EQ(5, universe.getSteps());
+
+    // Samples don't reach beyond the restored time
+    EXPECT_LT(universe.getObservations().back().time, universe.getTime());
+    EXPECT_EQ(5, universe.getObservations().size());
+    EXPECT_NEAR(0.4, universe.getPhaseSamples().back().time, 1e-12); // Analysed after step 4
+    for(const PhaseSample &sample: universe.getPhaseSamples())
+        EXPECT_LE(sample.time, universe.getTime() + 1e-12);
+}
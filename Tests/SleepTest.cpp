@@ -0,0 +1,136 @@
+#include "Lib/Universe.h"
+#include "Tests/Fixtures.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+static const ParticleState & particleAt(Universe &universe, const Vector2D &pos) {
+    const ParticleState *nearest = nullptr;
+    for(const ParticleState &p: universe)
+        if(! nearest || (p.pos - pos).magnitude() < (nearest->pos - pos).magnitude()) nearest = &p;
+    return *nearest;
+}
+
+TEST(SleepTest, FallAsleepAndWake) {
+    Universe universe(testUniverseConfig(200, 200, 1), testTypes);
+    // Particles at rest, further apart than their interaction range
+    for(int i = 0; i < 16; ++i)
+        universe.addParticle(i % 2, ParticleState(Vector2D(40 + 30 * (i % 4), 40 + 30 * (i / 4))));
+    SleepConfig sleep;
+    sleep.steps = 5;
+    universe.enableSleeping(sleep);
+    for(int i = 0; i < 4; ++i)
+        universe.advance(0.1);
+    EXPECT_EQ(0, universe.getSleepingParticles());
+    universe.advance(0.1);
+    EXPECT_EQ(16, universe.getSleepingParticles());
+
+    universe.wake(Vector2D(40, 40), 1);
+    EXPECT_FALSE(particleAt(universe, Vector2D(40, 40)).asleep);
+    EXPECT_TRUE(particleAt(universe, Vector2D(70, 40)).asleep);
+
+    // A particle flying past wakes the boxes within the interaction range
+    universe.addParticle(0, ParticleState(Vector2D(100, 95), Vector2D(1, 0)));
+    universe.advance(0.1);
+    EXPECT_FALSE(particleAt(universe, Vector2D(100, 100)).asleep);
+    EXPECT_TRUE(particleAt(universe, Vector2D(100, 70)).asleep); // Boxes further away stay asleep
+    EXPECT_TRUE(particleAt(universe, Vector2D(130, 100)).asleep);
+
+    // Disabling wakes everyone
+    sleep.steps = 0;
+    universe.enableSleeping(sleep);
+    EXPECT_EQ(0, universe.getSleepingParticles());
+    for(const ParticleState &p: universe)
+        EXPECT_FALSE(p.asleep);
+}
+
+TEST(SleepTest, AddingWakesNeighbours) {
+    Universe universe(testUniverseConfig(200, 200, 1), testTypes);
+    for(int i = 0; i < 16; ++i)
+        universe.addParticle(i % 2, ParticleState(Vector2D(40 + 30 * (i % 4), 40 + 30 * (i / 4))));
+    SleepConfig sleep;
+    sleep.steps = 5;
+    universe.enableSleeping(sleep);
+    for(int i = 0; i < 5; ++i)
+        universe.advance(0.1);
+    ASSERT_EQ(16, universe.getSleepingParticles());
+
+    // Added particles are within the interaction range of their neighbours, which are woken right away
+    universe.addParticle(0, ParticleState(Vector2D(40, 47)));
+    EXPECT_FALSE(particleAt(universe, Vector2D(40, 40)).asleep);
+    std::vector<ParticleState> particles = { ParticleState(Vector2D(100, 47)) };
+    particles[0].type = & universe.getParticleTypes()[0];
+    universe.addParticles(particles);
+    EXPECT_FALSE(particleAt(universe, Vector2D(100, 40)).asleep);
+    universe.getCommandQueue().push(UniverseCommand::add(0, Vector2D(130, 137)));
+    universe.advance(0.1);
+    EXPECT_FALSE(particleAt(universe, Vector2D(130, 130)).asleep);
+    EXPECT_TRUE(particleAt(universe, Vector2D(70, 70)).asleep); // Others stay asleep
+}
+
+TEST(SleepTest, RemovingWakesNeighbours) {
+    Universe universe(testUniverseConfig(200, 200, 1), testTypes);
+    for(int i = 0; i < 16; ++i)
+        universe.addParticle(i % 2, ParticleState(Vector2D(40 + 30 * (i % 4), 40 + 30 * (i / 4))));
+    universe.addParticle(0, ParticleState(Vector2D(50.5, 40))); // Just outside the range of the one at (40, 40)
+    SleepConfig sleep;
+    sleep.steps = 5;
+    universe.enableSleeping(sleep);
+    for(int i = 0; i < 5; ++i)
+        universe.advance(0.1);
+    ASSERT_EQ(17, universe.getSleepingParticles());
+
+    // The removed particle was within the interaction range of the box next to it
+    universe.getCommandQueue().push(UniverseCommand::removeInRadius(Vector2D(40, 40), 1));
+    universe.advance(0.1);
+    EXPECT_EQ(16, universe.size());
+    EXPECT_FALSE(particleAt(universe, Vector2D(50.5, 40)).asleep);
+    EXPECT_TRUE(particleAt(universe, Vector2D(70, 40)).asleep);
+}
+
+TEST(SleepTest, ErrorBound) {
+    // A slow particle is frozen and checked periodically, its error per sleep stays within the documented bound
+    const double dT = 0.1;
+    const Vector2D v(0.006, -0.004);
+    SleepConfig sleep;
+    sleep.steps = 5;
+    Universe reference(testUniverseConfig(200, 200, 1), testTypes);
+    Universe sleeping(testUniverseConfig(200, 200, 1), testTypes);
+    reference.addParticle(0, ParticleState(Vector2D(100, 100), v));
+    sleeping.addParticle(0, ParticleState(Vector2D(100, 100), v));
+    sleeping.enableSleeping(sleep);
+
+    int sleeps = 0;
+    bool wasAsleep = false;
+    for(int i = 0; i < 40; ++i) {
+        reference.advance(dT);
+        sleeping.advance(dT);
+        bool asleep = sleeping.getSleepingParticles() == 1;
+        sleeps += asleep && ! wasAsleep;
+        wasAsleep = asleep;
+    }
+    EXPECT_GE(sleeps, 3); // Woken for checks in between
+
+    double T = sleep.steps * dT;
+    double bound = sleep.maxVelocity * T + sleep.maxAcceleration * T * T / 2;
+    const ParticleState &p = *sleeping.begin(), &expected = *reference.begin();
+    EXPECT_GT((p.pos - expected.pos).magnitude(), 0);
+    EXPECT_LE((p.pos - expected.pos).magnitude(), sleeps * bound);
+    EXPECT_LE((p.v - expected.v).magnitude(), sleep.maxVelocity + sleep.maxAcceleration * T);
+}
+
+TEST(SleepTest, ActiveSystemUnchanged) {
+    // Nothing falls asleep in a hot system, so the trajectory is the same as without sleeping
+    uint64_t hashes[2];
+    for(int enabled = 0; enabled < 2; ++enabled) {
+        Universe universe(testUniverseConfig(200, 200, 1), testTypes);
+        addLattice(universe, 100, 10, 8, 10, 1);
+        SleepConfig sleep;
+        sleep.steps = enabled ? 3 : 0;
+        universe.enableSleeping(sleep);
+        for(int i = 0; i < 10; ++i)
+            universe.advance(0.1);
+        EXPECT_EQ(0, universe.getSleepingParticles());
+        hashes[enabled] = universe.stateHash();
+    }
+    EXPECT_EQ(hashes[0], hashes[1]);
+}
@@ -0,0 +1,86 @@
+#include "Lib/Universe.h"
+#include "Tests/Fixtures.h"
+#include <chrono>
+#include <cmath>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+TEST(SnapshotRingTest, PublishesParticles) {
+    std::string name = "/PhaseTransitionSnapshots-" + std::to_string(getpid());
+    auto writer = std::make_shared<SnapshotWriter>(name, 2, 50);
+    Universe universe(UniverseConfig{ 200, 200, 1e-2, 0 }, testTypes);
+    addLattice(universe, 60, 20, 8, 10, 0.1);
+    universe.publishSnapshots(writer, 3);
+    SnapshotReader reader(name);
+    EXPECT_EQ(2, reader.slots());
+    EXPECT_EQ(50, reader.capacity());
+
+    SnapshotView view;
+    EXPECT_FALSE(reader.read(1, view));
+    for(int i = 0; i < 7; ++i)
+        universe.advance(1e-2);
+    ASSERT_EQ(2, reader.published());
+    ASSERT_TRUE(reader.read(2, view));
+    EXPECT_EQ(6, view.step);
+    EXPECT_NEAR(6e-2, view.time, 1e-12);
+    EXPECT_EQ(50, view.count); // Truncated to the capacity
+    EXPECT_EQ(60, view.total);
+    for(size_t i = 0; i < view.count; ++i) {
+        EXPECT_EQ(view.particles[i].id % 2, view.particles[i].type);
+        EXPECT_LT(view.particles[i].id, 60);
+    }
+    EXPECT_TRUE(reader.read(1, view));
+
+    // Overwriting the slot of a snapshot being read invalidates it
+    for(int i = 0; i < 6; ++i)
+        universe.advance(1e-2);
+    EXPECT_FALSE(reader.stillValid(view));
+    EXPECT_FALSE(reader.read(1, view));
+
+    EXPECT_THROW(SnapshotReader("/PhaseTransitionNoSuchRing"), std::runtime_error);
+}
+
+TEST(SnapshotRingTest, ConcurrentReaderProcess) {
+    // A reader process checks every snapshot it manages to read while the universe is advanced
+    const int nParticles = 300, nSteps = 200;
+    std::string name = "/PhaseTransitionSnapshots-" + std::to_string(getpid());
+    auto writer = std::make_shared<SnapshotWriter>(name, 3, nParticles);
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        SnapshotReader reader(name);
+        int consistent = 0, inconsistent = 0;
+        uint64_t lastStep = 0;
+        auto begin = std::chrono::steady_clock::now();
+        while(lastStep < nSteps && std::chrono::steady_clock::now() - begin < std::chrono::seconds(60)) {
+            SnapshotView view;
+            if(! reader.read(reader.published(), view)) continue;
+            uint64_t idSum = 0;
+            bool finite = true;
+            for(size_t i = 0; i < view.count; ++i) {
+                idSum += view.particles[i].id;
+                finite &= std::isfinite(view.particles[i].x) && std::isfinite(view.particles[i].y);
+            }
+            if(! reader.stillValid(view)) continue; // Torn read, discarded
+
+            bool ok = view.step == view.generation && view.step >= lastStep && view.count == nParticles
+                    && idSum == (uint64_t) nParticles * (nParticles - 1) / 2 && finite;
+            ++(ok ? consistent : inconsistent);
+            lastStep = view.step;
+        }
+        _exit(consistent > 0 && inconsistent == 0 && lastStep == nSteps ? 0 : 1);
+    }
+
+    UniverseConfig config{ 200, 200, 1e-2, 0 };
+    config.threads = 1;
+    Universe universe(config, testTypes);
+    addLattice(universe, nParticles, 20, 8, 10, 0.1);
+    universe.publishSnapshots(writer);
+    for(int i = 0; i < nSteps; ++i)
+        universe.advance(1e-2);
+
+    int status;
+    waitpid(pid, & status, 0);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
@@ -0,0 +1,33 @@
+
+#include "Lib/StepScheduler.h"
+#include <gtest/gtest.h>
+
+TEST(StepSchedulerTest, StabilityGuard) {
+    Universe universe({ 400, 400, 1, 0 }, { ParticleType(1, 2, 1, 1, 10) });
+    StepSchedulerConfig config;
+    config.maxSubstepDT = 0.1;
+    config.stabilityFactor = 0.5;
+    StepScheduler scheduler(config);
+
+    universe.addParticle(0, ParticleState(Vector2D(100, 100), Vector2D(1, 0)));
+    EXPECT_DOUBLE_EQ(scheduler.substepDT(universe), 0.1); // Slow particles, maxSubstepDT limits
+
+    universe.addParticle(0, ParticleState(Vector2D(300, 300), Vector2D(0, 100)));
+    EXPECT_DOUBLE_EQ(scheduler.substepDT(universe), 0.5 * 2 / 100); // Fast particle moves at most 1 unit
+}
+
+TEST(StepSchedulerTest, SubstepsFollowBudget) {
+    Universe universe({ 400, 400, 1, 0 }, { ParticleType(1, 2, 1, 1, 10) });
+    universe.addParticle(0, ParticleState(Vector2D(100, 100)));
+
+    StepSchedulerConfig config;
+    config.frameTime = 0; // No time at all, use as few substeps as possible
+    config.minSubsteps = 2;
+    StepScheduler scheduler(config);
+    for(int i = 0; i < 3; ++i) {
+        scheduler.beginFrame();
+        scheduler.advanceFrame(universe);
+    }
+    EXPECT_EQ(scheduler.getSubsteps(), 2);
+    EXPECT_GT(scheduler.getSimulationSpeed(), 0);
+}
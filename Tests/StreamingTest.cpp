@@ -0,0 +1,114 @@
+#include "Lib/Streaming.h"
+#include "Lib/InputRecording.h"
+#include "Tests/Fixtures.h"
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+static void expectDecoded(Universe &universe, const DeltaDecoder &decoder) {
+    ASSERT_EQ(universe.size(), decoder.getParticles().size());
+    for(const ParticleState &p: universe) {
+        auto it = decoder.getParticles().find(p.id);
+        ASSERT_NE(decoder.getParticles().end(), it);
+        EXPECT_EQ(p.type - universe.getParticleTypes().data(), it->second.type);
+        EXPECT_NEAR(p.pos.x, it->second.pos().x, 0.5 / positionScale + 1e-9);
+        EXPECT_NEAR(p.pos.y, it->second.pos().y, 0.5 / positionScale + 1e-9);
+    }
+}
+
+TEST(StreamingTest, DeltaRoundTrip) {
+    UniverseConfig config{ 320, 200, 1e-2, 1e-2 };
+    config.threads = 1;
+    Universe universe(config, largeTestTypes);
+    addLattice(universe, 300, 25, 12, 10, 0.3);
+    DeltaEncoder encoder;
+    DeltaDecoder decoder;
+    std::vector<char> msg;
+
+    encoder.encode(universe, 12345, msg);
+    size_t fullSize = msg.size();
+    ASSERT_TRUE(decoder.decode(msg));
+    EXPECT_EQ(1, decoder.getFrame());
+    EXPECT_EQ(12345, decoder.getTimestamp());
+    expectDecoded(universe, decoder);
+
+    for(int frame = 0; frame < 10; ++frame) {
+        universe.advance(0.1);
+        if(frame == 3) universe.addParticle(1, ParticleState(Vector2D(300, 190)));
+        if(frame == 6) {
+            auto it = universe.begin();
+            for(int i = 0; i < 20; ++i)
+                it = universe.erase(it);
+        }
+        encoder.encode(universe, 0, msg);
+        ASSERT_TRUE(decoder.decode(msg));
+        expectDecoded(universe, decoder);
+        EXPECT_LT(msg.size(), fullSize);
+    }
+
+    msg.pop_back();
+    EXPECT_FALSE(DeltaDecoder().decode(msg));
+}
+
+static void expectServesViewer(const std::string &address) {
+    // The viewer holds the left button in create mode, so the server creates particles from its input
+    UniverseConfig config{ 320, 200, 1e-2, 1e-2 };
+    config.threads = 1;
+    Universe universe(config, largeTestTypes);
+    addLattice(universe, 100, 25, 12, 10, 0.3);
+    StreamListener listener(address);
+
+    size_t viewerParticles = 0;
+    bool viewerOk = true;
+    std::thread viewer([&]() {
+        std::unique_ptr<StreamConnection> connection = StreamConnection::connect(address);
+        std::vector<char> msg;
+        StreamHeader header;
+        viewerOk = connection->receive(msg, true) && header.decode(msg) && header.sizeX == 320
+                && header.radii.size() == 2 && header.radii[1] == 5.6;
+        DeltaDecoder decoder;
+        CallbackHandler handler(2);
+        handler.pos = Vector2D(160, 150);
+        handler.sign = 1;
+        while(connection->receive(msg, true)) {
+            viewerOk &= decoder.decode(msg);
+            msg.resize(sizeof(uint64_t) + InputFrame::encodedSize);
+            uint64_t timestamp = decoder.getTimestamp();
+            std::memcpy(msg.data(), & timestamp, sizeof(timestamp));
+            InputFrame(handler, 0).encode(msg.data() + sizeof(timestamp));
+            connection->send(msg);
+        }
+        viewerParticles = decoder.getParticles().size();
+    });
+
+    {
+        StreamServer server(universe, listener.accept());
+        CallbackHandler handler(2);
+        for(int frame = 0; frame < 30 && server.isConnected(); ++frame) {
+            server.receiveInput(handler);
+            UniverseModifier::modify(universe, handler, 0.5);
+            universe.advance(0.1);
+            server.sendFrame();
+            usleep(1000);
+        }
+        EXPECT_EQ(30, server.getFrames());
+        EXPECT_GT(server.getLatency(), 0);
+        EXPECT_LT(server.getMeanLatency(), 1);
+        EXPECT_LT(server.getBytes() / 30, 100 * 16); // Far less than 16 bytes per particle
+    } // Closes the connection
+    viewer.join();
+
+    EXPECT_TRUE(viewerOk);
+    EXPECT_GT(universe.size(), 100);
+    EXPECT_EQ(universe.size(), viewerParticles);
+}
+
+TEST(StreamingTest, LocalSocket) {
+    expectServesViewer("127.0.0.1:" + std::to_string(40000 + getpid() % 20000));
+}
+
+TEST(StreamingTest, UnixSocket) {
+    expectServesViewer("unix:" + std::string(P_tmpdir) + "/PhaseTransitionStream-" + std::to_string(getpid()));
+}
@@ -0,0 +1,80 @@
+
+#include "Lib/Universe.h"
+#include "Lib/Philox.h"
+#include <gtest/gtest.h>
+
+TEST(ThermostatTest, PhiloxKnownAnswers) {
+    // Known answer tests of the Random123 library
+    PhiloxCounter zero = philox4x32({ 0, 0, 0, 0 }, { 0, 0 });
+    EXPECT_EQ((PhiloxCounter{ 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 }), zero);
+    PhiloxCounter pi = philox4x32({ 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }, { 0xa4093822, 0x299f31d0 });
+    EXPECT_EQ((PhiloxCounter{ 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 }), pi);
+}
+
+static double temperature(Universe &universe, double minX = 0) {
+    ObservableBin sum;
+    for(auto it = universe.begin(); it != universe.end(); ++it) {
+        if(it->pos.x < minX) continue;
+        double mass = it->type->getMass();
+        ++sum.n;
+        sum.mass += mass;
+        sum.momentum += it->v * mass;
+        sum.kineticEnergy += it->v.magnitude2() * mass / 2;
+    }
+    return sum.temperature();
+}
+
+static void addGas(Universe &universe) {
+    for(int i = 0; i < 400; ++i)
+        universe.addParticle(i % 2, ParticleState(Vector2D(5 + 10 * (i % 20), 5 + 10 * (i / 20)),
+                Vector2D(0.1 * std::sin(i), 0.1 * std::cos(i))));
+}
+
+TEST(ThermostatTest, Langevin) {
+    // Non-interacting particles of different masses reach the target temperature, independently of thread count
+    std::vector<ParticleType> types = { ParticleType(1, 1, 0, 0, 5), ParticleType(3, 1, 0, 0, 5) };
+    std::vector<Universe> universes;
+    universes.reserve(2);
+    for(int threads: { 1, 3 }) {
+        UniverseConfig config{ 200, 200, 0, 0 };
+        config.threads = threads;
+        universes.emplace_back(config, types);
+        addGas(universes.back());
+        Thermostat thermostat;
+        thermostat.temperature = 2;
+        thermostat.coupling = 1;
+        universes.back().setThermostats({ thermostat }, 42);
+        for(int i = 0; i < 50; ++i)
+            universes.back().advance(0.1);
+    }
+
+    EXPECT_NEAR(2, temperature(universes[0]), 0.3);
+    for(auto it0 = universes[0].begin(), it1 = universes[1].begin(); it0 != universes[0].end(); ++it0, ++it1) {
+        EXPECT_EQ(it0->id, it1->id);
+        EXPECT_EQ(it0->v.x, it1->v.x);
+        EXPECT_EQ(it0->v.y, it1->v.y);
+    }
+}
+
+TEST(ThermostatTest, BerendsenRegion) {
+    // Only the right half is cooled, the rest keeps its temperature
+    std::vector<ParticleType> types = { ParticleType(1, 1, 0, 0, 5), ParticleType(3, 1, 0, 0, 5) };
+    Universe universe({ 200, 200, 0, 0 }, types);
+    addGas(universe);
+    double initial = temperature(universe, 100);
+    Thermostat thermostat;
+    thermostat.type = ThermostatType::berendsen;
+    thermostat.temperature = initial / 4;
+    thermostat.coupling = 0.5;
+    thermostat.minX = 100;
+    universe.setThermostats({ thermostat });
+
+    for(int i = 0; i < 200; ++i)
+        universe.advance(0.1);
+    EXPECT_NEAR(initial / 4, temperature(universe, 100), 1e-3 * initial);
+    for(auto it = universe.begin(); it != universe.end(); ++it) {
+        if(it->pos.x < 90) {
+            EXPECT_NEAR(0.1, it->v.magnitude(), 1e-12);
+        }
+    }
+}
@@ -1,5 +1,7 @@
 
 #include "Lib/Universe.h"
+#include "Lib/Conservation.h"
+#include "Tests/Fixtures.h"
 #include <gtest/gtest.h>
 
 TEST(UniverseTest, IteratorTest) {
@@ -61,3 +63,202 @@ TEST(UniverseTest, Gravity) {
 
     ASSERT_GT((universe.begin())->pos.y, state.pos.y);
 }
+
+TEST(UniverseTest, AdaptiveMatchesRungeKutta) {
+    std::vector<ParticleType> types = { ParticleType(1, 1, 1, 1, 10) };
+    Universe fixed({ 20, 20, 1, 0 }, types), adaptive({ 20, 20, 1, 0 }, types);
+    for(Universe *universe: { &fixed, &adaptive }) {
+        universe->addParticle(0, ParticleState(Vector2D(5, 10.1), Vector2D(1, 0)));
+        universe->addParticle(0, ParticleState(Vector2D(6, 10)));
+    }
+
+    AdaptiveStepControl control;
+    control.tolerance = 1e-8;
+    for(int i = 0; i < 10; ++i) {
+        fixed.advance(1e-3);
+        adaptive.advanceAdaptive(1e-3, control);
+    }
+
+    EXPECT_NEAR(fixed.begin()->pos.x, adaptive.begin()->pos.x, 1e-6);
+    EXPECT_NEAR(fixed.begin()->pos.y, adaptive.begin()->pos.y, 1e-6);
+    EXPECT_GT(control.accepted, 0);
+}
+
+TEST(UniverseTest, BlockTimestepsGravity) {
+    UniverseConfig config{ 10, 10, 0, 1 };
+    config.maxTimestepLevel = 3;
+    Universe universe(config, { ParticleType(1, 1, 0, 0, 0) });
+    universe.addParticle(0, ParticleState(Vector2D(5, 1), Vector2D(1, 0)));
+
+    for(int i = 0; i < 10; ++i) universe.advance(0.2); // Leapfrog is exact for constant acceleration
+    EXPECT_NEAR(universe.begin()->pos.x, 7, 1e-9);
+    EXPECT_NEAR(universe.begin()->pos.y, 3, 1e-9);
+}
+
+TEST(UniverseTest, BlockTimestepsMatchRungeKutta) {
+    std::vector<ParticleType> types = { ParticleType(1, 1, 1, 1, 10) };
+    UniverseConfig blockConfig{ 20, 20, 1, 0 };
+    blockConfig.maxTimestepLevel = 4;
+    Universe fixed({ 20, 20, 1, 0 }, types), block(blockConfig, types);
+    for(Universe *universe: { &fixed, &block }) {
+        universe->addParticle(0, ParticleState(Vector2D(5, 10.1), Vector2D(1, 0)));
+        universe->addParticle(0, ParticleState(Vector2D(6, 10)));
+        universe->addParticle(0, ParticleState(Vector2D(15, 15))); // Far away, stays at the largest timestep
+    }
+
+    for(int i = 0; i < 100; ++i) {
+        for(int j = 0; j < 16; ++j) fixed.advance(1e-2 / 16);
+        block.advance(1e-2);
+    }
+
+    auto itFixed = fixed.begin(), itBlock = block.begin();
+    for(; itFixed != fixed.end(); ++itFixed, ++itBlock) {
+        EXPECT_NEAR(itFixed->pos.x, itBlock->pos.x, 1e-3);
+        EXPECT_NEAR(itFixed->pos.y, itBlock->pos.y, 1e-3);
+    }
+}
+
+TEST(UniverseTest, SparseGrid) {
+    UniverseState state;
+    state.setInteractionDistance({ 100000, 100000, 1, 0 }, 10);
+    ParticleType type(1, 1, 1, 1, 10);
+    for(int i = 0; i < 100; ++i) {
+        ParticleState pState(Vector2D(50000 + 2 * (i % 10), 50000 + 2 * (i / 10)));
+        pState.type = &type;
+        state.insert(pState);
+    }
+    state.prepareDifferentiation();
+    EXPECT_TRUE(state.sparse);
+    EXPECT_EQ(4, state.cells.size());
+    EXPECT_EQ(0, state.cellIndex(5000, 5000));
+    EXPECT_EQ(-1, state.cellIndex(0, 0));
+
+    UniverseState small;
+    small.setInteractionDistance({ 20, 20, 1, 0 }, 10);
+    for(auto it = state.begin(); it != state.end(); ++it) {
+        ParticleState pState = *it;
+        pState.pos -= Vector2D(50000, 50000);
+        small.insert(pState);
+    }
+    small.prepareDifferentiation();
+    EXPECT_FALSE(small.sparse);
+    EXPECT_EQ(9, small.cells.size());
+    EXPECT_EQ(100, small.size());
+}
+
+TEST(UniverseTest, SparseMatchesDense) {
+    std::vector<ParticleType> types = { ParticleType(1, 1, 1, 1, 10) };
+    Universe dense({ 20, 20, 1, 0 }, types), sparse({ 100000, 100000, 1, 0 }, types);
+    for(int i = 0; i < 20; ++i) {
+        Vector2D pos(4 + 1.5 * (i % 5), 4 + 1.5 * (i / 5));
+        dense.addParticle(0, ParticleState(pos, Vector2D(0.1 * i, 0)));
+        sparse.addParticle(0, ParticleState(pos + Vector2D(50000, 50000), Vector2D(0.1 * i, 0)));
+    }
+
+    for(int i = 0; i < 20; ++i) {
+        dense.advance(1e-2);
+        sparse.advance(1e-2);
+    }
+
+    Vector2D denseSum, sparseSum;
+    for(auto it = dense.begin(); it != dense.end(); ++it) denseSum += it->pos;
+    for(auto it = sparse.begin(); it != sparse.end(); ++it) sparseSum += it->pos - Vector2D(50000, 50000);
+    EXPECT_NEAR(denseSum.x, sparseSum.x, 1e-6);
+    EXPECT_NEAR(denseSum.y, sparseSum.y, 1e-6);
+}
+
+TEST(UniverseTest, FinerCells) {
+    std::vector<ParticleType> types = { ParticleType(1, 1, 1, 1, 10), ParticleType(1, 1, 1, 1, 4) };
+    std::vector<Universe> universes;
+    universes.reserve(3); // Particles point to the types of their Universe
+    for(int cellsPerRange = 1; cellsPerRange <= 3; ++cellsPerRange) {
+        UniverseConfig config{ 60, 60, 1, 0 };
+        config.cellsPerRange = cellsPerRange;
+        universes.emplace_back(config, types);
+        for(int i = 0; i < 200; ++i)
+            universes.back().addParticle(i % 2, ParticleState(Vector2D(3 * (i % 20), 3 * (i / 20)), Vector2D(0.1, 0)));
+        universes.back().advance(1e-2);
+    }
+
+    PairCounts coarse = universes[0].countPairs();
+    for(size_t i = 1; i < universes.size(); ++i) {
+        PairCounts fine = universes[i].countPairs();
+        EXPECT_EQ(coarse.inRange, fine.inRange);
+        EXPECT_LT(fine.candidates, coarse.candidates);
+
+        Vector2D coarseSum, fineSum;
+        for(auto it = universes[0].begin(); it != universes[0].end(); ++it) coarseSum += it->pos;
+        for(auto it = universes[i].begin(); it != universes[i].end(); ++it) fineSum += it->pos;
+        EXPECT_NEAR(coarseSum.x, fineSum.x, 1e-6);
+        EXPECT_NEAR(coarseSum.y, fineSum.y, 1e-6);
+    }
+}
+
+TEST(UniverseTest, ObservablesOfPair) {
+    ParticleType type(1, 1, 1, 1, 10);
+    Universe universe({ 20, 20, 1, 0 }, { type });
+    universe.addParticle(0, ParticleState(Vector2D(8, 10), Vector2D(1, 0)));
+    universe.addParticle(0, ParticleState(Vector2D(10.5, 10), Vector2D(-1, 0)));
+    universe.observe(5);
+    universe.advance(1e-2);
+
+    ASSERT_EQ(1, universe.getObservations().size());
+    const ObservableGrid &grid = universe.getObservations().back().grid;
+    EXPECT_EQ(25, grid.bins.size());
+    ObservableBin total = grid.total();
+    EXPECT_EQ(2, total.n);
+    EXPECT_DOUBLE_EQ(1, total.kineticEnergy);
+    EXPECT_DOUBLE_EQ(1, total.thermalEnergy());
+    EXPECT_NEAR(type.computePotential(type, 2.5), total.potentialEnergy, 1e-3 * std::abs(total.potentialEnergy));
+    EXPECT_DOUBLE_EQ(2.5 * type.computeForceMagnitude(type, 2.5), total.virial);
+    EXPECT_EQ(1, grid.bins[2 * 5 + 1].n); // Pair quantities are split between the bins
+    EXPECT_DOUBLE_EQ(total.virial / 2, grid.bins[2 * 5 + 2].virial);
+}
+
+TEST(UniverseTest, ObservablesConserveEnergy) {
+    // Total energy is conserved with a short enough timestep, which also checks the sign of the potential
+    std::vector<Universe> universes;
+    universes.reserve(2);
+    for(int threads = 1; threads <= 2; ++threads) {
+        UniverseConfig config{ 60, 60, 1, 0 };
+        config.threads = threads;
+        universes.emplace_back(config, testTypes);
+        addLattice(universes.back(), 100, 10, 4, 10, 0.2);
+        universes.back().observe(20, 150);
+        for(int i = 0; i < 200; ++i)
+            universes.back().advance(1e-2);
+    }
+
+    const auto &observations = universes[0].getObservations();
+    ASSERT_EQ(150, observations.size());
+    EXPECT_NEAR(0.5, observations.front().time, 1e-9);
+    ObservableBin first = observations.front().grid.total(), last = observations.back().grid.total();
+    double exchanged = std::abs(first.potentialEnergy - last.potentialEnergy);
+    EXPECT_GT(exchanged, 10);
+    EXPECT_NEAR(first.kineticEnergy + first.potentialEnergy, last.kineticEnergy + last.potentialEnergy,
+            1e-3 * exchanged);
+
+    ObservableBin threaded = universes[1].getObservations().back().grid.total();
+    EXPECT_NEAR(last.potentialEnergy, threaded.potentialEnergy, 1e-9);
+    EXPECT_NEAR(last.virial, threaded.virial, 1e-9);
+}
+
+TEST(UniverseTest, ConservationTracker) {
+    ObservableSample sample{ 0, {} };
+    sample.grid.reset(10, 10, 10);
+    sample.grid.bins[0].kineticEnergy = 3;
+    sample.grid.bins[0].potentialEnergy = -1;
+    sample.grid.bins[0].momentum = Vector2D(1, 0);
+
+    ConservationTracker tracker;
+    tracker.add(sample);
+    sample.grid.bins[0].kineticEnergy = 3.4; // Total energy 2 -> 2.4, scale 3 + 1
+    sample.grid.bins[0].momentum = Vector2D(1, 0.5);
+    tracker.add(sample);
+    sample.grid.bins[0].kineticEnergy = 3;
+    tracker.add(sample);
+
+    EXPECT_EQ(3, tracker.samples());
+    EXPECT_NEAR(0.1, tracker.energyDrift(), 1e-12);
+    EXPECT_NEAR(0.5, tracker.momentumDrift(), 1e-12);
+}
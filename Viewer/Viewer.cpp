@@ -0,0 +1,89 @@
+
+#include <iostream>
+#include <cstring>
+#include <SDL2/SDL.h>
+#include "Lib/Streaming.h"
+#include "Lib/InputRecording.h"
+
+/*
+ * Thin viewer of a Server. Draws the particles it receives as colored squares and sends the mouse and keyboard
+ * input back, which is handled as in PhaseTransition.
+ *
+ * Usage: Viewer address
+ * address is host:port (e.g. 127.0.0.1:7000) or unix:path
+ */
+
+int main(int argc, char **argv) {
+    if(argc != 2) {
+        std::cout << "Usage: Viewer address" << std::endl;
+        return 1;
+    }
+    std::unique_ptr<StreamConnection> connection = StreamConnection::connect(argv[1]);
+    std::vector<char> msg;
+    StreamHeader header;
+    if(! connection->receive(msg, true) || ! header.decode(msg)) {
+        std::cout << "Invalid stream header from " << argv[1] << std::endl;
+        return 1;
+    }
+
+    if(SDL_Init(SDL_INIT_VIDEO) < 0) {
+        std::cout << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
+        return 1;
+    }
+    SDL_Window *window = SDL_CreateWindow("Phase Transition Viewer", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+            header.sizeX, header.sizeY, SDL_WINDOW_SHOWN);
+    if(window == nullptr) {
+        std::cout << "Window could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+        return 1;
+    }
+    SDL_Surface *surface = SDL_GetWindowSurface(window);
+    const Uint8 palette[][3] = { { 80, 160, 255 }, { 255, 200, 60 }, { 200, 80, 80 }, { 120, 220, 120 } };
+
+    CallbackHandler handler(header.radii.size());
+    DeltaDecoder decoder;
+    while(! handler.quit) {
+        // Waits for a frame, then catches up with any frames that arrived meanwhile
+        bool received = false;
+        for(bool wait = true; connection->receive(msg, wait); wait = false) {
+            if(! decoder.decode(msg)) {
+                std::cout << "Invalid frame from " << argv[1] << std::endl;
+                return 1;
+            }
+            received = true;
+        }
+        if(! received) break; // Server closed the connection
+
+        SDL_FillRect(surface, nullptr, 0x000000);
+        for(const auto &idParticle: decoder.getParticles()) {
+            const StreamParticle &p = idParticle.second;
+            double r = p.type < (int) header.radii.size() ? header.radii[p.type] : 1;
+            const Uint8 *color = palette[p.type % 4];
+            Vector2D pos = p.pos();
+            SDL_Rect rect{ (int) (pos.x - r), (int) (pos.y - r), (int) (2 * r), (int) (2 * r) };
+            SDL_FillRect(surface, & rect, SDL_MapRGB(surface->format, color[0], color[1], color[2]));
+        }
+        SDL_UpdateWindowSurface(window);
+
+        handler.rewindPoints = 0;
+        SDL_Event event;
+        while(SDL_PollEvent(& event)) {
+            if(event.type == SDL_QUIT)
+                handler.quit = true;
+            if(event.type == SDL_KEYDOWN)
+                handler.keyboardCallback(event);
+            if(event.type == SDL_MOUSEMOTION || event.type == SDL_MOUSEWHEEL
+                    || event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP)
+                handler.mouseCallback(event);
+        }
+
+        msg.resize(sizeof(uint64_t) + InputFrame::encodedSize);
+        uint64_t timestamp = decoder.getTimestamp();
+        std::memcpy(msg.data(), & timestamp, sizeof(timestamp));
+        InputFrame(handler, 0).encode(msg.data() + sizeof(timestamp));
+        connection->send(msg);
+    }
+
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}